@@ -2,9 +2,11 @@
 // Copyright (C) 2016 Thoralt Franz, https://github.com/thoralt
 //
 //  This class reads the analog input with an attached light dependent resistor
-//  (pullup to VCC, LDR to ground), filters the resulting ADC values with an
-//  moving average filter and calculates a brightness value using an interpolation
-//  on a curve defined by several points.
+//  (pullup to VCC, LDR to ground) at a fixed rate, filters the resulting ADC values
+//  with an integer moving average filter and looks up a brightness value in a table
+//  interpolated once from a curve defined by several points in the configuration. A
+//  hysteresis on the filtered ADC value keeps sensor noise from changing the
+//  brightness, small changes are still taken over once they have persisted.
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -20,6 +22,8 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <Arduino.h>
 #include "brightness.h"
+#include "config.h"
+#include "lighthistory.h"
 
 //---------------------------------------------------------------------------------------
 // global instance
@@ -29,114 +33,143 @@ BrightnessClass Brightness = BrightnessClass();
 //---------------------------------------------------------------------------------------
 // BrightnessClass
 //
-// Constructor, initializes filter with current ADC value
+// Constructor. The filter is initialized with the first ADC sample in value().
 //
 // -> --
 // <- --
 //---------------------------------------------------------------------------------------
 BrightnessClass::BrightnessClass()
 {
-	this->avg = analogRead(A0);
+}
+
+//---------------------------------------------------------------------------------------
+// begin
+//
+// Compiles the ambient light curve, must be called after the configuration has been
+// loaded
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void BrightnessClass::begin()
+{
+	this->loadCurve();
 }
 
 //---------------------------------------------------------------------------------------
 // filter
 //
-// Exponential moving average filter, implements the following behaviour:
+// Exponential moving average filter in fixed point, implements the following behaviour:
 //
-//   output = (1-coeff)*last_output + coeff*input with coeff = 0.01
+//   output = (1-coeff)*last_output + coeff*input with coeff = 1/2^BRIGHTNESS_FILTER_SHIFT
 //
-// -> input: filter input
+// -> input: raw ADC value [0...1023]
 // <- --
 //---------------------------------------------------------------------------------------
-float BrightnessClass::filter(float input)
+void BrightnessClass::filter(uint32_t input)
 {
-#define COEFF 0.01f
-	return (1.0f - COEFF) * this->avg + (COEFF * input);
-
-//	float result = (1.0f - COEFF) * this->avg + (COEFF * input);
-//	Serial.print("BrightnessClass::filter(input="); Serial.print(input, 3);
-//	Serial.print("): this->avg="); Serial.print(this->avg, 3);
-//	Serial.print(", result="); Serial.print(result, 3); Serial.print("\r\n");
-//	return result;
+	int32_t delta = (int32_t)(input << BRIGHTNESS_AVG_SHIFT) - (int32_t)this->avg;
+	this->avg += delta >> BRIGHTNESS_FILTER_SHIFT;
+}
 
-//#define ALPHA(x) ((uint16_t)(x * 65535.0f))
-//#define FILTER_COEFFICIENT ALPHA(0.01)
-//	uint32_t tmp = (65536 - FILTER_COEFFICIENT) * this->avg
-//			     + FILTER_COEFFICIENT * (uint32_t)input;
-//	uint32_t result = (tmp + 32768) >> 16;
-//	Serial.printf("BrightnessClass::filter(input=%d): this->avg=%d, tmp=%d, result=%d\r\n",
-//			input, this->avg, tmp, result);
-//	return (tmp + 32768) >> 16;
+//---------------------------------------------------------------------------------------
+// filteredAdc
+//
+// -> --
+// <- filtered ADC value rounded to an integer, the filter stops up to
+//    2^BRIGHTNESS_FILTER_SHIFT - 1 fractional steps below a rising input
+//---------------------------------------------------------------------------------------
+uint32_t BrightnessClass::filteredAdc()
+{
+	return (this->avg + (1 << (BRIGHTNESS_AVG_SHIFT - 1))) >> BRIGHTNESS_AVG_SHIFT;
 }
 
 //---------------------------------------------------------------------------------------
-// getBrightnessForADCValue
+// loadCurve
 //
-// Calculates a brightness value for a given ADC value using a table and interpolation.
+// Calculates the brightness for each ADC value by linear interpolation on the ambient
+// light curve in Config.lightCurve. Must be called after the curve has been changed.
 //
-// -> adcValue: input value [0...1023]
-// <- brightness [0...256]
+// -> --
+// <- --
 //---------------------------------------------------------------------------------------
-uint32_t BrightnessClass::getBrightnessForADCValue(uint32_t adcValue)
+void BrightnessClass::loadCurve()
 {
-//	float lightTable[] = {
-//		0, 15,
-//		59, 18,
-//		67, 32,
-//		155, 64,
-//		600, 128,
-//		800, 256,
-//		1024, 256,
-//		-1, -1
-//	};
-
-	float lightTable[] = {
-		0, 160,
-		300, 96,
-		680, 64,
-		800, 32,
-		900, 15,
-		1023, 15,
-		-1, -1
-	};
+	const light_curve_t *curve = ConfigClass::isValidLightCurve(Config.lightCurve) ?
+			&Config.lightCurve : &ConfigClass::defaultLightCurve;
+	const light_point *p = curve->points;
+	int i = 0;
+	int x1, y1, x2, y2, result;
 
-	if(this->brightnessOverride<256)
+	for(int adc = 0; adc < 1024; adc++)
 	{
-		return this->brightnessOverride;
-	}
+		while(i < curve->count - 2 && adc >= p[i + 1].adc) i++;
+		x1 = p[i].adc;     y1 = p[i].brightness;
+		x2 = p[i + 1].adc; y2 = p[i + 1].brightness;
 
-	int i = 0;
-	while (lightTable[i] != -1)
-	{
-		if (adcValue >= lightTable[i] && adcValue < lightTable[i + 2])
-		{
-			float x1 = lightTable[i + 0];
-			float y1 = lightTable[i + 1];
-			float x2 = lightTable[i + 2];
-			float y2 = lightTable[i + 3];
-			float result = y1 + ((float)adcValue - x1) * (y2 - y1) / (x2 - x1);
-			return (int) result;
-		}
-		i += 2;
-	}
+		if(adc <= x1) result = y1;
+		else if(adc >= x2) result = y2;
+		else result = y1 + (adc - x1) * (y2 - y1) / (x2 - x1);
 
-	return 0;
+		this->lut[adc] = (result > 255) ? 255 : (result < 0) ? 0 : result;
+	}
 }
 
 //---------------------------------------------------------------------------------------
 // value
 //
-// Triggers a new sample to be read from light sensor, returns value from average filter
+// Reads a new sample from the light sensor if sampleInterval has passed and returns
+// the brightness for the filtered value. The value in use only follows the filtered
+// value if they differ by more than the hysteresis or if the filtered value has stayed
+// above or below it for BRIGHTNESS_SETTLE_SAMPLES samples.
 //
 // -> --
-// <- low pass filtered brightness value
+// <- low pass filtered brightness value [0...256]
 //---------------------------------------------------------------------------------------
 uint32_t BrightnessClass::value()
 {
-	// read next ADC value and apply filter
-	this->avg = this->filter(analogRead(A0));
+	if(this->brightnessOverride<256)
+	{
+		return this->brightnessOverride;
+	}
+
+	uint32_t now = millis();
+	if(!this->initialized)
+	{
+		this->initialized = true;
+		this->lastSample = now;
+		uint32_t adc = analogRead(A0);
+		LightHistory.sample(adc);
+		this->avg = adc << BRIGHTNESS_AVG_SHIFT;
+		this->level = adc;
+	}
+	else if(now - this->lastSample >= this->sampleInterval)
+	{
+		this->lastSample = now;
+		uint32_t adc = analogRead(A0);
+		LightHistory.sample(adc);
+		this->filter(adc);
+
+		// noise around the value in use keeps changing sides and restarts the count
+		uint32_t filtered = this->filteredAdc();
+		int side = (filtered > this->level) - (filtered < this->level);
+		if(side == 0 || side != this->settleSide) this->settleSamples = 0;
+		else this->settleSamples++;
+		this->settleSide = side;
+	}
+
+	// follow large changes at once and small ones once they have persisted
+	uint32_t filtered = this->filteredAdc();
+	uint32_t delta = (filtered > this->level) ?
+			filtered - this->level : this->level - filtered;
+	if(delta > BRIGHTNESS_HYSTERESIS || this->settleSamples >= BRIGHTNESS_SETTLE_SAMPLES)
+	{
+		this->level = filtered;
+		this->settleSamples = 0;
+		this->settleSide = 0;
+	}
 
-	// calculate brightness value for filtered ADC value
-	return this->getBrightnessForADCValue(this->avg);
+	// the table also picks up a changed curve
+	uint32_t output = this->lut[this->level];
+	return (output == 255) ? 256 : output;
 }
@@ -20,21 +20,51 @@
 
 #include <stdint.h>
 
+// interval between two samples of the light sensor in ms
+#define BRIGHTNESS_SAMPLE_INTERVAL 100
+
+// EMA filter coefficient as power of 2: avg += (input - avg) / 2^BRIGHTNESS_FILTER_SHIFT
+#define BRIGHTNESS_FILTER_SHIFT 3
+
+// fractional bits of the filtered ADC value
+#define BRIGHTNESS_AVG_SHIFT 8
+
+// the brightness follows the filtered ADC value once it differs by more than
+// BRIGHTNESS_HYSTERESIS from the value in use, smaller differences are taken over once
+// they kept their sign for BRIGHTNESS_SETTLE_SAMPLES samples, so the output converges
+// while noise around the value in use is ignored
+#define BRIGHTNESS_HYSTERESIS 4
+#define BRIGHTNESS_SETTLE_SAMPLES 50
+
 class BrightnessClass
 {
 public:
 	BrightnessClass();
+	void begin();
+	void loadCurve();
 	uint32_t value();
 
-	float avg = 0;
+	// filtered ADC value with BRIGHTNESS_AVG_SHIFT fractional bits
+	uint32_t avg = 0;
 	uint32_t brightnessOverride = 256;
+	uint32_t sampleInterval = BRIGHTNESS_SAMPLE_INTERVAL;
 
 private:
-	uint32_t getBrightnessForADCValue(uint32_t adcValue);
-	float filter(float input);
+	void filter(uint32_t input);
+	uint32_t filteredAdc();
+
+	// brightness for each ADC value, 255 stands for full brightness (256)
+	uint8_t lut[1024];
+
+	// filtered ADC value the brightness is taken from, number of samples the filtered
+	// value has been on the same side of it and that side (-1, 0 or 1)
+	uint32_t level = 0;
+	uint32_t settleSamples = 0;
+	int settleSide = 0;
+	uint32_t lastSample = 0;
+	bool initialized = false;
 };
 
 extern BrightnessClass Brightness;
 
 #endif
-
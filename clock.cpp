@@ -0,0 +1,288 @@
+// ESP8266 Wordclock
+// Copyright (C) 2016 Thoralt Franz, https://github.com/thoralt
+//
+//  This class keeps the time of the clock. It is derived from the monotonic
+//  microsecond counter of the ESP8266 (micros64(), does not wrap) and an offset to
+//  UTC which is set from NTP, so the time neither drifts with the jitter of a timer
+//  nor advances in steps. Until the first synchronization the offset is zero and the
+//  clock counts from 00:00:00 at boot.
+//  Each NTP sample is passed to discipline(). The first sample and offsets beyond
+//  CLOCK_STEP_THRESHOLD set the time at once, smaller offsets are slewed with at most
+//  CLOCK_SLEW_RATE ppm, so the seconds display never jumps. The offset that remains
+//  after the previous correction, divided by the time since, is the frequency error
+//  of the oscillator; a part of it is added to the frequency correction on every
+//  sample (frequency locked loop). The correction is stored in Config.clockDrift, so
+//  the clock runs accurately right after a reboot.
+//  The model is kept in two slots and a sequence counter. The writer (discipline(),
+//  setDrift() and adjust(), one context only) fills the slot which is not in use and
+//  then increments the counter to publish it. Readers copy the published slot and
+//  retry if the counter changed meanwhile. Neither side ever waits for the other, so
+//  reading is safe from timer callbacks and interrupts, even if they interrupt the
+//  writer.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <Arduino.h>
+#include "clock.h"
+#include "config.h"
+
+//---------------------------------------------------------------------------------------
+// global instance
+//---------------------------------------------------------------------------------------
+ClockClass Clock = ClockClass();
+
+// keeps the compiler from moving memory accesses across the sequence counter
+#define CLOCK_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+//---------------------------------------------------------------------------------------
+// ClockClass
+//
+// Constructor, starts counting from 00:00:00
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+ClockClass::ClockClass()
+{
+	memset(this->base, 0, sizeof(this->base));
+}
+
+//---------------------------------------------------------------------------------------
+// monotonic
+//
+// -> --
+// <- microseconds since boot, never jumps
+//---------------------------------------------------------------------------------------
+uint64_t ClockClass::monotonic()
+{
+	return micros64();
+}
+
+//---------------------------------------------------------------------------------------
+// now
+//
+// -> --
+// <- UTC in microseconds since 1970, microseconds since boot if not synchronized yet
+//---------------------------------------------------------------------------------------
+uint64_t ClockClass::now()
+{
+	clock_base_t base;
+	this->read(base);
+	return toUTC(base, micros64());
+}
+
+//---------------------------------------------------------------------------------------
+// discipline
+//
+// Corrects the clock with a sample of its offset, steps the time for the first sample
+// and large offsets and slews it otherwise. Updates the frequency correction from the
+// offset which remains after the previous correction.
+//
+// -> offset: UTC minus the current time of the clock in microseconds
+//    localOffset: seconds the local time is ahead of UTC (time zone and DST)
+// <- --
+//---------------------------------------------------------------------------------------
+void ClockClass::discipline(int64_t offset, int32_t localOffset)
+{
+	clock_base_t base;
+	this->read(base);
+	uint64_t now = micros64();
+	int64_t utc = toUTC(base, now);
+
+	if(!base.synchronized || offset > CLOCK_STEP_THRESHOLD ||
+			offset < -CLOCK_STEP_THRESHOLD)
+	{
+		utc += offset;
+		base.slew = 0;
+		this->steps++;
+	}
+	else
+	{
+		// the part of the previous offset which has not been slewed yet is contained in
+		// the new offset, the rest has accumulated since the last sample
+		int64_t residual = offset - (base.slew - slewed(base, now));
+		int64_t interval = now - this->lastSample;
+		if(interval >= (int64_t) CLOCK_FLL_MIN_INTERVAL * 1000000)
+		{
+			int64_t frequency = base.frequency +
+					residual * 1000000000 / interval / CLOCK_FLL_GAIN;
+			base.frequency = constrain(frequency, -MAX_CLOCK_DRIFT, MAX_CLOCK_DRIFT);
+		}
+		this->jitter += ((int32_t) abs(residual) - this->jitter) / 4;
+		base.slew = offset;
+	}
+
+	base.reference = now;
+	base.offset = utc - now;
+	base.localOffset = localOffset;
+	base.synchronized = true;
+	this->lastSample = now;
+	this->write(base);
+}
+
+//---------------------------------------------------------------------------------------
+// adjust
+//
+// Shifts the time by a number of seconds (for testing purposes)
+//
+// -> seconds: time shift, may be negative
+// <- --
+//---------------------------------------------------------------------------------------
+void ClockClass::adjust(int32_t seconds)
+{
+	clock_base_t base;
+	this->read(base);
+	base.offset += (int64_t) seconds * 1000000;
+	this->write(base);
+}
+
+//---------------------------------------------------------------------------------------
+// getLocalTime
+//
+// Calculates the current local time from one consistent copy of the clock model
+//
+// -> time: receives hours, minutes, seconds and milliseconds
+// <- --
+//---------------------------------------------------------------------------------------
+void ClockClass::getLocalTime(clock_time_t &time)
+{
+	clock_base_t base;
+	this->read(base);
+
+	uint64_t t = toUTC(base, micros64()) + (int64_t) base.localOffset * 1000000;
+	uint32_t seconds = (t / 1000000) % 86400;
+	time.ms = (t % 1000000) / 1000;
+	time.s = seconds % 60;
+	time.m = (seconds / 60) % 60;
+	time.h = seconds / 3600;
+	time.synchronized = base.synchronized;
+}
+
+//---------------------------------------------------------------------------------------
+// isSynchronized
+//
+// -> --
+// <- true once the time has been set by NTP
+//---------------------------------------------------------------------------------------
+bool ClockClass::isSynchronized()
+{
+	clock_base_t base;
+	this->read(base);
+	return base.synchronized;
+}
+
+//---------------------------------------------------------------------------------------
+// getDrift
+//
+// -> --
+// <- frequency correction of the oscillator in ppb
+//---------------------------------------------------------------------------------------
+int32_t ClockClass::getDrift()
+{
+	clock_base_t base;
+	this->read(base);
+	return base.frequency;
+}
+
+//---------------------------------------------------------------------------------------
+// setDrift
+//
+// Sets the frequency correction, e. g. the value stored before the last reboot
+//
+// -> drift: frequency correction in ppb [-MAX_CLOCK_DRIFT...MAX_CLOCK_DRIFT]
+// <- --
+//---------------------------------------------------------------------------------------
+void ClockClass::setDrift(int32_t drift)
+{
+	clock_base_t base;
+	this->read(base);
+	uint64_t now = micros64();
+	int64_t utc = toUTC(base, now);
+
+	// keep the current time, the remaining slew continues from now on
+	base.slew -= slewed(base, now);
+	base.frequency = constrain(drift, -MAX_CLOCK_DRIFT, MAX_CLOCK_DRIFT);
+	base.reference = now;
+	base.offset = utc - now;
+	this->write(base);
+}
+
+//---------------------------------------------------------------------------------------
+// toUTC
+//
+// Applies the clock model to a monotonic time
+//
+// -> base: clock model
+//    monotonic: microseconds since boot, not before base.reference
+// <- UTC in microseconds since 1970
+//---------------------------------------------------------------------------------------
+uint64_t ClockClass::toUTC(const clock_base_t &base, uint64_t monotonic)
+{
+	// whole seconds and the rest are scaled separately, elapsed * frequency would
+	// overflow after 213 days without a sample at MAX_CLOCK_DRIFT
+	int64_t elapsed = monotonic - base.reference;
+	int64_t correction = (elapsed / 1000000 * base.frequency +
+			elapsed % 1000000 * base.frequency / 1000000) / 1000;
+	return monotonic + base.offset + correction + slewed(base, monotonic);
+}
+
+//---------------------------------------------------------------------------------------
+// slewed
+//
+// -> base: clock model
+//    monotonic: microseconds since boot, not before base.reference
+// <- part of base.slew applied until the given time
+//---------------------------------------------------------------------------------------
+int32_t ClockClass::slewed(const clock_base_t &base, uint64_t monotonic)
+{
+	int64_t limit = (int64_t)(monotonic - base.reference) * CLOCK_SLEW_RATE / 1000000;
+	if(base.slew >= 0) return std::min((int64_t) base.slew, limit);
+	return -std::min((int64_t) -base.slew, limit);
+}
+
+//---------------------------------------------------------------------------------------
+// read
+//
+// Copies the published clock model, retries if a new one was published meanwhile
+//
+// -> target: receives the clock model
+// <- --
+//---------------------------------------------------------------------------------------
+void ClockClass::read(clock_base_t &target)
+{
+	uint32_t sequence;
+	do
+	{
+		sequence = this->sequence;
+		CLOCK_BARRIER();
+		target = this->base[sequence & 1];
+		CLOCK_BARRIER();
+	}
+	while(sequence != this->sequence);
+}
+
+//---------------------------------------------------------------------------------------
+// write
+//
+// Fills the unused slot and publishes it
+//
+// -> source: new clock model
+// <- --
+//---------------------------------------------------------------------------------------
+void ClockClass::write(const clock_base_t &source)
+{
+	uint32_t sequence = this->sequence;
+	this->base[(sequence + 1) & 1] = source;
+	CLOCK_BARRIER();
+	this->sequence = sequence + 1;
+}
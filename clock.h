@@ -0,0 +1,96 @@
+// ESP8266 Wordclock
+// Copyright (C) 2016 Thoralt Franz, https://github.com/thoralt
+//
+//  See clock.cpp for description.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _CLOCK_H_
+#define _CLOCK_H_
+
+#include <stdint.h>
+
+// offsets of more than CLOCK_STEP_THRESHOLD us are corrected at once, smaller ones are
+// slewed with at most CLOCK_SLEW_RATE us per second
+#define CLOCK_STEP_THRESHOLD 128000
+#define CLOCK_SLEW_RATE 500
+
+// part of the measured frequency error taken over per sample (1/CLOCK_FLL_GAIN) and
+// minimum time in s between two samples for a frequency estimate
+#define CLOCK_FLL_GAIN 4
+#define CLOCK_FLL_MIN_INTERVAL 16
+
+// broken-down local time
+typedef struct _clock_time_t
+{
+	int h, m, s, ms;
+
+	// false until the time has been set by NTP, the time counts from 00:00:00 at
+	// boot until then
+	bool synchronized;
+} clock_time_t;
+
+class ClockClass
+{
+public:
+	ClockClass();
+	uint64_t monotonic();
+	uint64_t now();
+	void discipline(int64_t offset, int32_t localOffset);
+	void adjust(int32_t seconds);
+	void getLocalTime(clock_time_t &time);
+	bool isSynchronized();
+	int32_t getDrift();
+	void setDrift(int32_t drift);
+
+	// number of steps and average deviation in us of the samples from the clock model
+	uint32_t steps = 0;
+	int32_t jitter = 0;
+
+private:
+	// conversion from the monotonic counter to UTC and local time
+	typedef struct _clock_base_t
+	{
+		// monotonic time of the last correction and UTC in microseconds since 1970
+		// minus the monotonic counter at that time
+		uint64_t reference;
+		int64_t offset;
+
+		// correction of the oscillator frequency in ppb and the part of the last
+		// measured offset in us which is still to be slewed, both from reference on
+		int32_t frequency;
+		int32_t slew;
+
+		// seconds the local time is ahead of UTC (time zone and DST)
+		int32_t localOffset;
+
+		bool synchronized;
+	} clock_base_t;
+
+	// the writer fills the slot not selected by sequence and increments sequence
+	// afterwards, so readers always find a complete copy in the selected slot
+	clock_base_t base[2];
+	volatile uint32_t sequence = 0;
+
+	// monotonic time of the last sample, written by discipline() only
+	uint64_t lastSample = 0;
+
+	static uint64_t toUTC(const clock_base_t &base, uint64_t monotonic);
+	static int32_t slewed(const clock_base_t &base, uint64_t monotonic);
+	void read(clock_base_t &target);
+	void write(const clock_base_t &source);
+};
+
+extern ClockClass Clock;
+
+#endif
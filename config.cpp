@@ -3,11 +3,19 @@
 //
 //  This is the configuration module. It contains methods to load/save the
 //  configuration from/to the internal EEPROM (simulated EEPROM in flash).
-//  Data is loaded into this->eeprom_data[EEPROM_SIZE] which shares RAM with
-//  this->config. Configuration variables are copied to public class members
-//  ntpserver, heartbeat, ... where they can be used by other modules. Upon
-//  save, the public members are copied back to this->config/this->eeprom_data[]
-//  and then written to the EEPROM.
+//  Configuration variables are kept in public class members ntpServers,
+//  heartbeat, ... where they can be used by other modules.
+//
+//  The configuration is stored as schema version byte followed by tag-length-value
+//  records (1 byte tag, 1 byte length, value). Loading starts from the defaults and
+//  copies each known record straight from the EEPROM buffer to its member, so fields
+//  can be added without breaking older data, and unknown records of newer firmware
+//  are skipped. The raw structure written by previous versions is migrated once.
+//
+//  The EEPROM contains two slots, each with a header holding a sequence number and a
+//  CRC of the payload. Loading picks the valid slot with the newest sequence number,
+//  saving writes the other slot. A save which would not change the stored bytes does
+//  not commit at all, since every commit erases and rewrites the flash sector.
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -30,6 +38,66 @@
 //---------------------------------------------------------------------------------------
 ConfigClass Config = ConfigClass();
 
+static_assert(2 * CONFIG_SLOT_SIZE <= EEPROM_SIZE, "config slots do not fit EEPROM");
+
+//---------------------------------------------------------------------------------------
+// serialized configuration
+//---------------------------------------------------------------------------------------
+// record tags, values must never change, new tags are appended before count
+enum class ConfigTag : uint8_t
+{
+	end, bg, fg, s, ntpserver, heartbeat, mode, timeZone, fireGradient, plasmaGradient,
+	calibration, ledProfile, powerBudget, channelCurrent, lightCurve, stream, clockDrift,
+	ntpServers, count
+};
+
+// output state of serialize()
+typedef struct _tlv_writer
+{
+	uint8_t *pos, *end;
+	bool overflow;
+} tlv_writer;
+
+// raw structure stored at address 0 by previous versions
+#define CONFIG_MAGIC_LEGACY 0xDEADBEEF
+typedef struct _config_struct_legacy
+{
+	uint32_t magic;
+	palette_entry bg;
+	palette_entry fg;
+	palette_entry s;
+	uint8_t ntpserver[4];
+	bool heartbeat;
+	uint32_t mode;
+	uint32_t timeZone;
+} config_struct_legacy;
+
+//---------------------------------------------------------------------------------------
+// default gradient palettes
+//---------------------------------------------------------------------------------------
+static const gradient_t defaultFireGradient = {4, {
+	{  0, {  0,   0,   0}},
+	{ 63, {255,   0,   0}},
+	{127, {255, 255,   0}},
+	{255, {255, 255, 255}}}};
+
+const light_curve_t ConfigClass::defaultLightCurve = {6, {
+	{   0, 160},
+	{ 300,  96},
+	{ 680,  64},
+	{ 800,  32},
+	{ 900,  15},
+	{1023,  15}}};
+
+static const gradient_t defaultPlasmaGradient = {7, {
+	{  0, {255,   0,   0}},
+	{ 43, {255, 255,   0}},
+	{ 85, {  0, 255,   0}},
+	{128, {  0, 255, 255}},
+	{171, {  0,   0, 255}},
+	{213, {255,   0, 255}},
+	{255, {255,   0,   0}}}};
+
 //---------------------------------------------------------------------------------------
 // ConfigClass
 //
@@ -72,21 +140,332 @@ void ConfigClass::begin()
 //---------------------------------------------------------------------------------------
 // saveDelayed
 //
-// Copies the current class member values to EEPROM buffer and writes it to the EEPROM
-// after 10 seconds.
+// Schedules a save from the main loop after CONFIG_SAVE_DELAY. Every call restarts the
+// delay, so a series of changes results in a single EEPROM commit.
 //
 // -> --
 // <- --
 //---------------------------------------------------------------------------------------
 void ConfigClass::saveDelayed()
 {
-	this->delayedWriteTimer = 1000; // 10 seconds using 10 ms timer
+	this->delayedWriteTimer = CONFIG_SAVE_DELAY;
+}
+
+//---------------------------------------------------------------------------------------
+// crc16
+//
+// Calculates the CRC-16/CCITT of a block of data
+//
+// -> data: start of the data
+//    length: number of bytes
+// <- CRC
+//---------------------------------------------------------------------------------------
+uint16_t ConfigClass::crc16(const uint8_t *data, uint32_t length)
+{
+	uint16_t crc = 0xFFFF;
+	while (length--)
+	{
+		crc ^= (uint16_t)(*data++) << 8;
+		for (int i = 0; i < 8; i++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+//---------------------------------------------------------------------------------------
+// slotData
+//
+// -> slot: slot number [0...1]
+// <- payload of the slot inside the RAM copy of the EEPROM
+//---------------------------------------------------------------------------------------
+const uint8_t *ConfigClass::slotData(int slot)
+{
+	return EEPROM.getConstDataPtr() + slot * CONFIG_SLOT_SIZE + sizeof(config_slot_header);
+}
+
+//---------------------------------------------------------------------------------------
+// readSlot
+//
+// Reads the header of an EEPROM slot and checks the payload in place
+//
+// -> slot: slot number [0...1]
+//    header: receives the slot header
+// <- true if the slot contains a valid configuration
+//---------------------------------------------------------------------------------------
+bool ConfigClass::readSlot(int slot, config_slot_header &header)
+{
+	memcpy(&header, EEPROM.getConstDataPtr() + slot * CONFIG_SLOT_SIZE, sizeof(header));
+	if (header.magic != CONFIG_SLOT_MAGIC || header.length > CONFIG_PAYLOAD_SIZE)
+		return false;
+	return crc16(this->slotData(slot), header.length) == header.crc;
+}
+
+//---------------------------------------------------------------------------------------
+// putField
+//
+// Appends a tag-length-value record to the serialized configuration
+//
+// -> w: output position, end of buffer and overflow flag
+//    tag: field tag
+//    value: field value
+//    length: number of bytes of the value [0...255]
+// <- --
+//---------------------------------------------------------------------------------------
+static void putField(tlv_writer &w, ConfigTag tag, const void *value, uint32_t length)
+{
+	if (length > 255 || w.pos + 2 + length > w.end)
+	{
+		w.overflow = true;
+		return;
+	}
+	*w.pos++ = (uint8_t) tag;
+	*w.pos++ = (uint8_t) length;
+	memcpy(w.pos, value, length);
+	w.pos += length;
+}
+
+//---------------------------------------------------------------------------------------
+// serialize
+//
+// Writes the schema version followed by one record per member variable into
+// this->eeprom_data[]. Gradients and the light curve are stored with their used points
+// only, the LED profile indexes with 2 bits each. Records with tags unknown to this
+// firmware are copied from the active slot, so settings of a newer firmware survive a
+// temporary downgrade.
+//
+// -> --
+// <- number of bytes written
+//---------------------------------------------------------------------------------------
+uint32_t ConfigClass::serialize()
+{
+	tlv_writer w = {this->eeprom_data, this->eeprom_data + sizeof(this->eeprom_data), false};
+	*w.pos++ = CONFIG_SCHEMA_VERSION;
+
+	putField(w, ConfigTag::bg, &this->bg, 3);
+	putField(w, ConfigTag::fg, &this->fg, 3);
+	putField(w, ConfigTag::s, &this->s, 3);
+	uint8_t heartbeat = this->heartbeat;
+	putField(w, ConfigTag::heartbeat, &heartbeat, 1);
+	uint8_t mode = (uint8_t) this->defaultMode;
+	putField(w, ConfigTag::mode, &mode, 1);
+	int32_t timeZone = this->timeZone;
+	putField(w, ConfigTag::timeZone, &timeZone, 4);
+
+	putField(w, ConfigTag::fireGradient, &this->fireGradient,
+			1 + this->fireGradient.count * sizeof(gradient_stop));
+	putField(w, ConfigTag::plasmaGradient, &this->plasmaGradient,
+			1 + this->plasmaGradient.count * sizeof(gradient_stop));
+
+	putField(w, ConfigTag::calibration, this->calibration, sizeof(this->calibration));
+	uint8_t profiles[(NUM_PIXELS + 3) / 4];
+	memset(profiles, 0, sizeof(profiles));
+	for (int i = 0; i < NUM_PIXELS; i++)
+		profiles[i >> 2] |= (this->ledProfile[i] & 3) << ((i & 3) << 1);
+	putField(w, ConfigTag::ledProfile, profiles, sizeof(profiles));
+
+	uint16_t powerBudget = this->powerBudget;
+	putField(w, ConfigTag::powerBudget, &powerBudget, 2);
+	putField(w, ConfigTag::channelCurrent, this->channelCurrent, 3);
+
+	uint8_t curve[1 + sizeof(this->lightCurve.points)];
+	curve[0] = this->lightCurve.count;
+	memcpy(curve + 1, this->lightCurve.points, this->lightCurve.count * sizeof(light_point));
+	putField(w, ConfigTag::lightCurve, curve, 1 + curve[0] * sizeof(light_point));
+
+	uint16_t stream[2] = {(uint16_t) this->streamTimeout, (uint16_t) this->streamUniverse};
+	putField(w, ConfigTag::stream, stream, sizeof(stream));
+	putField(w, ConfigTag::clockDrift, &this->clockDrift, sizeof(this->clockDrift));
+	putField(w, ConfigTag::ntpServers, this->ntpServers, strlen(this->ntpServers));
+
+	// keep records of newer firmware versions
+	if (this->activeSlot >= 0 && this->activeVersion >= CONFIG_SCHEMA_VERSION)
+	{
+		const uint8_t *data = this->slotData(this->activeSlot);
+		const uint8_t *end = data + this->activeLength;
+		for (data++; data + 2 <= end && data[0] != (uint8_t) ConfigTag::end &&
+				data + 2 + data[1] <= end; data += 2 + data[1])
+		{
+			if (data[0] >= (uint8_t) ConfigTag::count)
+				putField(w, (ConfigTag) data[0], data + 2, data[1]);
+		}
+	}
+
+	if (w.overflow) Serial.println("EEPROM config truncated");
+	return w.pos - this->eeprom_data;
+}
+
+//---------------------------------------------------------------------------------------
+// parse
+//
+// Copies the values of all known and valid records directly from the EEPROM buffer to
+// the member variables. Unknown tags are skipped, fields without a valid record keep
+// their current (default) value.
+//
+// -> data: serialized configuration starting with the schema version
+//    length: number of bytes
+// <- --
+//---------------------------------------------------------------------------------------
+void ConfigClass::parse(const uint8_t *data, uint32_t length)
+{
+	const uint8_t *end = data + length;
+	for (data++; data + 2 <= end && data[0] != (uint8_t) ConfigTag::end; data += 2 + data[1])
+	{
+		ConfigTag tag = (ConfigTag) data[0];
+		uint32_t len = data[1];
+		const uint8_t *value = data + 2;
+		if (value + len > end) break;
+
+		switch (tag)
+		{
+		case ConfigTag::bg:
+			if (len == 3) memcpy(&this->bg, value, 3);
+			break;
+		case ConfigTag::fg:
+			if (len == 3) memcpy(&this->fg, value, 3);
+			break;
+		case ConfigTag::s:
+			if (len == 3) memcpy(&this->s, value, 3);
+			break;
+		case ConfigTag::ntpserver:
+			// single server IP address written by previous versions, 0.0.0.0 if unset
+			if (len == 4 && value[0] != 0)
+			{
+				snprintf(this->ntpServers, sizeof(this->ntpServers), "%u.%u.%u.%u",
+						value[0], value[1], value[2], value[3]);
+			}
+			break;
+		case ConfigTag::heartbeat:
+			if (len == 1) this->heartbeat = value[0] != 0;
+			break;
+		case ConfigTag::mode:
+			// the stream mode only makes sense while pixel data is received
+			if (len == 1 && value[0] < (uint8_t) DisplayMode::stream)
+				this->defaultMode = (DisplayMode) value[0];
+			break;
+		case ConfigTag::timeZone:
+			if (len == 4)
+			{
+				int32_t timeZone;
+				memcpy(&timeZone, value, 4);
+				this->timeZone = timeZone;
+			}
+			break;
+		case ConfigTag::fireGradient:
+		case ConfigTag::plasmaGradient:
+			if (len >= 1 && value[0] <= MAX_GRADIENT_STOPS &&
+					len == 1 + value[0] * sizeof(gradient_stop))
+			{
+				gradient_t gradient;
+				memcpy(&gradient, value, len);
+				if (!isValidGradient(gradient)) break;
+				if (tag == ConfigTag::fireGradient) this->fireGradient = gradient;
+				else this->plasmaGradient = gradient;
+			}
+			break;
+		case ConfigTag::calibration:
+			// fewer profiles than supported keep the defaults for the remaining ones
+			for (uint32_t i = 0; i < len / sizeof(calibration_profile) &&
+					i < NUM_CALIBRATION_PROFILES; i++)
+			{
+				const calibration_profile *p = (const calibration_profile*) value + i;
+				if (p->curve < NUM_BRIGHTNESS_CURVES) this->calibration[i] = *p;
+			}
+			break;
+		case ConfigTag::ledProfile:
+			for (uint32_t i = 0; i < len * 4 && i < NUM_PIXELS; i++)
+				this->ledProfile[i] = (value[i >> 2] >> ((i & 3) << 1)) & 3;
+			break;
+		case ConfigTag::powerBudget:
+			if (len == 2)
+			{
+				uint16_t powerBudget;
+				memcpy(&powerBudget, value, 2);
+				if (isValidPower(powerBudget, this->channelCurrent))
+					this->powerBudget = powerBudget;
+			}
+			break;
+		case ConfigTag::channelCurrent:
+			if (len == 3 && isValidPower(this->powerBudget, value))
+				memcpy(this->channelCurrent, value, 3);
+			break;
+		case ConfigTag::lightCurve:
+			if (len >= 1 && value[0] <= MAX_LIGHT_POINTS &&
+					len == 1 + value[0] * sizeof(light_point))
+			{
+				light_curve_t curve;
+				curve.count = value[0];
+				memcpy(curve.points, value + 1, len - 1);
+				if (isValidLightCurve(curve)) this->lightCurve = curve;
+			}
+			break;
+		case ConfigTag::stream:
+			if (len == 4)
+			{
+				uint16_t stream[2];
+				memcpy(stream, value, 4);
+				if (isValidStream(stream[0], stream[1]))
+				{
+					this->streamTimeout = stream[0];
+					this->streamUniverse = stream[1];
+				}
+			}
+			break;
+		case ConfigTag::clockDrift:
+			if (len == 4)
+			{
+				int32_t drift;
+				memcpy(&drift, value, 4);
+				if (isValidDrift(drift)) this->clockDrift = drift;
+			}
+			break;
+		case ConfigTag::ntpServers:
+			if (len < sizeof(this->ntpServers))
+			{
+				char list[NTP_SERVER_LIST_SIZE];
+				memcpy(list, value, len);
+				list[len] = 0;
+				if (isValidNtpServers(list)) strcpy(this->ntpServers, list);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// migrateLegacy
+//
+// Copies the values of the configuration structure written by previous versions to
+// the member variables
+//
+// -> data: start of the structure inside the EEPROM buffer
+// <- --
+//---------------------------------------------------------------------------------------
+void ConfigClass::migrateLegacy(const uint8_t *data)
+{
+	const config_struct_legacy *legacy = (const config_struct_legacy*) data;
+
+	this->bg = legacy->bg;
+	this->fg = legacy->fg;
+	this->s = legacy->s;
+	this->defaultMode = legacy->mode < (uint32_t) DisplayMode::stream ?
+			(DisplayMode) legacy->mode : DisplayMode::explode;
+	this->heartbeat = legacy->heartbeat;
+	this->timeZone = legacy->timeZone;
+	if (legacy->ntpserver[0] != 0)
+	{
+		snprintf(this->ntpServers, sizeof(this->ntpServers), "%u.%u.%u.%u",
+				legacy->ntpserver[0], legacy->ntpserver[1], legacy->ntpserver[2],
+				legacy->ntpserver[3]);
+	}
 }
 
 //---------------------------------------------------------------------------------------
 // save
 //
-// Copies the current class member values to EEPROM buffer and writes it to the EEPROM.
+// Serializes the current class member values and writes them to the inactive EEPROM
+// slot. Nothing is written if the active slot already holds the same bytes.
 //
 // -> --
 // <- --
@@ -95,66 +474,86 @@ void ConfigClass::save()
 {
 	this->delayedWriteFlag = false;
 
-	this->config->bg = this->bg;
-	this->config->fg = this->fg;
-	this->config->s = this->s;
-	this->config->timeZone = this->timeZone;
-	this->config->heartbeat = this->heartbeat;
-	this->config->mode = (uint32_t) this->defaultMode;
-	for (int i = 0; i < 4; i++)
-		this->config->ntpserver[i] = this->ntpserver[i];
-
-	for (int i = 0; i < EEPROM_SIZE; i++)
-		EEPROM.write(i, this->eeprom_data[i]);
+	uint32_t length = this->serialize();
+	if (this->activeSlot >= 0 && this->activeLength == length &&
+			memcmp(this->slotData(this->activeSlot), this->eeprom_data, length) == 0)
+	{
+		this->skippedCommits++;
+		return;
+	}
+
+	uint32_t start = micros();
+	int slot = this->activeSlot == 0 ? 1 : 0;
+	config_slot_header header;
+	header.magic = CONFIG_SLOT_MAGIC;
+	header.sequence = this->sequence + 1;
+	header.length = length;
+	header.crc = crc16(this->eeprom_data, length);
+
+	int base = slot * CONFIG_SLOT_SIZE;
+	const uint8_t *h = (const uint8_t*) &header;
+	for (uint32_t i = 0; i < sizeof(header); i++) EEPROM.write(base + i, h[i]);
+	base += sizeof(header);
+	for (uint32_t i = 0; i < length; i++) EEPROM.write(base + i, this->eeprom_data[i]);
 	EEPROM.commit();
+
+	this->activeSlot = slot;
+	this->activeLength = length;
+	this->activeVersion = CONFIG_SCHEMA_VERSION;
+	this->sequence = header.sequence;
+	this->commitCount++;
+	this->lastCommitTime = micros() - start;
+	if (this->lastCommitTime > this->maxCommitTime) this->maxCommitTime = this->lastCommitTime;
 }
 
 //---------------------------------------------------------------------------------------
 // reset
 //
-// Sets default values in EEPROM buffer and member variables.
+// Sets default values in member variables.
 //
 // -> --
 // <- --
 //---------------------------------------------------------------------------------------
 void ConfigClass::reset()
 {
-	this->config->magic = 0xDEADBEEF;
-	this->config->bg =
-	{	0, 0, 0};
-	this->bg = this->config->bg;
+	this->bg = {0, 0, 0};
+	this->fg = {255, 255, 255};
+	this->s = {32, 0, 21};
+	this->heartbeat = true;
+	this->defaultMode = DisplayMode::explode;
+	this->timeZone = 0;
+
+	this->fireGradient = defaultFireGradient;
+	this->plasmaGradient = defaultPlasmaGradient;
+	this->paletteVersion++;
+
+	// neutral calibration, all LEDs use the first profile
+	for (int i = 0; i < NUM_CALIBRATION_PROFILES; i++)
+	{
+		this->calibration[i] = {0, {128, 128, 128}, {0, 0, 0}};
+	}
+	memset(this->ledProfile, 0, sizeof(this->ledProfile));
 
-	this->config->fg =
-	{	255, 255, 255};
-	this->fg = this->config->fg;
+	// no power limit, WS2812B draw about 20 mA per channel
+	this->powerBudget = 0;
+	memset(this->channelCurrent, 20, sizeof(this->channelCurrent));
 
-	this->config->s =
-	{	32, 0, 21};
-	this->s = this->config->s;
+	this->lightCurve = defaultLightCurve;
 
-	this->config->heartbeat = true;
-	this->heartbeat = this->config->heartbeat;
+	this->streamTimeout = 2500;
+	this->streamUniverse = 1;
 
-	this->defaultMode = DisplayMode::explode;
-	this->config->mode = (uint32_t) this->defaultMode;
-	this->timeZone = 0;
+	this->clockDrift = 0;
 
-	this->config->ntpserver[0] = 129;
-	this->config->ntpserver[1] = 6;
-	this->config->ntpserver[2] = 15;
-	this->config->ntpserver[3] = 28;
-	this->ntpserver[0] = this->config->ntpserver[0];
-	this->ntpserver[1] = this->config->ntpserver[1];
-	this->ntpserver[2] = this->config->ntpserver[2];
-	this->ntpserver[3] = this->config->ntpserver[3];
+	strcpy(this->ntpServers, DEFAULT_NTP_SERVERS);
 }
 
 //---------------------------------------------------------------------------------------
 // load
 //
-// Reads the content of the EEPROM into the EEPROM buffer and copies the values to the
-// public member variables. Resets (and saves) the values to their defaults if the
-// EEPROM data is not initialized.
+// Sets all member variables to their defaults and overwrites them with the values of
+// the newest valid EEPROM slot. Configurations of older firmware versions are migrated
+// and saved in the current format.
 //
 // -> --
 // <- --
@@ -162,20 +561,174 @@ void ConfigClass::reset()
 void ConfigClass::load()
 {
 	Serial.println("Reading EEPROM config");
-	for (int i = 0; i < EEPROM_SIZE; i++)
-		this->eeprom_data[i] = EEPROM.read(i);
-	if (this->config->magic != 0xDEADBEEF)
+	config_slot_header header[2];
+	bool valid[2];
+	for (int i = 0; i < 2; i++) valid[i] = this->readSlot(i, header[i]);
+
+	// use the newer slot if both are valid (sequence numbers may wrap around)
+	this->activeSlot = -1;
+	if (valid[0] && valid[1])
+		this->activeSlot = (int32_t)(header[1].sequence - header[0].sequence) > 0 ? 1 : 0;
+	else if (valid[0]) this->activeSlot = 0;
+	else if (valid[1]) this->activeSlot = 1;
+
+	this->reset();
+	bool convert = false;
+	if (this->activeSlot >= 0)
+	{
+		const uint8_t *data = this->slotData(this->activeSlot);
+		this->sequence = header[this->activeSlot].sequence;
+		this->activeLength = header[this->activeSlot].length;
+		this->activeVersion = this->activeLength ? data[0] : 0;
+		this->parse(data, this->activeLength);
+	}
+	else if (*(const uint32_t*) EEPROM.getConstDataPtr() == CONFIG_MAGIC_LEGACY)
+	{
+		// configurations written before the slots existed start at address 0
+		Serial.println("Converting EEPROM config to slot format");
+		this->migrateLegacy(EEPROM.getConstDataPtr());
+		convert = true;
+	}
+	else
 	{
 		Serial.println("EEPROM config invalid, writing default values");
-		this->reset();
-		this->save();
-	}
-	this->bg = this->config->bg;
-	this->fg = this->config->fg;
-	this->s = this->config->s;
-	this->defaultMode = (DisplayMode) this->config->mode;
-	this->heartbeat = this->config->heartbeat;
-	this->timeZone = this->config->timeZone;
-	for (int i = 0; i < 4; i++)
-		this->ntpserver[i] = this->config->ntpserver[i];
+		convert = true;
+	}
+
+	if (convert) this->save();
+}
+
+//---------------------------------------------------------------------------------------
+// isValidLightCurve
+//
+// Checks the number of points, their order and their ranges
+//
+// -> curve: ambient light curve to check
+// <- true if the curve can be compiled
+//---------------------------------------------------------------------------------------
+bool ConfigClass::isValidLightCurve(const light_curve_t &curve)
+{
+	if (curve.count < 2 || curve.count > MAX_LIGHT_POINTS) return false;
+	for (int i = 0; i < curve.count; i++)
+	{
+		if (curve.points[i].adc > 1023 || curve.points[i].brightness > 256) return false;
+		if (i > 0 && curve.points[i].adc <= curve.points[i - 1].adc) return false;
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+// isValidStream
+//
+// Checks the settings of the UDP pixel input
+//
+// -> timeout: silence in ms until the clock is shown again [100...60000]
+//    universe: Art-Net port address / E1.31 universe [0...32767]
+// <- true if both values are in range
+//---------------------------------------------------------------------------------------
+bool ConfigClass::isValidStream(int timeout, int universe)
+{
+	return timeout >= 100 && timeout <= 60000 && universe >= 0 && universe <= 32767;
+}
+
+//---------------------------------------------------------------------------------------
+// isValidDrift
+//
+// -> drift: frequency correction of the clock in ppb
+// <- true if it is within [-MAX_CLOCK_DRIFT...MAX_CLOCK_DRIFT]
+//---------------------------------------------------------------------------------------
+bool ConfigClass::isValidDrift(int32_t drift)
+{
+	return drift >= -MAX_CLOCK_DRIFT && drift <= MAX_CLOCK_DRIFT;
+}
+
+//---------------------------------------------------------------------------------------
+// isValidPower
+//
+// Checks the settings of the power limiter
+//
+// -> budget: supply current budget in mA [0...MAX_POWER_BUDGET], 0 = unlimited
+//    current: current of a single LED channel at full intensity in mA (r, g, b)
+//             [1...MAX_CHANNEL_CURRENT]
+// <- true if all values are in range
+//---------------------------------------------------------------------------------------
+bool ConfigClass::isValidPower(int budget, const uint8_t *current)
+{
+	if (budget < 0 || budget > MAX_POWER_BUDGET) return false;
+	for (int c = 0; c < 3; c++)
+	{
+		if (current[c] < 1 || current[c] > MAX_CHANNEL_CURRENT) return false;
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+// isValidNtpServers
+//
+// Checks a list of NTP servers
+//
+// -> list: 1...MAX_NTP_SERVERS host names or IP addresses separated by commas
+// <- true if the list fits into ntpServers and contains only valid host names
+//---------------------------------------------------------------------------------------
+bool ConfigClass::isValidNtpServers(const char *list)
+{
+	static const char hostChars[] =
+			"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789.-";
+	if (strlen(list) >= NTP_SERVER_LIST_SIZE) return false;
+
+	int count = 0;
+	do
+	{
+		size_t length = strcspn(list, ",");
+		if (length == 0 || length >= MAX_NTP_HOSTNAME || strspn(list, hostChars) != length ||
+				++count > MAX_NTP_SERVERS) return false;
+		list += length;
+	}
+	while (*list++ == ',');
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+// isValidCalibration
+//
+// Checks curve and profile indexes of the calibration. Configurations written before
+// calibration existed contain only zeros, which would switch off all LEDs.
+//
+// -> --
+// <- true if the calibration can be used
+//---------------------------------------------------------------------------------------
+bool ConfigClass::isValidCalibration()
+{
+	bool anyGain = false;
+	for (int i = 0; i < NUM_CALIBRATION_PROFILES; i++)
+	{
+		if (this->calibration[i].curve >= NUM_BRIGHTNESS_CURVES) return false;
+		for (int c = 0; c < 3; c++)
+		{
+			if (this->calibration[i].gain[c]) anyGain = true;
+		}
+	}
+	for (int i = 0; i < NUM_PIXELS; i++)
+	{
+		if (this->ledProfile[i] >= NUM_CALIBRATION_PROFILES) return false;
+	}
+	return anyGain;
+}
+
+//---------------------------------------------------------------------------------------
+// isValidGradient
+//
+// Checks the number of stops and their order
+//
+// -> gradient: gradient palette to check
+// <- true if the gradient can be expanded
+//---------------------------------------------------------------------------------------
+bool ConfigClass::isValidGradient(const gradient_t &gradient)
+{
+	if (gradient.count < 2 || gradient.count > MAX_GRADIENT_STOPS) return false;
+	for (int i = 1; i < gradient.count; i++)
+	{
+		if (gradient.stops[i].pos <= gradient.stops[i - 1].pos) return false;
+	}
+	return true;
 }
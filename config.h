@@ -21,6 +21,10 @@
 #include <IPAddress.h>
 
 #define NUM_PIXELS 114
+
+// NUM_PIXELS rounded up to a multiple of 4, size of the indexed scratch buffers
+#define NUM_PIXELS_ALIGNED ((NUM_PIXELS + 3) & ~0x03)
+
 #define HOURGLASS_ANIMATION_FRAMES 8
 
 // structure to encapsulate a color value with red, green and blue values
@@ -29,27 +33,102 @@ typedef struct _palette_entry
 	uint8_t r, g, b;
 } palette_entry;
 
-// structure with configuration data to be stored in EEPROM
-typedef struct _config_struct
+// number of brightness curves (LED types) in LEDFunctionsClass
+#define NUM_BRIGHTNESS_CURVES 2
+
+// number of calibration profiles, must be a power of 2
+#define NUM_CALIBRATION_PROFILES 4
+
+// per LED color calibration, applied after the brightness curve of the LED type:
+// value = value * gain / 128 + offset
+typedef struct _calibration_profile
+{
+	uint8_t curve;
+	uint8_t gain[3];
+	int8_t offset[3];
+} calibration_profile;
+
+// NTP servers are configured as list of up to MAX_NTP_SERVERS host names or IP
+// addresses separated by commas, each shorter than MAX_NTP_HOSTNAME
+#define MAX_NTP_SERVERS 4
+#define MAX_NTP_HOSTNAME 64
+#define NTP_SERVER_LIST_SIZE 128
+#define DEFAULT_NTP_SERVERS "pool.ntp.org,time.nist.gov,129.6.15.28"
+
+// maximum frequency correction of the clock in ppb
+#define MAX_CLOCK_DRIFT 500000
+
+// maximum supply current budget and LED channel current in mA, larger values are
+// treated as not configured (erased EEPROM reads 0xFF)
+#define MAX_POWER_BUDGET 20000
+#define MAX_CHANNEL_CURRENT 100
+
+// maximum number of points of the ambient light curve
+#define MAX_LIGHT_POINTS 8
+
+// point of the ambient light curve, maps a filtered ADC value [0...1023] to a
+// brightness [0...256]
+typedef struct _light_point
+{
+	uint16_t adc;
+	uint16_t brightness;
+} light_point;
+
+// ambient light curve with count points in ascending ADC order, compiled into a lookup
+// table by BrightnessClass::loadCurve()
+typedef struct _light_curve_t
+{
+	uint8_t count;
+	light_point points[MAX_LIGHT_POINTS];
+} light_curve_t;
+
+// maximum number of color stops in a gradient palette
+#define MAX_GRADIENT_STOPS 8
+
+// color stop of a gradient palette, pos is the palette index (0...255) of the color
+typedef struct _gradient_stop
+{
+	uint8_t pos;
+	palette_entry color;
+} gradient_stop;
+
+// gradient palette with count stops in ascending order, expanded into a 256 entry
+// lookup table by LEDFunctionsClass::buildLUT()
+typedef struct _gradient_t
+{
+	uint8_t count;
+	gradient_stop stops[MAX_GRADIENT_STOPS];
+} gradient_t;
+
+// The EEPROM holds two slots of CONFIG_SLOT_SIZE bytes. Each save goes to the slot
+// which does not contain the currently valid configuration, so a broken write leaves
+// the previous configuration intact.
+#define EEPROM_SIZE 1024
+#define CONFIG_SLOT_SIZE 512
+#define CONFIG_SLOT_MAGIC 0x57434C4B
+
+// delay between the last change and the EEPROM commit in 10 ms timer ticks
+#define CONFIG_SAVE_DELAY 300
+
+typedef struct _config_slot_header
 {
 	uint32_t magic;
-	palette_entry bg;
-	palette_entry fg;
-	palette_entry s;
-	uint8_t ntpserver[4];
-	bool heartbeat;
-	uint32_t mode;
-	uint32_t timeZone;
-} config_struct;
+	uint32_t sequence;
+	uint16_t length;
+	uint16_t crc;
+} config_slot_header;
+
+#define CONFIG_PAYLOAD_SIZE (CONFIG_SLOT_SIZE - sizeof(config_slot_header))
 
-#define EEPROM_SIZE 512
+// version of the tag-length-value format in the first payload byte of a slot
+#define CONFIG_SCHEMA_VERSION 1
 
 enum class DisplayMode
 {
 	plain, fade, flyingLettersVerticalUp, flyingLettersVerticalDown, explode,
 	random, matrix, heart, fire, plasma, stars, red, green, blue,
 	yellowHourglass, greenHourglass, update, updateComplete, updateError,
-	wifiManager, invalid
+	wifiManager, stream, invalid
 };
 
 class ConfigClass
@@ -63,12 +142,20 @@ public:
 	void saveDelayed();
 	void load();
 	void reset();
+	static bool isValidGradient(const gradient_t &gradient);
+	bool isValidCalibration();
+	static bool isValidLightCurve(const light_curve_t &curve);
+	static bool isValidStream(int timeout, int universe);
+	static bool isValidDrift(int32_t drift);
+	static bool isValidPower(int budget, const uint8_t *current);
+	static bool isValidNtpServers(const char *list);
+	static const light_curve_t defaultLightCurve;
 
 	// public configuration variables
 	palette_entry fg;
 	palette_entry bg;
 	palette_entry s;
-	IPAddress ntpserver = IPAddress(0, 0, 0, 0);
+	char ntpServers[NTP_SERVER_LIST_SIZE];
 	bool heartbeat = true;
 	bool debugMode = false;
 
@@ -78,13 +165,55 @@ public:
 	int hourglassState = 0;
 	int timeZone = 0;
 
+	// gradient palettes, paletteVersion is incremented on every change of a palette or
+	// of the calibration
+	gradient_t fireGradient;
+	gradient_t plasmaGradient;
+	uint32_t paletteVersion = 0;
+
+	// calibration profiles and the profile index of each LED (in chain order)
+	calibration_profile calibration[NUM_CALIBRATION_PROFILES];
+	uint8_t ledProfile[NUM_PIXELS];
+
+	// supply current budget in mA (0 = unlimited) and current of a single LED channel
+	// at full intensity in mA (r, g, b)
+	int powerBudget = 0;
+	uint8_t channelCurrent[3];
+
+	// ambient light to brightness curve
+	light_curve_t lightCurve;
+
+	// UDP pixel input: silence in ms after which the clock is shown again and the
+	// Art-Net port address / E1.31 universe the clock listens to
+	int streamTimeout = 2500;
+	int streamUniverse = 1;
+
+	// frequency correction of the clock oscillator in ppb, estimated from NTP
+	int32_t clockDrift = 0;
+
 	int delayedWriteTimer = 0;
 	bool delayedWriteFlag = false;
 
+	// EEPROM statistics, times in microseconds
+	uint32_t commitCount = 0;
+	uint32_t skippedCommits = 0;
+	uint32_t lastCommitTime = 0;
+	uint32_t maxCommitTime = 0;
+	int activeSlot = -1;
+	uint32_t sequence = 0;
+
 private:
-	// copy of EEPROM content
-	config_struct *config = (config_struct*) eeprom_data;
-	uint8_t eeprom_data[EEPROM_SIZE];
+	// serialized configuration, written to the inactive slot on save
+	uint8_t eeprom_data[CONFIG_PAYLOAD_SIZE];
+	uint32_t activeLength = 0;
+	uint8_t activeVersion = 0;
+
+	static uint16_t crc16(const uint8_t *data, uint32_t length);
+	const uint8_t *slotData(int slot);
+	bool readSlot(int slot, config_slot_header &header);
+	uint32_t serialize();
+	void parse(const uint8_t *data, uint32_t length);
+	void migrateLegacy(const uint8_t *data);
 };
 
 extern ConfigClass Config;
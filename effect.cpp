@@ -0,0 +1,333 @@
+// ESP8266 Wordclock
+// Copyright (C) 2016 Thoralt Franz, https://github.com/thoralt
+//
+//  This module contains the base class for all display effects, the arena which
+//  holds the working state of the currently active effect, the scratch region for
+//  render buffers and the registry mapping display modes to effects. Only the active
+//  effect owns memory, so the heap usage follows the current display mode instead of
+//  the sum of all modes.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <Arduino.h>
+#include "effect.h"
+
+//---------------------------------------------------------------------------------------
+// global instance
+//---------------------------------------------------------------------------------------
+ScratchClass Scratch = ScratchClass();
+
+//---------------------------------------------------------------------------------------
+#if 1 // ScratchClass
+//---------------------------------------------------------------------------------------
+
+//---------------------------------------------------------------------------------------
+// clearMode
+//
+// Zeroes the mode region, called whenever a new effect is entered
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void ScratchClass::clearMode()
+{
+	memset(this->modeRegion, 0, sizeof(this->modeRegion));
+}
+
+#endif
+
+//---------------------------------------------------------------------------------------
+#if 1 // EffectArena
+//---------------------------------------------------------------------------------------
+
+//---------------------------------------------------------------------------------------
+// EffectArena
+//
+// Constructor, the arena is empty until reserve() is called
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+EffectArena::EffectArena()
+{
+}
+
+//---------------------------------------------------------------------------------------
+// ~EffectArena
+//
+// Destructor, frees the memory block
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+EffectArena::~EffectArena()
+{
+	this->release();
+}
+
+//---------------------------------------------------------------------------------------
+// reserve
+//
+// Allocates a new memory block of the given size, frees the previous one.
+//
+// -> size: number of bytes to reserve, may be 0
+// <- true if the block could be allocated
+//---------------------------------------------------------------------------------------
+bool EffectArena::reserve(size_t size)
+{
+	this->release();
+	if(size == 0) return true;
+
+	this->block = (uint8_t*) malloc(size);
+	if(!this->block) return false;
+
+	memset(this->block, 0, size);
+	this->capacity = size;
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+// alloc
+//
+// Hands out the next part of the memory block. Sizes are rounded up to
+// EFFECT_ARENA_ALIGNMENT, so stateSize() of an effect must use EFFECT_ARENA_ALIGN()
+// for each allocation it makes.
+//
+// -> size: number of bytes requested
+// <- pointer to zero initialized memory, NULL if the block is exhausted
+//---------------------------------------------------------------------------------------
+void *EffectArena::alloc(size_t size)
+{
+	size = EFFECT_ARENA_ALIGN(size);
+	if(this->used + size > this->capacity) return NULL;
+
+	void *result = this->block + this->used;
+	this->used += size;
+	return result;
+}
+
+//---------------------------------------------------------------------------------------
+// release
+//
+// Frees the memory block, all pointers handed out by alloc() become invalid.
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void EffectArena::release()
+{
+	if(this->block) free(this->block);
+	this->block = NULL;
+	this->used = 0;
+	this->capacity = 0;
+}
+
+#endif
+
+//---------------------------------------------------------------------------------------
+#if 1 // Effect
+//---------------------------------------------------------------------------------------
+
+//---------------------------------------------------------------------------------------
+// Effect
+//
+// Constructor
+//
+// -> name: name of the effect, used for status output
+// <- --
+//---------------------------------------------------------------------------------------
+Effect::Effect(const char *name)
+{
+	this->name = name;
+}
+
+//---------------------------------------------------------------------------------------
+// ~Effect
+//
+// Destructor
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+Effect::~Effect()
+{
+}
+
+//---------------------------------------------------------------------------------------
+// stateSize
+//
+// Returns the number of arena bytes this effect needs while it is active. Default
+// implementation for effects without state.
+//
+// -> --
+// <- size in bytes
+//---------------------------------------------------------------------------------------
+size_t Effect::stateSize()
+{
+	return 0;
+}
+
+//---------------------------------------------------------------------------------------
+// enter
+//
+// Called when the effect becomes active. Default implementation does nothing.
+//
+// -> led: LED module to render to
+//    arena: memory for the effect state, holds at least stateSize() bytes
+// <- --
+//---------------------------------------------------------------------------------------
+void Effect::enter(LEDFunctionsClass &led, EffectArena &arena)
+{
+}
+
+//---------------------------------------------------------------------------------------
+// tick
+//
+// Advances the effect state by one frame. Default implementation does nothing.
+//
+// -> led: LED module to render to
+// <- --
+//---------------------------------------------------------------------------------------
+void Effect::tick(LEDFunctionsClass &led)
+{
+}
+
+//---------------------------------------------------------------------------------------
+// leave
+//
+// Called before the effect is deactivated, the arena is released afterwards.
+// Default implementation does nothing.
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void Effect::leave()
+{
+}
+
+#endif
+
+//---------------------------------------------------------------------------------------
+#if 1 // EffectRegistry
+//---------------------------------------------------------------------------------------
+
+//---------------------------------------------------------------------------------------
+// EffectRegistry
+//
+// Constructor, initializes an empty registry
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+EffectRegistry::EffectRegistry()
+{
+	for(int i = 0; i < NUM_DISPLAY_MODES; i++) this->effects[i] = NULL;
+}
+
+//---------------------------------------------------------------------------------------
+// add
+//
+// Registers an effect for a display mode
+//
+// -> mode: display mode
+//    effect: effect to show for this display mode
+// <- --
+//---------------------------------------------------------------------------------------
+void EffectRegistry::add(DisplayMode mode, Effect *effect)
+{
+	if((int)mode < 0 || (int)mode >= NUM_DISPLAY_MODES) return;
+	this->effects[(int)mode] = effect;
+}
+
+//---------------------------------------------------------------------------------------
+// get
+//
+// Looks up the effect for a display mode
+//
+// -> mode: display mode
+// <- effect or NULL if none is registered
+//---------------------------------------------------------------------------------------
+Effect *EffectRegistry::get(DisplayMode mode)
+{
+	if((int)mode < 0 || (int)mode >= NUM_DISPLAY_MODES) return NULL;
+	return this->effects[(int)mode];
+}
+
+//---------------------------------------------------------------------------------------
+// activate
+//
+// Leaves the active effect, releases its state and enters the effect registered for
+// the given mode. Falls back to DisplayMode::plain if the mode has no effect or if its
+// state cannot be allocated.
+//
+// -> mode: new display mode
+//    led: LED module to render to
+// <- new active effect
+//---------------------------------------------------------------------------------------
+Effect *EffectRegistry::activate(DisplayMode mode, LEDFunctionsClass &led)
+{
+	Effect *next = this->get(mode);
+	if(!next) next = this->get(DisplayMode::plain);
+
+	if(this->active)
+	{
+		this->active->leave();
+		this->arena.release();
+		this->active = NULL;
+	}
+
+	if(!next) return NULL;
+
+	// the new effect starts with an empty mode scratch region
+	Scratch.clearMode();
+
+	if(!this->arena.reserve(next->stateSize()))
+	{
+		Serial.printf("EffectRegistry: no memory for effect '%s' (%u bytes)\r\n",
+				next->name, next->stateSize());
+		next = this->get(DisplayMode::plain);
+		if(!next) return NULL;
+	}
+
+	this->active = next;
+	next->enter(led, this->arena);
+	return next;
+}
+
+//---------------------------------------------------------------------------------------
+// current
+//
+// Returns the active effect
+//
+// -> --
+// <- active effect, NULL if no effect has been activated yet
+//---------------------------------------------------------------------------------------
+Effect *EffectRegistry::current()
+{
+	return this->active;
+}
+
+//---------------------------------------------------------------------------------------
+// memoryInUse
+//
+// Returns the number of arena bytes allocated by the active effect
+//
+// -> --
+// <- size in bytes
+//---------------------------------------------------------------------------------------
+size_t EffectRegistry::memoryInUse()
+{
+	return this->arena.capacity;
+}
+
+#endif
@@ -0,0 +1,141 @@
+// ESP8266 Wordclock
+// Copyright (C) 2016 Thoralt Franz, https://github.com/thoralt
+//
+//  See effect.cpp for description.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _EFFECT_H_
+#define _EFFECT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+
+class LEDFunctionsClass;
+
+// indexed image with one palette index per pixel
+typedef struct _index_buffer_t
+{
+	uint8_t data[NUM_PIXELS_ALIGNED];
+} index_buffer_t;
+
+// RGB values for all pixels, same layout as LEDFunctionsClass::currentValues
+typedef struct _rgb_buffer_t
+{
+	uint8_t data[NUM_PIXELS * 3];
+} rgb_buffer_t;
+
+// number of entries in the effect registry, one per DisplayMode
+#define NUM_DISPLAY_MODES ((int)DisplayMode::invalid)
+
+// alignment of every block handed out by the effect arena
+#define EFFECT_ARENA_ALIGNMENT 8
+#define EFFECT_ARENA_ALIGN(x) \
+	(((x) + EFFECT_ARENA_ALIGNMENT - 1) & ~(EFFECT_ARENA_ALIGNMENT - 1))
+
+// size of the scratch regions, see ScratchClass
+#define SCRATCH_MODE_SIZE EFFECT_ARENA_ALIGN(sizeof(rgb_buffer_t))
+#define SCRATCH_FRAME_SIZE EFFECT_ARENA_ALIGN(sizeof(index_buffer_t))
+
+// Statically allocated scratch memory for render buffers. Only one effect renders at a
+// time, so effects borrow these buffers instead of owning them:
+//  - the mode region keeps its content while a mode is active and is cleared by the
+//    registry when the effect changes (fade target, fire heat, plasma frame)
+//  - the frame region is only valid until the end of the current enter(), tick() or
+//    render() call
+// Not reentrant, all users have to run from LEDFunctionsClass::process().
+class ScratchClass
+{
+public:
+	template<typename T> T *mode()
+	{
+		static_assert(sizeof(T) <= SCRATCH_MODE_SIZE, "type does not fit into mode scratch");
+		static_assert(alignof(T) <= EFFECT_ARENA_ALIGNMENT, "type alignment too large");
+		return (T*) this->modeRegion;
+	}
+
+	template<typename T> T *frame()
+	{
+		static_assert(sizeof(T) <= SCRATCH_FRAME_SIZE, "type does not fit into frame scratch");
+		static_assert(alignof(T) <= EFFECT_ARENA_ALIGNMENT, "type alignment too large");
+		return (T*) this->frameRegion;
+	}
+
+	void clearMode();
+
+private:
+	uint8_t modeRegion[SCRATCH_MODE_SIZE] __attribute__((aligned(EFFECT_ARENA_ALIGNMENT)));
+	uint8_t frameRegion[SCRATCH_FRAME_SIZE] __attribute__((aligned(EFFECT_ARENA_ALIGNMENT)));
+};
+
+extern ScratchClass Scratch;
+
+// Memory block holding the working state of the active effect. The block is allocated
+// when an effect is entered and freed when it is left, so the heap only ever holds the
+// state of a single effect.
+class EffectArena
+{
+public:
+	EffectArena();
+	~EffectArena();
+	bool reserve(size_t size);
+	void *alloc(size_t size);
+	void release();
+
+	size_t used = 0;
+	size_t capacity = 0;
+
+private:
+	uint8_t *block = NULL;
+};
+
+// Base class for all display effects. The life cycle of an effect is
+//   enter() -> { tick() -> render() }* -> leave()
+// Effects must not keep any state outside of the arena block they receive in
+// enter(), the size of which has to be announced by stateSize(), or the scratch
+// regions described above.
+class Effect
+{
+public:
+	Effect(const char *name);
+	virtual ~Effect();
+
+	virtual size_t stateSize();
+	virtual void enter(LEDFunctionsClass &led, EffectArena &arena);
+	virtual void tick(LEDFunctionsClass &led);
+	virtual void render(LEDFunctionsClass &led) = 0;
+	virtual void leave();
+
+	const char *name;
+};
+
+// Maps each DisplayMode to its effect and switches between them, handing out the
+// shared arena to the effect which is currently active.
+class EffectRegistry
+{
+public:
+	EffectRegistry();
+	void add(DisplayMode mode, Effect *effect);
+	Effect *get(DisplayMode mode);
+	Effect *activate(DisplayMode mode, LEDFunctionsClass &led);
+	Effect *current();
+	size_t memoryInUse();
+
+private:
+	Effect *effects[NUM_DISPLAY_MODES];
+	Effect *active = NULL;
+	EffectArena arena;
+};
+
+#endif
@@ -0,0 +1,1330 @@
+// ESP8266 Wordclock
+// Copyright (C) 2016 Thoralt Franz, https://github.com/thoralt
+//
+//  This module contains the display effects (time display, screensavers, status
+//  screens). Each effect is registered for one DisplayMode and keeps its working
+//  state in the effect arena only while it is active.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <Arduino.h>
+#include <new>
+#include "effects.h"
+#include "ledfunctions.h"
+#include "flashtable.h"
+
+//---------------------------------------------------------------------------------------
+#if 1 // images and palettes
+//---------------------------------------------------------------------------------------
+#include "hourglass_animation.h"
+
+// images and palettes live in flash, LEDFunctionsClass::setBuffer() reads them through
+// the accessors from flashtable.h
+
+static const uint8_t PROGMEM imageSolid[NUM_PIXELS] = {
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1
+};
+
+static const uint8_t PROGMEM imageHeart[NUM_PIXELS] = {
+	0, 1, 1, 1, 0, 0, 0, 1, 1, 1, 0,
+	1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0,
+	0, 0, 1, 1, 1, 1, 1, 1, 1, 0, 0,
+	0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0,
+	0, 0, 0, 0, 1, 1, 1, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1
+};
+
+static const uint8_t PROGMEM imageUpdate[NUM_PIXELS] = {
+	0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0,
+	0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0,
+	0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0,
+	0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0,
+	0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0,
+	0, 1, 1, 1, 0, 0, 0, 1, 1, 1, 0,
+	0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0,
+	0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0,
+	0, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0,
+	1, 1, 1, 1
+};
+
+static const uint8_t PROGMEM imageUpdateOK[NUM_PIXELS] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0,
+	0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 0,
+	0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1
+};
+
+static const uint8_t PROGMEM imageUpdateError[NUM_PIXELS] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0,
+	0, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0,
+	0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1
+};
+
+static const uint8_t PROGMEM imageWifiManager[NUM_PIXELS] = {
+	0, 0, 0, 1, 1, 1, 1, 0, 0, 0, 0,
+	0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 0,
+	0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0,
+	0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0,
+	0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0,
+	1, 1, 1, 1
+};
+
+static const palette_entry PROGMEM paletteRed[] = {{0, 0, 0}, {32, 0, 0}};
+static const palette_entry PROGMEM paletteGreen[] = {{0, 0, 0}, {0, 32, 0}};
+static const palette_entry PROGMEM paletteBlue[] = {{0, 0, 0}, {0, 0, 32}};
+static const palette_entry PROGMEM paletteUpdateOK[] = {{0, 21, 0}, {0, 255, 0}};
+static const palette_entry PROGMEM paletteUpdateError[] = {{0, 0, 0}, {255, 0, 0}};
+static const palette_entry PROGMEM paletteWifiManager[] = {{0, 0, 0}, {255, 255, 0}};
+
+#endif
+
+//---------------------------------------------------------------------------------------
+#if 1 // registration
+//---------------------------------------------------------------------------------------
+
+//---------------------------------------------------------------------------------------
+// effectTablesInFlash
+//
+// Returns the size of the images and palettes which are kept in flash instead of RAM,
+// i. e. the amount of RAM saved compared to plain const tables
+//
+// -> --
+// <- size in bytes
+//---------------------------------------------------------------------------------------
+size_t effectTablesInFlash()
+{
+	return sizeof(imageSolid) + sizeof(imageHeart) + sizeof(imageUpdate) +
+			sizeof(imageUpdateOK) + sizeof(imageUpdateError) + sizeof(imageWifiManager) +
+			sizeof(paletteRed) + sizeof(paletteGreen) + sizeof(paletteBlue) +
+			sizeof(paletteUpdateOK) + sizeof(paletteUpdateError) +
+			sizeof(paletteWifiManager);
+}
+
+//---------------------------------------------------------------------------------------
+// registerEffects
+//
+// Creates all effects and registers them for their display mode. The effect objects
+// only hold a few pointers, their working state is allocated when they are entered.
+//
+// -> registry: registry to receive the effects
+// <- --
+//---------------------------------------------------------------------------------------
+void registerEffects(EffectRegistry &registry)
+{
+	static TimeEffect plain("plain", false);
+	static TimeEffect fade("fade", true);
+	static TimeEffect randomTime("random", false); // TODO: Implement random display mode
+	static FlyingLettersEffect flyingUp("flyingLettersVerticalUp", true);
+	static FlyingLettersEffect flyingDown("flyingLettersVerticalDown", false);
+	static ExplosionEffect explode("explode");
+	static MatrixEffect matrix("matrix");
+	static HeartEffect heart("heart");
+	static FireEffect fire("fire", &Config.fireGradient);
+	static PlasmaEffect plasma("plasma", &Config.plasmaGradient);
+	static StarsEffect stars("stars");
+	static ImageEffect red("red", imageSolid, paletteRed);
+	static ImageEffect green("green", imageSolid, paletteGreen);
+	static ImageEffect blue("blue", imageSolid, paletteBlue);
+	static HourglassEffect yellowHourglass("yellowHourglass", false);
+	static HourglassEffect greenHourglass("greenHourglass", true);
+	static UpdateEffect update("update");
+	static ImageEffect updateComplete("updateComplete", imageUpdateOK, paletteUpdateOK);
+	static ImageEffect updateError("updateError", imageUpdateError, paletteUpdateError);
+	static ImageEffect wifiManager("wifiManager", imageWifiManager, paletteWifiManager);
+	static StreamEffect stream("stream");
+
+	registry.add(DisplayMode::plain, &plain);
+	registry.add(DisplayMode::fade, &fade);
+	registry.add(DisplayMode::random, &randomTime);
+	registry.add(DisplayMode::flyingLettersVerticalUp, &flyingUp);
+	registry.add(DisplayMode::flyingLettersVerticalDown, &flyingDown);
+	registry.add(DisplayMode::explode, &explode);
+	registry.add(DisplayMode::matrix, &matrix);
+	registry.add(DisplayMode::heart, &heart);
+	registry.add(DisplayMode::fire, &fire);
+	registry.add(DisplayMode::plasma, &plasma);
+	registry.add(DisplayMode::stars, &stars);
+	registry.add(DisplayMode::red, &red);
+	registry.add(DisplayMode::green, &green);
+	registry.add(DisplayMode::blue, &blue);
+	registry.add(DisplayMode::yellowHourglass, &yellowHourglass);
+	registry.add(DisplayMode::greenHourglass, &greenHourglass);
+	registry.add(DisplayMode::update, &update);
+	registry.add(DisplayMode::updateComplete, &updateComplete);
+	registry.add(DisplayMode::updateError, &updateError);
+	registry.add(DisplayMode::wifiManager, &wifiManager);
+	registry.add(DisplayMode::stream, &stream);
+}
+
+#endif
+
+//---------------------------------------------------------------------------------------
+#if 1 // stateless effects
+//---------------------------------------------------------------------------------------
+
+//---------------------------------------------------------------------------------------
+// TimeEffect
+//
+// Constructor
+//
+// -> name: name of the effect
+//    fade: if true, fade to the new time, display it immediately otherwise
+// <- --
+//---------------------------------------------------------------------------------------
+TimeEffect::TimeEffect(const char *name, bool fade) : Effect(name)
+{
+	this->fade = fade;
+}
+
+//---------------------------------------------------------------------------------------
+// render
+//
+// Renders the current time using the time colors of the LED module
+//
+// -> led: LED module to render to
+// <- --
+//---------------------------------------------------------------------------------------
+void TimeEffect::render(LEDFunctionsClass &led)
+{
+	uint8_t *buf = Scratch.frame<index_buffer_t>()->data;
+
+	// colors being previewed are shown without fading
+	led.renderTime(buf, led.h, led.m, led.s, led.ms);
+	if(this->fade && !led.isPreviewing())
+	{
+		led.setTimeColors(buf, false);
+		led.fade();
+	}
+	else
+	{
+		led.setTimeColors(buf, true);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// ImageEffect
+//
+// Constructor
+//
+// -> name: name of the effect
+//    image: indexed image with NUM_PIXELS bytes, may reside in PROGMEM
+//    palette: colors for the image, may reside in PROGMEM
+// <- --
+//---------------------------------------------------------------------------------------
+ImageEffect::ImageEffect(const char *name, const uint8_t *image,
+		const palette_entry *palette) : Effect(name)
+{
+	this->image = image;
+	this->palette = palette;
+}
+
+//---------------------------------------------------------------------------------------
+// render
+//
+// Displays the image immediately
+//
+// -> led: LED module to render to
+// <- --
+//---------------------------------------------------------------------------------------
+void ImageEffect::render(LEDFunctionsClass &led)
+{
+	led.set(this->image, this->palette, true);
+}
+
+//---------------------------------------------------------------------------------------
+// HourglassEffect
+//
+// Constructor
+//
+// -> name: name of the effect
+//    green: Flag to switch the palette color 3 to green instead of yellow (used in the
+//           second half of the hourglass animation to indicate the short wait-for-OTA
+//           window)
+// <- --
+//---------------------------------------------------------------------------------------
+HourglassEffect::HourglassEffect(const char *name, bool green) : Effect(name)
+{
+	this->green = green;
+}
+
+//---------------------------------------------------------------------------------------
+// render
+//
+// Immediately displays the current step of the hourglass animation selected by
+// Config.hourglassState.
+//
+// -> led: LED module to render to
+// <- --
+//---------------------------------------------------------------------------------------
+void HourglassEffect::render(LEDFunctionsClass &led)
+{
+	// colors in palette: black, white, yellow
+	palette_entry p[] = {{0, 0, 0}, {255, 255, 255}, {255, 255, 0}, {255, 255, 0}};
+
+	// delete red component in palette entry 3 to make this color green
+	if(this->green) p[3].r = 0;
+
+	int animationStep = Config.hourglassState;
+	if (animationStep >= HOURGLASS_ANIMATION_FRAMES) animationStep = 0;
+	led.set(hourglass_animation[animationStep], p, true);
+}
+
+//---------------------------------------------------------------------------------------
+// UpdateEffect
+//
+// Constructor
+//
+// -> name: name of the effect
+// <- --
+//---------------------------------------------------------------------------------------
+UpdateEffect::UpdateEffect(const char *name) : Effect(name)
+{
+}
+
+//---------------------------------------------------------------------------------------
+// render
+//
+// Renders the OTA update screen with progress information depending on
+// Config.updateProgress
+//
+// -> led: LED module to render to
+// <- --
+//---------------------------------------------------------------------------------------
+void UpdateEffect::render(LEDFunctionsClass &led)
+{
+	uint8_t *update = Scratch.frame<index_buffer_t>()->data;
+	memcpy_P(update, imageUpdate, sizeof(imageUpdate));
+
+	palette_entry p[] = {{0, 0, 0}, {255, 0, 0}, {42, 21, 0}, {255, 85, 0}};
+	for(int i=0; i<110; i++)
+	{
+		if(i<Config.updateProgress)
+		{
+			if(update[i] == 0) update[i] = 2;
+			else update[i] = 3;
+		}
+	}
+	led.set(update, p, true);
+}
+
+//---------------------------------------------------------------------------------------
+// StreamEffect
+//
+// Constructor
+//
+// -> name: name of the effect
+// <- --
+//---------------------------------------------------------------------------------------
+StreamEffect::StreamEffect(const char *name) : Effect(name)
+{
+}
+
+//---------------------------------------------------------------------------------------
+// render
+//
+// Does nothing, the received pixels are decoded directly into the LED buffer
+//
+// -> led: LED module to render to
+// <- --
+//---------------------------------------------------------------------------------------
+void StreamEffect::render(LEDFunctionsClass &led)
+{
+}
+
+#endif
+
+//---------------------------------------------------------------------------------------
+#if 1 // screensavers
+//---------------------------------------------------------------------------------------
+
+//---------------------------------------------------------------------------------------
+// MatrixEffect
+//
+// Constructor
+//
+// -> name: name of the effect
+// <- --
+//---------------------------------------------------------------------------------------
+MatrixEffect::MatrixEffect(const char *name) : Effect(name)
+{
+}
+
+//---------------------------------------------------------------------------------------
+// stateSize
+//
+// -> --
+// <- arena bytes for the matrix objects
+//---------------------------------------------------------------------------------------
+size_t MatrixEffect::stateSize()
+{
+	return EFFECT_ARENA_ALIGN(NUM_MATRIX_OBJECTS * sizeof(MatrixObject));
+}
+
+//---------------------------------------------------------------------------------------
+// enter
+//
+// Creates the matrix objects with random coordinates
+//
+// -> led: LED module to render to
+//    arena: memory for the matrix objects
+// <- --
+//---------------------------------------------------------------------------------------
+void MatrixEffect::enter(LEDFunctionsClass &led, EffectArena &arena)
+{
+	this->objects = (MatrixObject*) arena.alloc(NUM_MATRIX_OBJECTS * sizeof(MatrixObject));
+	for (int i = 0; i < NUM_MATRIX_OBJECTS; i++) new (&this->objects[i]) MatrixObject();
+}
+
+//---------------------------------------------------------------------------------------
+// render
+//
+// Renders one frame of the matrix animation and displays it immediately
+//
+// -> led: LED module to render to
+// <- --
+//---------------------------------------------------------------------------------------
+void MatrixEffect::render(LEDFunctionsClass &led)
+{
+	// clear buffer
+	memset(led.currentValues, 0, sizeof(led.currentValues));
+
+	// sort by y coordinate for correct overlapping
+	std::sort(this->objects, this->objects + NUM_MATRIX_OBJECTS);
+
+	// iterate over all matrix objects, move and render them
+	for (int i = 0; i < NUM_MATRIX_OBJECTS; i++) this->objects[i].render(led.currentValues);
+}
+
+//---------------------------------------------------------------------------------------
+// leave
+//
+// Destroys the matrix objects
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void MatrixEffect::leave()
+{
+	for (int i = 0; i < NUM_MATRIX_OBJECTS; i++) this->objects[i].~MatrixObject();
+	this->objects = NULL;
+}
+
+//---------------------------------------------------------------------------------------
+// StarsEffect
+//
+// Constructor
+//
+// -> name: name of the effect
+// <- --
+//---------------------------------------------------------------------------------------
+StarsEffect::StarsEffect(const char *name) : Effect(name)
+{
+}
+
+//---------------------------------------------------------------------------------------
+// stateSize
+//
+// -> --
+// <- arena bytes for the star objects
+//---------------------------------------------------------------------------------------
+size_t StarsEffect::stateSize()
+{
+	return EFFECT_ARENA_ALIGN(NUM_STARS * sizeof(StarObject));
+}
+
+//---------------------------------------------------------------------------------------
+// enter
+//
+// Creates the star objects and places them at random coordinates with minimum
+// distance to each other
+//
+// -> led: LED module to render to
+//    arena: memory for the star objects
+// <- --
+//---------------------------------------------------------------------------------------
+void StarsEffect::enter(LEDFunctionsClass &led, EffectArena &arena)
+{
+	this->stars = (StarObject*) arena.alloc(NUM_STARS * sizeof(StarObject));
+
+	// initialize star objects with default coordinates
+	for (int i = 0; i < NUM_STARS; i++) new (&this->stars[i]) StarObject();
+
+	// set random coordinates with minimum distance to other star objects
+	for (int i = 0; i < NUM_STARS; i++) this->stars[i].randomize(this->stars, NUM_STARS);
+}
+
+//---------------------------------------------------------------------------------------
+// render
+//
+// Renders one frame of the stars animation and displays it immediately
+//
+// -> led: LED module to render to
+// <- --
+//---------------------------------------------------------------------------------------
+void StarsEffect::render(LEDFunctionsClass &led)
+{
+	// clear buffer
+	memset(led.currentValues, 0, sizeof(led.currentValues));
+
+	for (int i = 0; i < NUM_STARS; i++)
+		this->stars[i].render(led.currentValues, this->stars, NUM_STARS);
+}
+
+//---------------------------------------------------------------------------------------
+// leave
+//
+// Destroys the star objects
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void StarsEffect::leave()
+{
+	for (int i = 0; i < NUM_STARS; i++) this->stars[i].~StarObject();
+	this->stars = NULL;
+}
+
+//---------------------------------------------------------------------------------------
+// HeartEffect
+//
+// Constructor
+//
+// -> name: name of the effect
+// <- --
+//---------------------------------------------------------------------------------------
+HeartEffect::HeartEffect(const char *name) : Effect(name)
+{
+}
+
+//---------------------------------------------------------------------------------------
+// stateSize
+//
+// -> --
+// <- arena bytes for the heart beat state
+//---------------------------------------------------------------------------------------
+size_t HeartEffect::stateSize()
+{
+	return EFFECT_ARENA_ALIGN(sizeof(state_t));
+}
+
+//---------------------------------------------------------------------------------------
+// enter
+//
+// Starts the heart beat with zero brightness
+//
+// -> led: LED module to render to
+//    arena: memory for the heart beat state
+// <- --
+//---------------------------------------------------------------------------------------
+void HeartEffect::enter(LEDFunctionsClass &led, EffectArena &arena)
+{
+	this->state = (state_t*) arena.alloc(sizeof(state_t));
+}
+
+//---------------------------------------------------------------------------------------
+// tick
+//
+// Advances the heart beat state machine
+//
+// -> led: LED module to render to
+// <- --
+//---------------------------------------------------------------------------------------
+void HeartEffect::tick(LEDFunctionsClass &led)
+{
+	switch (this->state->state)
+	{
+	case 0:
+		if (this->state->brightness >= 255) this->state->state = 1;
+		else this->state->brightness += 32;
+		break;
+
+	case 1:
+		if (this->state->brightness < 128) this->state->state = 2;
+		else this->state->brightness -= 32;
+		break;
+
+	case 2:
+		if (this->state->brightness >= 255) this->state->state = 3;
+		else this->state->brightness += 32;
+		break;
+
+	case 3:
+	default:
+		if (this->state->brightness <= 0) this->state->state = 0;
+		else this->state->brightness -= 4;
+		break;
+	}
+
+	if (this->state->brightness > 255) this->state->brightness = 255;
+	if (this->state->brightness < 0) this->state->brightness = 0;
+}
+
+//---------------------------------------------------------------------------------------
+// render
+//
+// Renders one frame of the heart animation and displays it immediately
+//
+// -> led: LED module to render to
+// <- --
+//---------------------------------------------------------------------------------------
+void HeartEffect::render(LEDFunctionsClass &led)
+{
+	palette_entry palette[2];
+	palette[0] = {0, 0, 0};
+	palette[1] = {(uint8_t)this->state->brightness, 0, 0};
+	led.set(imageHeart, palette, true);
+}
+
+//---------------------------------------------------------------------------------------
+// leave
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void HeartEffect::leave()
+{
+	this->state = NULL;
+}
+
+//---------------------------------------------------------------------------------------
+// GradientEffect
+//
+// Constructor
+//
+// -> name: name of the effect
+//    gradient: gradient palette, usually from the configuration
+// <- --
+//---------------------------------------------------------------------------------------
+GradientEffect::GradientEffect(const char *name, const gradient_t *gradient) :
+		Effect(name)
+{
+	this->gradient = gradient;
+}
+
+//---------------------------------------------------------------------------------------
+// stateSize
+//
+// -> --
+// <- arena bytes for the lookup table
+//---------------------------------------------------------------------------------------
+size_t GradientEffect::stateSize()
+{
+	return EFFECT_ARENA_ALIGN(sizeof(lut_state_t));
+}
+
+//---------------------------------------------------------------------------------------
+// enter
+//
+// Expands the gradient palette into the lookup table
+//
+// -> led: LED module to render to
+//    arena: memory for the lookup table
+// <- --
+//---------------------------------------------------------------------------------------
+void GradientEffect::enter(LEDFunctionsClass &led, EffectArena &arena)
+{
+	this->lutState = (lut_state_t*) arena.alloc(sizeof(lut_state_t));
+	this->lutState->version = Config.paletteVersion;
+	led.buildLUT(this->gradient, &this->lutState->lut);
+}
+
+//---------------------------------------------------------------------------------------
+// tick
+//
+// Rebuilds the lookup table if the gradient palette has been changed
+//
+// -> led: LED module to render to
+// <- --
+//---------------------------------------------------------------------------------------
+void GradientEffect::tick(LEDFunctionsClass &led)
+{
+	if (this->lutState->version == Config.paletteVersion) return;
+	this->lutState->version = Config.paletteVersion;
+	led.buildLUT(this->gradient, &this->lutState->lut);
+}
+
+//---------------------------------------------------------------------------------------
+// render
+//
+// Displays the index buffer from the mode scratch region using the lookup table
+//
+// -> led: LED module to render to
+// <- --
+//---------------------------------------------------------------------------------------
+void GradientEffect::render(LEDFunctionsClass &led)
+{
+	led.setLUT(Scratch.mode<index_buffer_t>()->data, &this->lutState->lut);
+}
+
+//---------------------------------------------------------------------------------------
+// leave
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void GradientEffect::leave()
+{
+	this->lutState = NULL;
+}
+
+//---------------------------------------------------------------------------------------
+// FireEffect
+//
+// Constructor
+//
+// -> name: name of the effect
+//    gradient: fire palette
+// <- --
+//---------------------------------------------------------------------------------------
+FireEffect::FireEffect(const char *name, const gradient_t *gradient) :
+		GradientEffect(name, gradient)
+{
+}
+
+//---------------------------------------------------------------------------------------
+// tick
+//
+// Seeds the bottom row with random hot spots and lets the heat rise
+//
+// -> led: LED module to render to
+// <- --
+//---------------------------------------------------------------------------------------
+void FireEffect::tick(LEDFunctionsClass &led)
+{
+    GradientEffect::tick(led);
+
+    uint8_t *buf = Scratch.mode<index_buffer_t>()->data;
+    int f;
+
+    // iterate over bottom row, create fire seed
+    for (int i = 0; i < LEDFunctionsClass::width; i++)
+    {
+        // only set hot spot with probability of 1/4
+        f = (random(4) == 0) ? random(256) : 0;
+
+        // update one pixel in bottom row
+        buf[i + (LEDFunctionsClass::height - 1) * LEDFunctionsClass::width] = f;
+    }
+
+    int y1, y2, l, r;
+    for (int y = 0; y < LEDFunctionsClass::height - 1; y++)
+    {
+        y1 = y + 1; if (y1 >= LEDFunctionsClass::height) y1 = LEDFunctionsClass::height - 1;
+        y2 = y + 2; if (y2 >= LEDFunctionsClass::height) y2 = LEDFunctionsClass::height - 1;
+        for (int x = 0; x < LEDFunctionsClass::width; x++)
+        {
+            l = x - 1; if (l < 0) l = 0;
+            r = x + 1; if (r >= LEDFunctionsClass::width) r = LEDFunctionsClass::width - 1;
+            buf[x + y * LEDFunctionsClass::width] =
+                ((buf[y1 * LEDFunctionsClass::width + l]
+                + buf[y1 * LEDFunctionsClass::width + x]
+                + buf[y1 * LEDFunctionsClass::width + r]
+                + buf[y2 * LEDFunctionsClass::width + x])
+                * 32) / 129;
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------
+// render
+//
+// Displays the heat buffer using the fire palette
+//
+// -> led: LED module to render to
+// <- --
+//---------------------------------------------------------------------------------------
+void FireEffect::render(LEDFunctionsClass &led)
+{
+	GradientEffect::render(led);
+	delay(100);
+}
+
+//---------------------------------------------------------------------------------------
+// PlasmaEffect
+//
+// Constructor
+//
+// -> name: name of the effect
+//    gradient: plasma palette
+// <- --
+//---------------------------------------------------------------------------------------
+PlasmaEffect::PlasmaEffect(const char *name, const gradient_t *gradient) :
+		GradientEffect(name, gradient)
+{
+}
+
+//---------------------------------------------------------------------------------------
+// stateSize
+//
+// -> --
+// <- arena bytes for the lookup table and the animation time
+//---------------------------------------------------------------------------------------
+size_t PlasmaEffect::stateSize()
+{
+	return GradientEffect::stateSize() + EFFECT_ARENA_ALIGN(sizeof(state_t));
+}
+
+//---------------------------------------------------------------------------------------
+// enter
+//
+// -> led: LED module to render to
+//    arena: memory for the animation state
+// <- --
+//---------------------------------------------------------------------------------------
+void PlasmaEffect::enter(LEDFunctionsClass &led, EffectArena &arena)
+{
+	GradientEffect::enter(led, arena);
+	this->state = (state_t*) arena.alloc(sizeof(state_t));
+}
+
+//---------------------------------------------------------------------------------------
+// tick
+//
+// Advances the animation time and calculates the next plasma frame
+//
+// -> led: LED module to render to
+// <- --
+//---------------------------------------------------------------------------------------
+void PlasmaEffect::tick(LEDFunctionsClass &led)
+{
+    GradientEffect::tick(led);
+
+    uint8_t *buf = Scratch.mode<index_buffer_t>()->data;
+    int color;
+    double cx, cy, xx, yy;
+    double &_time = this->state->time;
+
+    _time += 0.05;
+
+    for (int y=0; y<LEDFunctionsClass::height; y++)
+    {
+        yy = (double)y / (double)LEDFunctionsClass::height / 3.0;
+        for (int x=0; x<LEDFunctionsClass::width; x++)
+        {
+            xx = (double)x / (double)LEDFunctionsClass::width / 3.0;
+            cx = xx + 0.5 * sin(_time / 5.0);
+            cy = (double)y/(double)LEDFunctionsClass::height / 3.0 + 0.5 * sin(_time / 3.0);
+            color = (
+            	sin(
+                    sqrt(100 * (cx*cx + cy*cy) + 1 + _time) +
+                    6.0 * (xx * sin(_time/2) + yy * cos(_time/3) + _time / 4.0)
+                ) + 1.0
+			) * 128.0;
+            buf[x + y * LEDFunctionsClass::width] = color;
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------
+// leave
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void PlasmaEffect::leave()
+{
+	GradientEffect::leave();
+	this->state = NULL;
+}
+
+#endif
+
+//---------------------------------------------------------------------------------------
+#if 1 // animated time display
+//---------------------------------------------------------------------------------------
+
+//---------------------------------------------------------------------------------------
+// ExplosionEffect
+//
+// Constructor
+//
+// -> name: name of the effect
+// <- --
+//---------------------------------------------------------------------------------------
+ExplosionEffect::ExplosionEffect(const char *name) : Effect(name)
+{
+}
+
+//---------------------------------------------------------------------------------------
+// stateSize
+//
+// -> --
+// <- arena bytes for the animation state and the maximum number of particles
+//---------------------------------------------------------------------------------------
+size_t ExplosionEffect::stateSize()
+{
+	return EFFECT_ARENA_ALIGN(sizeof(state_t)) +
+			EFFECT_ARENA_ALIGN(MAX_PARTICLES * sizeof(Particle));
+}
+
+//---------------------------------------------------------------------------------------
+// enter
+//
+// Starts the animation immediately by exploding the currently displayed time, even if
+// the time did not yet change
+//
+// -> led: LED module to render to
+//    arena: memory for the animation state and particles
+// <- --
+//---------------------------------------------------------------------------------------
+void ExplosionEffect::enter(LEDFunctionsClass &led, EffectArena &arena)
+{
+	uint8_t *buf = Scratch.frame<index_buffer_t>()->data;
+
+	this->state = (state_t*) arena.alloc(sizeof(state_t));
+	this->particles = (Particle*) arena.alloc(MAX_PARTICLES * sizeof(Particle));
+	this->state->lastH = led.h;
+	this->state->lastM = led.m;
+
+	led.renderTime(buf, led.h, led.m, led.s, led.ms);
+	this->prepare(buf);
+}
+
+//---------------------------------------------------------------------------------------
+// prepare
+//
+// Prepare particles based on current screen state
+//
+// -> source: buffer to read the currently active LEDs from
+// <- --
+//---------------------------------------------------------------------------------------
+void ExplosionEffect::prepare(uint8_t *source)
+{
+	float vx, vy, angle;
+	int ofs = 0;
+	int delay;
+
+	// compute angle increment
+	float angle_increment = 2.0f * 3.141592654f / (float)(PARTICLE_COUNT);
+
+	// iterate over every position in the screen buffer
+	for(int y=0; y<LEDFunctionsClass::height; y++)
+	{
+		for(int x=0; x<LEDFunctionsClass::width; x++)
+		{
+			// create particles if current pixel is foreground and there is still
+			// room left in the arena
+			if(source[ofs++] == 1 &&
+					this->state->particleCount + PARTICLE_COUNT <= MAX_PARTICLES)
+			{
+				// add a random delay of zero to approx. 3 seconds to each
+				// explosion
+				delay = random(300);
+
+				// start with angle of zero radians, assign velocity vector
+				// placed on a circle to each particle
+				angle = 0;
+				for(int i=0; i<PARTICLE_COUNT; i++)
+				{
+					// calculate particle speed vector based on angle and
+					// absolute speed value
+					vx = PARTICLE_SPEED * sin(angle);
+					vy = PARTICLE_SPEED * cos(angle);
+
+					// create new particle in the next free slot
+					new (&this->particles[this->state->particleCount++])
+							Particle(x, y, vx, vy, delay);
+					angle += angle_increment;
+				}
+			}
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// tick
+//
+// Starts a new explosion of the previously displayed time if the time has changed
+//
+// -> led: LED module to render to
+// <- --
+//---------------------------------------------------------------------------------------
+void ExplosionEffect::tick(LEDFunctionsClass &led)
+{
+	uint8_t *buf = Scratch.frame<index_buffer_t>()->data;
+
+	// check if the displayed time has changed
+	if((led.m/5 != this->state->lastM/5) || (led.h != this->state->lastH))
+	{
+		// prepare new animation with old time
+		led.renderTime(buf, this->state->lastH, this->state->lastM, 0, 0);
+		this->prepare(buf);
+	}
+
+	this->state->lastM = led.m;
+	this->state->lastH = led.h;
+}
+
+//---------------------------------------------------------------------------------------
+// render
+//
+// Renders the exploding letters animation
+//
+// -> led: LED module to render to
+// <- --
+//---------------------------------------------------------------------------------------
+void ExplosionEffect::render(LEDFunctionsClass &led)
+{
+	uint8_t *buf = Scratch.frame<index_buffer_t>()->data;
+
+	// create empty buffer filled with seconds color
+	led.fillBackground(led.s, led.ms, buf);
+
+	// minutes 1...4 for the corners
+	for(int i=0; i<=((led.m%5)-1); i++) buf[10 * 11 + i] = 1;
+
+	// Do we have something to explode?
+	if(this->state->particleCount > 0)
+	{
+		// transfer background created by fillBackground to target buffer
+		led.setTimeColors(buf, true);
+
+		// iterate over all particles, keep the active ones at the beginning
+		// of the array
+		int kept = 0;
+		for(int i = 0; i < this->state->particleCount; i++)
+		{
+			Particle &p = this->particles[i];
+
+			// move and render current particle
+			p.render(led.currentValues, led.timeColors);
+
+			// if particle is still active, keep it; kill it otherwise
+			if(p.alive)
+			{
+				if(kept != i) this->particles[kept] = p;
+				kept++;
+			}
+		}
+		for(int i = kept; i < this->state->particleCount; i++)
+			this->particles[i].~Particle();
+		this->state->particleCount = kept;
+	}
+	else
+	{
+		// present the current time in boring mode with simple fading
+		led.renderTime(buf, led.h, led.m, led.s, led.ms);
+		led.setTimeColors(buf, led.isPreviewing());
+		if(!led.isPreviewing()) led.fade();
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// leave
+//
+// Destroys all remaining particles
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void ExplosionEffect::leave()
+{
+	for(int i = 0; i < this->state->particleCount; i++) this->particles[i].~Particle();
+	this->particles = NULL;
+	this->state = NULL;
+}
+
+//---------------------------------------------------------------------------------------
+// FlyingLettersEffect
+//
+// Constructor
+//
+// -> name: name of the effect
+//    up: true if the letters fly upwards, false if they fly downwards
+// <- --
+//---------------------------------------------------------------------------------------
+FlyingLettersEffect::FlyingLettersEffect(const char *name, bool up) : Effect(name)
+{
+	this->up = up;
+}
+
+//---------------------------------------------------------------------------------------
+// stateSize
+//
+// -> --
+// <- arena bytes for the animation state
+//---------------------------------------------------------------------------------------
+size_t FlyingLettersEffect::stateSize()
+{
+	return EFFECT_ARENA_ALIGN(sizeof(state_t));
+}
+
+//---------------------------------------------------------------------------------------
+// enter
+//
+// Starts the animation immediately, even if the current time did not yet change
+//
+// -> led: LED module to render to
+//    arena: memory for the animation state
+// <- --
+//---------------------------------------------------------------------------------------
+void FlyingLettersEffect::enter(LEDFunctionsClass &led, EffectArena &arena)
+{
+	uint8_t *buf = Scratch.frame<index_buffer_t>()->data;
+
+	this->state = (state_t*) arena.alloc(sizeof(state_t));
+	this->state->lastH = led.h;
+	this->state->lastM = led.m;
+
+	led.renderTime(buf, led.h, led.m, led.s, led.ms);
+	this->prepare(led, buf);
+}
+
+//---------------------------------------------------------------------------------------
+// prepare
+//
+// Sets the current buffer as target state for flying letters, initializes current
+// positions of the letters below the visible area with some random jitter
+//
+// -> led: LED module to render to
+//    source: buffer to read the currently active LEDs from
+// <- --
+//---------------------------------------------------------------------------------------
+void FlyingLettersEffect::prepare(LEDFunctionsClass &led, uint8_t *source)
+{
+	state_t *st = this->state;
+
+	// transfer the previous flying letters in the leaving letters array to prepare for
+	// outgoing animation
+	st->leavingCount = 0;
+	for(int i = 0; i < st->arrivingCount; i++)
+	{
+		xy_t &p = st->arriving[i];
+
+		// delay every letter depending on its position
+		// and set new target coordinate
+		if(this->up)
+		{
+			p.delay = p.y * 2 + p.x + 1 + random(5);
+			p.yTarget = -1;
+		}
+		else
+		{
+			p.delay = (LEDFunctionsClass::height - p.y - 1) * 2 + p.x + 1 + random(5);
+			p.yTarget = LEDFunctionsClass::height;
+		}
+		st->leaving[st->leavingCount++] = p;
+	}
+
+	// initialize arriving letters from scratch
+	st->arrivingCount = 0;
+	int ofs = 0;
+
+	// iterate over every position in the screen buffer
+	for(int y=0; y<LEDFunctionsClass::height; y++)
+	{
+		for(int x=0; x<LEDFunctionsClass::width; x++)
+		{
+			// create entry in arriving letters if current pixel is foreground
+			if(source[ofs++] == 1 && st->arrivingCount < MAX_TIME_LETTERS)
+			{
+				if(this->up)
+				{
+					xy_t p = {x, y, x, LEDFunctionsClass::height,
+							(int)(y * 2 + x + 1 + random(5)), 200, 0};
+					st->arriving[st->arrivingCount++] = p;
+				}
+				else
+				{
+					xy_t p = {x, y, x, -1,
+							(int)((LEDFunctionsClass::height - y - 1) * 2 + x + 1 + random(5)),
+							200, 0};
+					st->arriving[st->arrivingCount++] = p;
+				}
+			}
+		}
+	}
+
+	// DEBUG
+	Serial.printf("h=%i, m=%i, s=%i, lastH=%i, lastM=%i\r\n", led.h, led.m, led.s, st->lastH, st->lastM);
+	Serial.println("leavingLetters:");
+	for(int i = 0; i < st->leavingCount; i++)
+	{
+		xy_t &p = st->leaving[i];
+		Serial.printf("  counter=%i, delay=%i, speed=%i, x=%i, y=%i, xTarget=%i, yTarget=%i\r\n",
+				p.counter, p.delay, p.speed, p.x, p.y, p.xTarget, p.yTarget);
+	}
+	Serial.println("arrivingLetters:");
+	for(int i = 0; i < st->arrivingCount; i++)
+	{
+		xy_t &p = st->arriving[i];
+		Serial.printf("  counter=%i, delay=%i, speed=%i, x=%i, y=%i, xTarget=%i, yTarget=%i\r\n",
+				p.counter, p.delay, p.speed, p.x, p.y, p.xTarget, p.yTarget);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// tick
+//
+// Prepares a new animation if the displayed time has changed
+//
+// -> led: LED module to render to
+// <- --
+//---------------------------------------------------------------------------------------
+void FlyingLettersEffect::tick(LEDFunctionsClass &led)
+{
+	uint8_t *buf = Scratch.frame<index_buffer_t>()->data;
+
+	// check if the displayed time has changed
+	if((led.m/5 != this->state->lastM/5) || (led.h != this->state->lastH))
+	{
+		// prepare new animation
+		led.renderTime(buf, led.h, led.m, led.s, led.ms);
+		this->prepare(led, buf);
+	}
+
+	this->state->lastM = led.m;
+	this->state->lastH = led.h;
+}
+
+//---------------------------------------------------------------------------------------
+// render
+//
+// Takes the current arriving and leaving letters to render the flying letters
+// animation
+//
+// -> led: LED module to render to
+// <- --
+//---------------------------------------------------------------------------------------
+void FlyingLettersEffect::render(LEDFunctionsClass &led)
+{
+	uint8_t *buf = Scratch.frame<index_buffer_t>()->data;
+	state_t *st = this->state;
+
+	// create empty buffer filled with seconds color
+	led.fillBackground(led.s, led.ms, buf);
+
+	// minutes 1...4 for the corners
+	for(int i=0; i<=((led.m%5)-1); i++) buf[10 * 11 + i] = 1;
+
+	// leaving letters animation has priority
+	if(st->leavingCount > 0)
+	{
+		// count actually moved letters to detect end of animation
+		int movedLetters = 0;
+
+		// iterate over all leaving letters
+		for(int i = 0; i < st->leavingCount; i++)
+		{
+			xy_t &p = st->leaving[i];
+
+			// draw letter only if inside visible area
+			if(p.x>=0 && p.y>=0 && p.x<LEDFunctionsClass::width
+					&& p.y<LEDFunctionsClass::height)
+				buf[p.x + p.y * LEDFunctionsClass::width] = 1;
+
+			// continue with next letter if the current letter already
+			// reached its target position
+			if(p.y == p.yTarget && p.x == p.xTarget) continue;
+			p.counter += p.speed;
+			movedLetters++;
+			if(p.counter >= 1000)
+			{
+				p.counter -= 1000;
+				if(p.delay>0)
+				{
+					// do not move if animation of current letter is delayed
+					p.delay--;
+				}
+				else
+				{
+					if(p.y > p.yTarget) p.y--; else p.y++;
+				}
+			}
+		}
+		if(movedLetters == 0) st->leavingCount = 0;
+	}
+	else
+	{
+		// iterate over all arriving letters
+		for(int i = 0; i < st->arrivingCount; i++)
+		{
+			xy_t &p = st->arriving[i];
+
+			// draw letter only if inside visible area
+			if(p.x>=0 && p.y>=0 && p.x<LEDFunctionsClass::width
+					&& p.y<LEDFunctionsClass::height)
+				buf[p.x + p.y * LEDFunctionsClass::width] = 1;
+
+			// continue with next letter if the current letter already
+			// reached its target position
+			if(p.y == p.yTarget && p.x == p.xTarget) continue;
+			p.counter += p.speed;
+			if(p.counter >= 1000)
+			{
+				p.counter -= 1000;
+				if(p.delay>0)
+				{
+					// do not move if animation of current letter is delayed
+					p.delay--;
+				}
+				else
+				{
+					if(p.y > p.yTarget) p.y--; else p.y++;
+				}
+			}
+		}
+	}
+
+	// present the current content immediately without fading
+	led.setTimeColors(buf, true);
+}
+
+//---------------------------------------------------------------------------------------
+// leave
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void FlyingLettersEffect::leave()
+{
+	this->state = NULL;
+}
+
+#endif
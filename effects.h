@@ -0,0 +1,237 @@
+// ESP8266 Wordclock
+// Copyright (C) 2016 Thoralt Franz, https://github.com/thoralt
+//
+//  See effects.cpp for description.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _EFFECTS_H_
+#define _EFFECTS_H_
+
+#include <stdint.h>
+
+#include "config.h"
+#include "effect.h"
+#include "ledfunctions.h"
+#include "matrixobject.h"
+#include "starobject.h"
+#include "particle.h"
+
+#define NUM_MATRIX_OBJECTS 25
+#define NUM_STARS 10
+
+// maximum number of letters lit by LEDFunctionsClass::renderTime() in the 11x10 area
+#define MAX_TIME_LETTERS 24
+
+// number of particles per exploding letter
+#define PARTICLE_COUNT 16
+#define PARTICLE_SPEED 0.15f
+#define MAX_PARTICLES (MAX_TIME_LETTERS * PARTICLE_COUNT)
+
+typedef struct _xy_t
+{
+	int xTarget, yTarget, x, y, delay, speed, counter;
+} xy_t;
+
+// shows the current time, either immediately or fading to the new state using the
+// fade target in the mode scratch region
+class TimeEffect : public Effect
+{
+public:
+	TimeEffect(const char *name, bool fade);
+	void render(LEDFunctionsClass &led);
+
+private:
+	bool fade;
+};
+
+// shows a static image with a fixed palette
+class ImageEffect : public Effect
+{
+public:
+	ImageEffect(const char *name, const uint8_t *image, const palette_entry *palette);
+	void render(LEDFunctionsClass &led);
+
+private:
+	const uint8_t *image;
+	const palette_entry *palette;
+};
+
+class HourglassEffect : public Effect
+{
+public:
+	HourglassEffect(const char *name, bool green);
+	void render(LEDFunctionsClass &led);
+
+private:
+	bool green;
+};
+
+class UpdateEffect : public Effect
+{
+public:
+	UpdateEffect(const char *name);
+	void render(LEDFunctionsClass &led);
+};
+
+// shows the pixel data written to the LED buffer by UdpStreamClass or SerialStreamClass
+class StreamEffect : public Effect
+{
+public:
+	StreamEffect(const char *name);
+	void render(LEDFunctionsClass &led);
+};
+
+class MatrixEffect : public Effect
+{
+public:
+	MatrixEffect(const char *name);
+	size_t stateSize();
+	void enter(LEDFunctionsClass &led, EffectArena &arena);
+	void render(LEDFunctionsClass &led);
+	void leave();
+
+private:
+	MatrixObject *objects = NULL;
+};
+
+class StarsEffect : public Effect
+{
+public:
+	StarsEffect(const char *name);
+	size_t stateSize();
+	void enter(LEDFunctionsClass &led, EffectArena &arena);
+	void render(LEDFunctionsClass &led);
+	void leave();
+
+private:
+	StarObject *stars = NULL;
+};
+
+class HeartEffect : public Effect
+{
+public:
+	HeartEffect(const char *name);
+	size_t stateSize();
+	void enter(LEDFunctionsClass &led, EffectArena &arena);
+	void tick(LEDFunctionsClass &led);
+	void render(LEDFunctionsClass &led);
+	void leave();
+
+private:
+	typedef struct _state_t
+	{
+		int brightness, state;
+	} state_t;
+	state_t *state = NULL;
+};
+
+// base class for effects which display the index buffer in the mode scratch region
+// through a gradient palette, keeps the expanded lookup table in the arena and rebuilds
+// it whenever the palette changes
+class GradientEffect : public Effect
+{
+public:
+	GradientEffect(const char *name, const gradient_t *gradient);
+	size_t stateSize();
+	void enter(LEDFunctionsClass &led, EffectArena &arena);
+	void tick(LEDFunctionsClass &led);
+	void render(LEDFunctionsClass &led);
+	void leave();
+
+private:
+	typedef struct _lut_state_t
+	{
+		uint32_t version;
+		color_lut_t lut;
+	} lut_state_t;
+	lut_state_t *lutState = NULL;
+	const gradient_t *gradient;
+};
+
+class FireEffect : public GradientEffect
+{
+public:
+	FireEffect(const char *name, const gradient_t *gradient);
+	void tick(LEDFunctionsClass &led);
+	void render(LEDFunctionsClass &led);
+};
+
+class PlasmaEffect : public GradientEffect
+{
+public:
+	PlasmaEffect(const char *name, const gradient_t *gradient);
+	size_t stateSize();
+	void enter(LEDFunctionsClass &led, EffectArena &arena);
+	void tick(LEDFunctionsClass &led);
+	void leave();
+
+private:
+	typedef struct _state_t
+	{
+		double time;
+	} state_t;
+	state_t *state = NULL;
+};
+
+// fades via the fade target in the mode scratch region
+class ExplosionEffect : public Effect
+{
+public:
+	ExplosionEffect(const char *name);
+	size_t stateSize();
+	void enter(LEDFunctionsClass &led, EffectArena &arena);
+	void tick(LEDFunctionsClass &led);
+	void render(LEDFunctionsClass &led);
+	void leave();
+
+private:
+	typedef struct _state_t
+	{
+		int lastM, lastH;
+		int particleCount;
+	} state_t;
+	state_t *state = NULL;
+	Particle *particles = NULL;
+
+	void prepare(uint8_t *source);
+};
+
+class FlyingLettersEffect : public Effect
+{
+public:
+	FlyingLettersEffect(const char *name, bool up);
+	size_t stateSize();
+	void enter(LEDFunctionsClass &led, EffectArena &arena);
+	void tick(LEDFunctionsClass &led);
+	void render(LEDFunctionsClass &led);
+	void leave();
+
+private:
+	typedef struct _state_t
+	{
+		int lastM, lastH;
+		int arrivingCount, leavingCount;
+		xy_t arriving[MAX_TIME_LETTERS];
+		xy_t leaving[MAX_TIME_LETTERS];
+	} state_t;
+	state_t *state = NULL;
+	bool up;
+
+	void prepare(LEDFunctionsClass &led, uint8_t *source);
+};
+
+void registerEffects(EffectRegistry &registry);
+size_t effectTablesInFlash();
+
+#endif
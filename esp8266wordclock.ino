@@ -33,7 +33,12 @@
 
 #include "ledfunctions.h"
 #include "brightness.h"
+#include "lighthistory.h"
+#include "livestream.h"
+#include "udpstream.h"
+#include "serialstream.h"
 #include "ntp.h"
+#include "clock.h"
 #include "webserver.h"
 #include "config.h"
 #include "osapi.h"
@@ -55,13 +60,11 @@ int OTA_in_progress = 0;
 //---------------------------------------------------------------------------------------
 #define TIMER_RESOLUTION 10
 #define HOURGLASS_ANIMATION_PERIOD 100
+
+// change of the clock drift estimate in ppb which is saved to EEPROM
+#define DRIFT_SAVE_THRESHOLD 1000
 Ticker timer;
-int h = 0;
-int m = 0;
-int s = 0;
-int ms = 0;
 int lastSecond = -1;
-bool timeVarLock = false;
 bool startup = true;
 
 int hourglassState = 0;
@@ -72,33 +75,15 @@ int updateCountdown = 25;
 //---------------------------------------------------------------------------------------
 // timerCallback
 //
-// Increments time, decrements timeout and NTP timer
+// Decrements timeout, blinks the heartbeat LED and advances the hourglass animation
 //
 // -> --
 // <- --
 //---------------------------------------------------------------------------------------
 void timerCallback()
 {
-	// update time variables
-	if (!timeVarLock)
-	{
-		timeVarLock = true;
-		ms += TIMER_RESOLUTION;
-		if (ms >= 1000)
-		{
-			ms -= 1000;
-			if (++s > 59)
-			{
-				s = 0;
-				if (++m > 59)
-				{
-					m = 0;
-					if (++h > 23) h = 0;
-				}
-			}
-		}
-		timeVarLock = false;
-	}
+	clock_time_t time;
+	Clock.getLocalTime(time);
 
 	// decrement delayed EEPROM config timer
 	if(Config.delayedWriteTimer)
@@ -108,7 +93,7 @@ void timerCallback()
 	}
 
 	// blink onboard LED if heartbeat is enabled
-	if (ms == 0 && Config.heartbeat) digitalWrite(LED_BUILTIN, LOW);
+	if (time.ms < TIMER_RESOLUTION && Config.heartbeat) digitalWrite(LED_BUILTIN, LOW);
 	else digitalWrite(LED_BUILTIN, HIGH);
 
 	hourglassPrescaler += TIMER_RESOLUTION;
@@ -142,26 +127,59 @@ void configModeCallback(WiFiManager *myWiFiManager)
 //---------------------------------------------------------------------------------------
 // NtpCallback
 //
-// Is called by the NTP class upon successful reception of an NTP data packet. Updates
-// the global hour, minute, second and millisecond values.
+// Is called by the NTP class upon successful reception of an NTP data packet.
+// Corrects the clock and saves its drift estimate once it has changed noticeably.
 //
-// ->
+// -> offset: UTC minus the time of the clock in microseconds
+//    localOffset: seconds the local time is ahead of UTC
 // <- --
 //---------------------------------------------------------------------------------------
-void NtpCallback(uint8_t _h, uint8_t _m, uint8_t _s, uint8_t _ms)
+void NtpCallback(int64_t offset, int32_t localOffset)
 {
 	Serial.println("NtpCallback()");
+	Clock.discipline(offset, localOffset);
 
-	// wait if timer variable lock is set
-	while (timeVarLock) delay(1);
+	int32_t drift = Clock.getDrift();
+	if (abs(drift - Config.clockDrift) >= DRIFT_SAVE_THRESHOLD)
+	{
+		Config.clockDrift = drift;
+		Config.saveDelayed();
+	}
+}
 
-	// lock timer variables to prevent changes during interrupt
-	timeVarLock = true;
-	h = _h;
-	m = _m;
-	s = _s;
-	ms = _ms;
-	timeVarLock = false;
+//---------------------------------------------------------------------------------------
+// handleSerial
+//
+// Reads all bytes received on the serial port, passes them to the Adalight/TPM2
+// decoder and executes single character commands outside of frames
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void handleSerial()
+{
+	for (int n = Serial.available(); n > 0; n--)
+	{
+		int incoming = Serial.read();
+		if (incoming < 0) break;
+		if (SerialStream.decode(incoming)) continue;
+
+		switch (incoming)
+		{
+		case 'i':
+			Serial.println("WordClock ESP8266 ready.");
+			break;
+
+		case 'X':
+			WiFi.disconnect();
+			ESP.reset();
+			break;
+
+		default:
+			Serial.printf("Unknown command '%c'\r\n", incoming);
+			break;
+		}
+	}
 }
 
 void setLED(unsigned char r, unsigned char g, unsigned char b)
@@ -189,8 +207,9 @@ void setup()
 
 	setLED(1, 0, 0);
 
-	// serial port
-	Serial.begin(115200);
+	// serial port, fast enough for Adalight/TPM2 frames
+	Serial.setRxBufferSize(SERIAL_RX_BUFFER);
+	Serial.begin(SERIAL_BAUD);
 	Serial.println();
 	Serial.println();
 	Serial.println("ESP8266 WordClock setup() begin");
@@ -209,8 +228,10 @@ void setup()
 	// configuration
 	Serial.println("Loading configuration");
 	Config.begin();
+	Clock.setDrift(Config.clockDrift);
 //	Config.reset();
 //	Config.save();
+	Brightness.begin();
 
 	// LEDs
 	Serial.println("Starting LED module");
@@ -278,12 +299,16 @@ void setup()
 
 	// NTP
 	Serial.println("Starting NTP module");
-	NTP.begin(Config.ntpserver, NtpCallback, 1, true);
+	NTP.begin(Config.ntpServers, NtpCallback, 1, true);
 
 	// web server
 	Serial.println("Starting HTTP server");
 	WebServer.begin();
 
+	// pixel data from lighting controllers
+	Serial.println("Starting UDP stream input");
+	UdpStream.begin();
+
 //	telnetServer.begin();
 //	telnetServer.setNoDelay(true);
 
@@ -302,10 +327,17 @@ void loop()
 	ArduinoOTA.handle();
 
 	// update LEDs
-	LED.setBrightness(Brightness.value());
-	LED.setTime(h, m, s, ms);
+	clock_time_t time;
+	Clock.getLocalTime(time);
+	uint32_t brightness = Brightness.value();
+	LED.setBrightness(brightness);
+	LED.setTime(time.h, time.m, time.s, time.ms);
 	LED.process();
 
+	// record ambient light
+	LightHistory.process(Brightness.avg >> BRIGHTNESS_AVG_SHIFT, brightness,
+			Brightness.brightnessOverride < 256);
+
 	// do not continue if OTA update is in progress
 	// OTA callbacks drive the LED display mode and OTA progress
 	// in the background, the above call to LED.process() ensures
@@ -331,17 +363,27 @@ void loop()
 		return;
 	}
 
-	// set mode depending on current time
-	if(h == 13 && m == 37) LED.setMode(DisplayMode::matrix);
-	else if(h == 19 && m == 00) LED.setMode(DisplayMode::matrix);
-	else if(h == 20 && m == 00) LED.setMode(DisplayMode::plasma);
-	else if(h == 21 && m == 00) LED.setMode(DisplayMode::fire);
-	else if(h == 22 && m == 00) LED.setMode(DisplayMode::heart);
-	else if(h == 23 && m == 00) LED.setMode(DisplayMode::stars);
+	// serial commands and frames
+	handleSerial();
+
+	// received pixel data takes precedence over the clock until the stream times out,
+	// otherwise set mode depending on current time
+	UdpStream.process();
+	if(UdpStream.isActive() || SerialStream.isActive()) LED.setMode(DisplayMode::stream);
+	else if(time.h == 13 && time.m == 37) LED.setMode(DisplayMode::matrix);
+	else if(time.h == 19 && time.m == 00) LED.setMode(DisplayMode::matrix);
+	else if(time.h == 20 && time.m == 00) LED.setMode(DisplayMode::plasma);
+	else if(time.h == 21 && time.m == 00) LED.setMode(DisplayMode::fire);
+	else if(time.h == 22 && time.m == 00) LED.setMode(DisplayMode::heart);
+	else if(time.h == 23 && time.m == 00) LED.setMode(DisplayMode::stars);
 	else LED.setMode(Config.defaultMode);
 
 	// do web server stuff
 	WebServer.process();
+	LiveStream.process();
+
+	// NTP requests, received replies and server name lookups
+	NTP.process();
 
 	// save configuration to EEPROM if necessary
 	if(Config.delayedWriteFlag)
@@ -352,33 +394,15 @@ void loop()
 	}
 
 	// output current time if seconds value has changed
-	if (s != lastSecond)
+	if (time.s != lastSecond)
 	{
-		lastSecond = s;
+		lastSecond = time.s;
 		DEBUG("%02i:%02i:%02i, filtered ADC=%i.%02i, heap=%i, brightness=%i\r\n",
-			  h, m, s, (int)Brightness.avg, (int)(Brightness.avg*100)%100,
+			  time.h, time.m, time.s, (int)(Brightness.avg >> BRIGHTNESS_AVG_SHIFT),
+			  (int)(((Brightness.avg & ((1 << BRIGHTNESS_AVG_SHIFT) - 1)) * 100)
+					  >> BRIGHTNESS_AVG_SHIFT),
 			  ESP.getFreeHeap(), Brightness.value());
 	}
-
-	if (Serial.available())
-	{
-		int incoming = Serial.read();
-		switch (incoming)
-		{
-		case 'i':
-			Serial.println("WordClock ESP8266 ready.");
-			break;
-
-		case 'X':
-			WiFi.disconnect();
-			ESP.reset();
-			break;
-
-		default:
-			Serial.printf("Unknown command '%c'\r\n", incoming);
-			break;
-		}
-	}
 }
 // ./esptool.py --port /dev/tty.usbserial --baud 460800 write_flash --flash_size=8m 0 /var/folders/yh/bv744591099f3x24xbkc22zw0000gn/T/build006b1a55228a1b90dda210fcddb62452.tmp/test.ino.bin
 // FlashSize 1M (128k SPIFFS)
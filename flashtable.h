@@ -0,0 +1,64 @@
+// ESP8266 Wordclock
+// Copyright (C) 2016 Thoralt Franz, https://github.com/thoralt
+//
+//  This file contains the accessors for constant tables in flash memory. The ESP8266
+//  can only read flash (PROGMEM) with aligned 32 bit accesses, so byte tables can not
+//  be dereferenced directly. These accessors read the surrounding 32 bit word and
+//  extract the requested byte, which also works for tables in RAM. Tables read through
+//  them may therefore be declared as plain uint8_t arrays without any padding.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _FLASHTABLE_H_
+#define _FLASHTABLE_H_
+
+#include <stdint.h>
+#include "config.h"
+
+//---------------------------------------------------------------------------------------
+// flashRead8
+//
+// Reads one byte from a table in flash or RAM using an aligned 32 bit access
+//
+// -> table: start of the table
+//    index: byte offset inside the table
+// <- byte value
+//---------------------------------------------------------------------------------------
+inline uint8_t flashRead8(const uint8_t *table, uint32_t index)
+{
+	uintptr_t address = (uintptr_t)(table + index);
+	uint32_t word = *(const uint32_t*)(address & ~(uintptr_t)0x03);
+	return (uint8_t)(word >> ((address & 0x03) << 3));
+}
+
+//---------------------------------------------------------------------------------------
+// flashReadPalette
+//
+// Reads one entry from a packed RGB palette (3 bytes per entry) in flash or RAM
+//
+// -> palette: start of the palette
+//    index: palette index
+// <- color
+//---------------------------------------------------------------------------------------
+inline palette_entry flashReadPalette(const palette_entry *palette, uint32_t index)
+{
+	const uint8_t *table = (const uint8_t*) palette;
+	index *= 3;
+	palette_entry result = {
+		flashRead8(table, index + 0),
+		flashRead8(table, index + 1),
+		flashRead8(table, index + 2)};
+	return result;
+}
+
+#endif
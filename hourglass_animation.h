@@ -2,7 +2,7 @@
 // Copyright (C) 2016 Thoralt Franz, https://github.com/thoralt
 //
 //  This file contains the hourglass animation. This is not a regular header file,
-//  it must be included only once from ledfunctions.cpp.
+//  it must be included only once from effects.cpp.
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -22,11 +22,9 @@
 #include <stdint.h>
 #include "config.h"
 
-// animation frames for hourglass animation
-// second dimension is NUM_PIXELS+2 to guarantee each frame starts at
-// a 32 bit boundary
-#define NUM_PIXELS_ALIGNED ((NUM_PIXELS + 3) & ~0x03)
-static const uint8_t PROGMEM hourglass_animation[HOURGLASS_ANIMATION_FRAMES][NUM_PIXELS_ALIGNED] = {
+// animation frames for hourglass animation, frames are packed without padding and
+// must be read through the accessors from flashtable.h
+static const uint8_t PROGMEM hourglass_animation[HOURGLASS_ANIMATION_FRAMES][NUM_PIXELS] = {
 	{   0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0,
 		0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0,
 		0, 0, 1, 2, 2, 0, 2, 2, 1, 0, 0,
@@ -37,7 +35,7 @@ static const uint8_t PROGMEM hourglass_animation[HOURGLASS_ANIMATION_FRAMES][NUM
 		0, 0, 1, 0, 2, 2, 2, 0, 1, 0, 0,
 		0, 0, 1, 2, 2, 2, 2, 2, 1, 0, 0,
 		0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0,
-		3, 3, 3, 3, 0, 0},
+		3, 3, 3, 3},
 	{   0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0,
 		0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0,
 		0, 0, 1, 2, 2, 0, 2, 2, 1, 0, 0,
@@ -48,7 +46,7 @@ static const uint8_t PROGMEM hourglass_animation[HOURGLASS_ANIMATION_FRAMES][NUM
 		0, 0, 1, 0, 2, 2, 2, 0, 1, 0, 0,
 		0, 0, 1, 2, 2, 2, 2, 2, 1, 0, 0,
 		0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0,
-		3, 3, 3, 3, 0, 0},
+		3, 3, 3, 3},
 	{   0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0,
 		0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0,
 		0, 0, 1, 2, 2, 0, 2, 2, 1, 0, 0,
@@ -59,7 +57,7 @@ static const uint8_t PROGMEM hourglass_animation[HOURGLASS_ANIMATION_FRAMES][NUM
 		0, 0, 1, 0, 2, 2, 2, 0, 1, 0, 0,
 		0, 0, 1, 2, 2, 2, 2, 2, 1, 0, 0,
 		0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0,
-		3, 3, 3, 3, 0, 0},
+		3, 3, 3, 3},
 	{   0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0,
 		0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0,
 		0, 0, 1, 2, 2, 0, 2, 2, 1, 0, 0,
@@ -70,7 +68,7 @@ static const uint8_t PROGMEM hourglass_animation[HOURGLASS_ANIMATION_FRAMES][NUM
 		0, 0, 1, 0, 2, 2, 2, 0, 1, 0, 0,
 		0, 0, 1, 2, 2, 2, 2, 2, 1, 0, 0,
 		0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0,
-		3, 3, 3, 3, 0, 0},
+		3, 3, 3, 3},
 	{   0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0,
 		0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0,
 		0, 0, 1, 2, 2, 0, 2, 2, 1, 0, 0,
@@ -81,7 +79,7 @@ static const uint8_t PROGMEM hourglass_animation[HOURGLASS_ANIMATION_FRAMES][NUM
 		0, 0, 1, 0, 2, 2, 2, 0, 1, 0, 0,
 		0, 0, 1, 2, 2, 2, 2, 2, 1, 0, 0,
 		0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0,
-		3, 3, 3, 3, 0, 0},
+		3, 3, 3, 3},
 	{   0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0,
 		0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0,
 		0, 0, 1, 2, 2, 0, 2, 2, 1, 0, 0,
@@ -92,7 +90,7 @@ static const uint8_t PROGMEM hourglass_animation[HOURGLASS_ANIMATION_FRAMES][NUM
 		0, 0, 1, 0, 2, 2, 2, 0, 1, 0, 0,
 		0, 0, 1, 2, 2, 2, 2, 2, 1, 0, 0,
 		0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0,
-		3, 3, 3, 3, 0, 0},
+		3, 3, 3, 3},
 	{   0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0,
 		0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0,
 		0, 0, 1, 2, 2, 0, 2, 2, 1, 0, 0,
@@ -103,7 +101,7 @@ static const uint8_t PROGMEM hourglass_animation[HOURGLASS_ANIMATION_FRAMES][NUM
 		0, 0, 1, 0, 2, 2, 2, 0, 1, 0, 0,
 		0, 0, 1, 2, 2, 2, 2, 2, 1, 0, 0,
 		0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0,
-		3, 3, 3, 3, 0, 0},
+		3, 3, 3, 3},
 	{   0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0,
 		0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0,
 		0, 0, 1, 2, 2, 0, 2, 2, 1, 0, 0,
@@ -114,7 +112,7 @@ static const uint8_t PROGMEM hourglass_animation[HOURGLASS_ANIMATION_FRAMES][NUM
 		0, 0, 1, 0, 2, 2, 2, 0, 1, 0, 0,
 		0, 0, 1, 2, 2, 2, 2, 2, 1, 0, 0,
 		0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0,
-		3, 3, 3, 3, 0, 0}
+		3, 3, 3, 3}
 };
 
 #endif
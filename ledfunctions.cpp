@@ -3,8 +3,7 @@
 //
 //  This module implements functions to manage the WS2812B LEDs. Two buffers contain
 //  color information with current state and fade target state and are updated by
-//  either simple set operations or integrated screensavers (matrix, stars, heart).
-//  Also contains part of the data and logic for the hourglass animation.
+//  the currently active display effect (see effects.cpp).
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -19,6 +18,8 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "ledfunctions.h"
+#include "flashtable.h"
+#include "effects.h"
 
 //---------------------------------------------------------------------------------------
 #if 1 // variables
@@ -29,13 +30,10 @@
 //---------------------------------------------------------------------------------------
 LEDFunctionsClass LED = LEDFunctionsClass();
 
-uint8_t fireBuf[NUM_PIXELS];
-uint8_t plasmaBuf[NUM_PIXELS];
-
 //---------------------------------------------------------------------------------------
-// variables in PROGMEM (mapping table, images)
+// variables in PROGMEM (mapping table, templates, brightness curves), byte tables are
+// read with the accessors from flashtable.h
 //---------------------------------------------------------------------------------------
-#include "hourglass_animation.h"
 
 // This defines the LED output for different minutes
 // param0 controls whether the hour has to be incremented for the given minutes
@@ -91,7 +89,7 @@ const std::vector<leds_template_t> LEDFunctionsClass::hoursTemplate =
 #if 1 // code folding mapping table
 // this mapping table maps the linear memory buffer structure used throughout the
 // project to the physical layout of the LEDs
-const uint32_t PROGMEM LEDFunctionsClass::mapping[NUM_PIXELS] = {
+const uint8_t PROGMEM LEDFunctionsClass::mapping[NUM_PIXELS] = {
 	10,   9,   8,   7,   6,   5,   4,   3,   2,   1,   0,
 	11,  12,  13,  14,  15,  16,  17,  18,  19,  20,  21,
 	32,  31,  30,  29,  28,  27,  26,  25,  24,  23,  22,
@@ -107,43 +105,7 @@ const uint32_t PROGMEM LEDFunctionsClass::mapping[NUM_PIXELS] = {
 #endif
 
 #if 1 // code folding brightness adjust tables
-const uint32_t PROGMEM LEDFunctionsClass::brightnessCurveSelect[NUM_PIXELS] = {
-				0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-				0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-				0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-				0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-				0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-				0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-				0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-				0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-				0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-				0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-				0, 0, 0, 0
-		//		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		//		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		//		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		//		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		//		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		//		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		//		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		//		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		//		0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0,
-		//		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		//		0, 0, 0, 0
-		//		0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0,
-		//		1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		//		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		//		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		//		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		//		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		//		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		//		0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		//		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0,
-		//		0, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1,
-		//		0, 1, 0, 1
-};
-
-const uint32_t PROGMEM LEDFunctionsClass::brightnessCurvesR[256*NUM_BRIGHTNESS_CURVES] = {
+const uint8_t PROGMEM LEDFunctionsClass::brightnessCurvesR[256*NUM_BRIGHTNESS_CURVES] = {
 		// LED type 1, 1:1 mapping (neutral)
 		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19,
 		20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36,
@@ -184,7 +146,7 @@ const uint32_t PROGMEM LEDFunctionsClass::brightnessCurvesR[256*NUM_BRIGHTNESS_C
 		216, 216, 218, 218
 };
 
-const uint32_t PROGMEM LEDFunctionsClass::brightnessCurvesG[256*NUM_BRIGHTNESS_CURVES] = {
+const uint8_t PROGMEM LEDFunctionsClass::brightnessCurvesG[256*NUM_BRIGHTNESS_CURVES] = {
 		// LED type 1, 1:1 mapping (neutral)
 		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19,
 		20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36,
@@ -225,7 +187,7 @@ const uint32_t PROGMEM LEDFunctionsClass::brightnessCurvesG[256*NUM_BRIGHTNESS_C
 		232, 234, 234
 };
 
-const uint32_t PROGMEM LEDFunctionsClass::brightnessCurvesB[256*NUM_BRIGHTNESS_CURVES] = {
+const uint8_t PROGMEM LEDFunctionsClass::brightnessCurvesB[256*NUM_BRIGHTNESS_CURVES] = {
 		// LED type 1, 1:1 mapping (neutral)
 		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19,
 		20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36,
@@ -290,30 +252,19 @@ LEDFunctionsClass::~LEDFunctionsClass()
 //---------------------------------------------------------------------------------------
 // LEDFunctionsClass
 //
-// Constructor, initializes data structures
+// Constructor, the effects are registered in begin()
 //
 // -> --
 // <- --
 //---------------------------------------------------------------------------------------
 LEDFunctionsClass::LEDFunctionsClass()
 {
-	// initialize matrix objects with random coordinates
-	for (int i = 0; i < NUM_MATRIX_OBJECTS; i++)
-	{
-		this->matrix.push_back(MatrixObject());
-	}
-
-	// initialize star objects with default coordinates
-	for (int i = 0; i < NUM_STARS; i++) this->stars.push_back(StarObject());
-
-	// set random coordinates with minimum distance to other star objects
-	for (StarObject& s : this->stars) s.randomize(this->stars);
 }
 
 //---------------------------------------------------------------------------------------
 // begin
 //
-// Initializes the LED driver
+// Initializes the LED driver and registers the display effects
 //
 // -> pin: hardware pin to use for WS2812B data output
 // <- --
@@ -322,6 +273,61 @@ void LEDFunctionsClass::begin(int pin)
 {
 	this->pixels = new Adafruit_NeoPixel(NUM_PIXELS, pin, NEO_GRB + NEO_KHZ800);
 	this->pixels->begin();
+	this->loadCalibration();
+	registerEffects(this->effects);
+}
+
+//---------------------------------------------------------------------------------------
+// loadCalibration
+//
+// Compiles the brightness curves and the calibration profiles from Config into the
+// correction tables used by setBuffer() and buildLUT(). Must be called after the
+// calibration in Config has been changed.
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void LEDFunctionsClass::loadCalibration()
+{
+	const calibration_profile *profile;
+	uint32_t curveOffset, ofs;
+
+	for (int p = 0; p < NUM_CALIBRATION_PROFILES; p++)
+	{
+		profile = &Config.calibration[p];
+		curveOffset = (profile->curve < NUM_BRIGHTNESS_CURVES ? profile->curve : 0) << 8;
+		for (int v = 0; v < 256; v++)
+		{
+			ofs = (p << 8) + v;
+			this->correctionR[ofs] = calibrate(flashRead8(brightnessCurvesR,
+					curveOffset + v), profile->gain[0], profile->offset[0]);
+			this->correctionG[ofs] = calibrate(flashRead8(brightnessCurvesG,
+					curveOffset + v), profile->gain[1], profile->offset[1]);
+			this->correctionB[ofs] = calibrate(flashRead8(brightnessCurvesB,
+					curveOffset + v), profile->gain[2], profile->offset[2]);
+		}
+	}
+
+	// lookup tables of gradient effects contain corrected colors as well
+	Config.paletteVersion++;
+}
+
+//---------------------------------------------------------------------------------------
+// calibrate
+//
+// Applies gain and offset of a calibration profile to a single color value
+//
+// -> value: color value after brightness curve
+//    gain: gain with 128 = 1.0
+//    offset: value added after gain
+// <- calibrated value, clipped to 0...255
+//---------------------------------------------------------------------------------------
+uint8_t LEDFunctionsClass::calibrate(int value, int gain, int offset)
+{
+	value = ((value * gain + 64) >> 7) + offset;
+	if (value < 0) return 0;
+	if (value > 255) return 255;
+	return value;
 }
 
 //---------------------------------------------------------------------------------------
@@ -334,7 +340,16 @@ void LEDFunctionsClass::begin(int pin)
 //---------------------------------------------------------------------------------------
 void LEDFunctionsClass::process()
 {
-	if(Config.debugMode) return;
+	// in debug mode the LEDs are set from outside, only a test pattern is animated
+	if(Config.debugMode)
+	{
+		if(this->diagnostic != DiagnosticPattern::none)
+		{
+			this->renderDiagnostic();
+			this->show();
+		}
+		return;
+	}
 
 	// check time values against boundaries
 	if(this->h > 23 || this->h < 0) this->h = 0;
@@ -342,78 +357,13 @@ void LEDFunctionsClass::process()
 	if(this->s > 59 || this->s < 0) this->s = 0;
 	if(this->ms > 999 || this->ms < 0) this->ms = 0;
 
-	// load palette colors from configuration
-	palette_entry palette[] = {
-		{Config.bg.r, Config.bg.g, Config.bg.b},
-		{Config.fg.r, Config.fg.g, Config.fg.b},
-		{Config.s.r,  Config.s.g,  Config.s.b}};
-	uint8_t buf[NUM_PIXELS];
-
-	switch(this->mode)
-	{
-	case DisplayMode::wifiManager:
-		this->renderWifiManager();
-		break;
-	case DisplayMode::yellowHourglass:
-		this->renderHourglass(Config.hourglassState, false);
-		break;
-	case DisplayMode::greenHourglass:
-		this->renderHourglass(Config.hourglassState, true);
-		break;
-	case DisplayMode::update:
-		this->renderUpdate();
-		break;
-	case DisplayMode::updateComplete:
-		this->renderUpdateComplete();
-		break;
-	case DisplayMode::updateError:
-		this->renderUpdateError();
-		break;
-	case DisplayMode::red:
-		this->renderRed();
-		break;
-	case DisplayMode::green:
-		this->renderGreen();
-		break;
-	case DisplayMode::blue:
-		this->renderBlue();
-		break;
-	case DisplayMode::flyingLettersVerticalUp:
-	case DisplayMode::flyingLettersVerticalDown:
-		this->renderFlyingLetters();
-		break;
-	case DisplayMode::explode:
-		this->renderExplosion();
-		break;
-	case DisplayMode::matrix:
-		this->renderMatrix();
-		break;
-	case DisplayMode::heart:
-		this->renderHeart();
-		break;
-	case DisplayMode::stars:
-		this->renderStars();
-		break;
-	case DisplayMode::fire:
-		this->renderFire();
-		break;
-	case DisplayMode::plasma:
-		this->renderPlasma();
-		break;
-	case DisplayMode::fade:
-		this->renderTime(buf, this->h, this->m, this->s, this->ms);
-		this->set(buf, palette, false);
-		this->fade();
-		break;
-
-	case DisplayMode::random: // TODO: Implement random display mode
-	case DisplayMode::plain:
-	default:
-		this->renderTime(buf, this->h, this->m, this->s, this->ms);
-		this->set(buf, palette, true);
-		break;
-	}
+	// nothing to show until setMode() has activated an effect
+	Effect *effect = this->effects.current();
+	if(!effect) return;
 
+	this->updateTimeColors();
+	effect->tick(*this);
+	effect->render(*this);
 
 	// transfer this->currentValues to LEDs
 	this->show();
@@ -461,45 +411,42 @@ void LEDFunctionsClass::setTime(int h, int m, int s, int ms)
 //---------------------------------------------------------------------------------------
 void LEDFunctionsClass::setMode(DisplayMode newMode)
 {
-	uint8_t buf[NUM_PIXELS];
-	DisplayMode previousMode = this->mode;
-	this->mode = newMode;
-
-	// if we changed to an animated letters mode, then start animation
-	// even if the current time did not yet change
-	if(newMode != previousMode &&
-			(newMode == DisplayMode::flyingLettersVerticalUp ||
-			newMode == DisplayMode::flyingLettersVerticalDown))
+	// switch effects only if the mode changes, the previous effect releases its state
+	// and the new one starts from scratch
+	if(newMode != this->mode || !this->effects.current())
 	{
-		this->renderTime(buf, this->h, this->m, this->s, this->ms);
-		this->prepareFlyingLetters(buf);
-	}
-
-	// if we changed to exploding letters mode, then start animation
-	// even if the current time did not yet change
-	if(newMode != previousMode && newMode == DisplayMode::explode)
-	{
-		this->renderTime(buf, this->h, this->m, this->s, this->ms);
-		this->prepareExplosion(buf);
+		this->effects.activate(newMode, *this);
 	}
+	this->mode = newMode;
 
 	this->process();
 }
 
+//---------------------------------------------------------------------------------------
+// getMode
+//
+// Returns the current display mode
+//
+// -> --
+// <- current display mode
+//---------------------------------------------------------------------------------------
+DisplayMode LEDFunctionsClass::getMode()
+{
+	return this->mode;
+}
+
 //---------------------------------------------------------------------------------------
 // set
 //
 // Sets the internal LED buffer to new values based on an indexed source buffer and an
 // associated palette. Does not display colors immediately, fades to new colors instead.
-//
-// Attention: If buf is PROGMEM, make sure it is aligned at 32 bit and its size is
-// a multiple of 4 bytes!
+// Both buf and palette may reside in PROGMEM.
 //
 // -> buf: indexed source buffer
 //	palette: color definition for source buffer
 // <- --
 //---------------------------------------------------------------------------------------
-void LEDFunctionsClass::set(const uint8_t *buf, palette_entry palette[])
+void LEDFunctionsClass::set(const uint8_t *buf, const palette_entry palette[])
 {
 	this->set(buf, palette, false);
 }
@@ -510,995 +457,631 @@ void LEDFunctionsClass::set(const uint8_t *buf, palette_entry palette[])
 // Sets the internal LED buffer to new values based on an indexed source buffer and an
 // associated palette.
 //
-// Attention: If buf is PROGMEM, make sure it is aligned at 32 bit and its size is
-// a multiple of 4 bytes!
+// The fade target lives in the mode scratch region, so only effects which do not use
+// that region for anything else may fade. Both buf and palette may reside in PROGMEM.
 //
 // -> buf: indexed source buffer
 //	  palette: color definition for source buffer
 //	  immediately: if true, display buffer immediately; fade to new colors if false
 // <- --
 //---------------------------------------------------------------------------------------
-void LEDFunctionsClass::set(const uint8_t *buf, palette_entry palette[],
+void LEDFunctionsClass::set(const uint8_t *buf, const palette_entry palette[],
 		bool immediately)
 {
-	this->setBuffer(this->targetValues, buf, palette);
-
 	if (immediately)
 	{
 		this->setBuffer(this->currentValues, buf, palette);
 	}
+	else
+	{
+		this->setBuffer(Scratch.mode<rgb_buffer_t>()->data, buf, palette);
+	}
 }
 
 //---------------------------------------------------------------------------------------
-// setBuffer
+// setLUT
 //
-// Fills a buffer (e. g. this->targetValues) with color data based on indexed source
-// pixels and a palette. Pays attention to 32 bit boundaries, so use with PROGMEM is
-// safe.
+// Immediately sets the internal LED buffer from an indexed source buffer and a lookup
+// table built by buildLUT(). The table already contains corrected colors for each
+// calibration profile, so each pixel only costs a table read.
 //
-// -> target: color buffer, e. g. this->targetValues or this->currentValues
-//    source: buffer with color indexes
-//	  palette: colors for indexed source buffer
+// -> buf: indexed source buffer, may reside in PROGMEM
+//    lut: color lookup table
 // <- --
 //---------------------------------------------------------------------------------------
-void LEDFunctionsClass::setBuffer(uint8_t *target, const uint8_t *source,
-		palette_entry palette[])
+void LEDFunctionsClass::setLUT(const uint8_t *buf, const color_lut_t *lut)
 {
-	uint32_t mapping, palette_index, curveOffset;
-
-	// cast source to 32 bit pointer to ensure 32 bit aligned access
-	uint32_t *buf = (uint32_t*) source;
-	// this holds the current 4 bytes
-	uint32_t currentDWord;
-	// this is a pointer to the current 4 bytes for access as single bytes
-	uint8_t *currentBytes = (uint8_t*) &currentDWord;
-	// this counts bytes from 0...3
-	uint32_t byteCounter = 0;
+	uint32_t led, mapping;
+	const uint8_t *color;
+
 	for (int i = 0; i < NUM_PIXELS; i++)
 	{
-		// get next 4 bytes
-		if (byteCounter == 0) currentDWord = buf[i >> 2];
-
-		palette_index = currentBytes[byteCounter];
-		mapping = LEDFunctionsClass::mapping[i] * 3;
-		curveOffset = LEDFunctionsClass::brightnessCurveSelect[i] << 8;
-
-		// select color value using palette and brightness correction curves
-		target[mapping + 0] = brightnessCurvesR[curveOffset + palette[palette_index].r];
-		target[mapping + 1] = brightnessCurvesG[curveOffset + palette[palette_index].g];
-		target[mapping + 2] = brightnessCurvesB[curveOffset + palette[palette_index].b];
-
-		byteCounter = (byteCounter + 1) & 0x03;
+		led = flashRead8(LEDFunctionsClass::mapping, i);
+		mapping = led * 3;
+		color = lut->rgb[Config.ledProfile[led] & (NUM_CALIBRATION_PROFILES - 1)] +
+				flashRead8(buf, i) * 3;
+		this->currentValues[mapping + 0] = color[0];
+		this->currentValues[mapping + 1] = color[1];
+		this->currentValues[mapping + 2] = color[2];
 	}
 }
 
 //---------------------------------------------------------------------------------------
-// fade
+// buildLUT
 //
-// Fade one step of the color values from this->currentValues[i] to 
-// this->targetValues[i]. Uses non-linear fade speed depending on distance to target
-// value.
+// Expands a gradient palette into a 256 entry lookup table by linear interpolation
+// between its stops and applies the correction of each calibration profile. Indexes
+// outside the first and last stop get the color of that stop.
 //
-// -> --
+// -> gradient: gradient palette, must be valid (see ConfigClass::isValidGradient())
+//    lut: lookup table to receive the colors
 // <- --
 //---------------------------------------------------------------------------------------
-void LEDFunctionsClass::fade()
+void LEDFunctionsClass::buildLUT(const gradient_t *gradient, color_lut_t *lut)
 {
-	static int prescaler = 0;
-	if(++prescaler<2) return;
-	prescaler = 0;
+	const gradient_stop *a = &gradient->stops[0];
+	const gradient_stop *b = a;
+	int next = 0;
+	int span, weight;
+	uint8_t rgb[3];
 
-	int delta;
-	for (int i = 0; i < NUM_PIXELS * 3; i++)
+	for (int i = 0; i < 256; i++)
 	{
-		delta = this->targetValues[i] - this->currentValues[i];
-		if (delta > 64) this->currentValues[i] += 8;
-		else if (delta > 16) this->currentValues[i] += 4;
-		else if (delta > 0) this->currentValues[i]++;
-		else if (delta < -64) this->currentValues[i] -= 8;
-		else if (delta < -16) this->currentValues[i] -= 4;
-		else if (delta < 0) this->currentValues[i]--;
+		// advance to the segment containing i
+		while (next < gradient->count && gradient->stops[next].pos <= i)
+		{
+			a = &gradient->stops[next++];
+			b = (next < gradient->count) ? &gradient->stops[next] : a;
+		}
+
+		span = b->pos - a->pos;
+		weight = span ? ((i - a->pos) << 8) / span : 0;
+		rgb[0] = a->color.r + (((b->color.r - a->color.r) * weight) >> 8);
+		rgb[1] = a->color.g + (((b->color.g - a->color.g) * weight) >> 8);
+		rgb[2] = a->color.b + (((b->color.b - a->color.b) * weight) >> 8);
+
+		for (int p = 0; p < NUM_CALIBRATION_PROFILES; p++)
+		{
+			lut->rgb[p][i * 3 + 0] = this->correctionR[(p << 8) + rgb[0]];
+			lut->rgb[p][i * 3 + 1] = this->correctionG[(p << 8) + rgb[1]];
+			lut->rgb[p][i * 3 + 2] = this->correctionB[(p << 8) + rgb[2]];
+		}
 	}
 }
 
 //---------------------------------------------------------------------------------------
-// show
+// setBuffer
 //
-// Internal method, copies this->currentValues to WS2812 object while applying brightness
+// Fills a buffer (e. g. the fade target) with color data based on indexed source
+// pixels and a palette. Source and palette are read through the aligned accessors from
+// flashtable.h, so they may reside in PROGMEM without any padding. Colors are corrected
+// with the calibration profile of each LED.
 //
-// -> --
+// -> target: color buffer, e. g. the fade target or this->currentValues
+//    source: buffer with color indexes
+//	  palette: colors for indexed source buffer
 // <- --
 //---------------------------------------------------------------------------------------
-void LEDFunctionsClass::show()
+void LEDFunctionsClass::setBuffer(uint8_t *target, const uint8_t *source,
+		const palette_entry palette[])
 {
-	uint8_t *data = this->currentValues;
-	int ofs = 0;
+	uint32_t led, mapping, curveOffset;
+	palette_entry color;
 
-	// copy current color values to LED object and display it
 	for (int i = 0; i < NUM_PIXELS; i++)
 	{
-		this->pixels->setPixelColor(i,
-				pixels->Color(((int) data[ofs + 0] * this->brightness) >> 8,
-						      ((int) data[ofs + 1] * this->brightness) >> 8,
-						      ((int) data[ofs + 2] * this->brightness) >> 8));
-		ofs += 3;
-	}
-	this->pixels->show();
-}
-
-//---------------------------------------------------------------------------------------
-// getOffset
-//
-// Calculates the offset of a given RGB triplet inside the LED buffer.
-// Does range checking for x and y, uses the internal mapping table.
-//
-// -> x: x coordinate
-//    y: y coordinate
-// <- offset for given coordinates
-//---------------------------------------------------------------------------------------
-int LEDFunctionsClass::getOffset(int x, int y)
-{
-	if (x>=0 && y>=0 && x<LEDFunctionsClass::width && y<LEDFunctionsClass::height)
-	{
-		return LEDFunctionsClass::mapping[x + y*LEDFunctionsClass::width] * 3;
-	}
-	else
-	{
-		return 0;
+		color = flashReadPalette(palette, flashRead8(source, i));
+		led = flashRead8(LEDFunctionsClass::mapping, i);
+		mapping = led * 3;
+		curveOffset = (Config.ledProfile[led] & (NUM_CALIBRATION_PROFILES - 1)) << 8;
+
+		// select color value using palette and per LED correction tables
+		target[mapping + 0] = this->correctionR[curveOffset + color.r];
+		target[mapping + 1] = this->correctionG[curveOffset + color.g];
+		target[mapping + 2] = this->correctionB[curveOffset + color.b];
 	}
 }
 
 //---------------------------------------------------------------------------------------
-// fillBackground
+// setPixel
 //
-// Initializes the buffer with either background (=0) or seconds progress (=2),
-// part of the background will be illuminated with color 2 depending on current
-// seconds/milliseconds value, whole screen is backlit when seconds = 59
+// Sets a single pixel of the internal LED buffer, corrected with the calibration profile
+// of its LED. Used for pixel data received from outside, e. g. by UdpStreamClass.
 //
-// -> seconds, milliseconds: Time value which the fill process will base on
-//    buf: destination buffer
+// -> index: pixel index in display order [0...NUM_PIXELS-1]
+//    r, g, b: color
 // <- --
 //---------------------------------------------------------------------------------------
-void LEDFunctionsClass::fillBackground(int seconds, int milliseconds, uint8_t *buf)
+void LEDFunctionsClass::setPixel(int index, uint8_t r, uint8_t g, uint8_t b)
 {
-	int pos = (((seconds * 1000 + milliseconds) * 110) / 60000) + 1;
-	for (int i = 0; i < NUM_PIXELS; i++) buf[i] = (i < pos) ? 2 : 0;
-}
-
-#endif
+	uint32_t led = flashRead8(LEDFunctionsClass::mapping, index);
+	uint32_t curveOffset = (Config.ledProfile[led] & (NUM_CALIBRATION_PROFILES - 1)) << 8;
+	uint8_t *target = &this->currentValues[led * 3];
 
-//---------------------------------------------------------------------------------------
-#if 1 // rendering methods
-//---------------------------------------------------------------------------------------
+	target[0] = this->correctionR[curveOffset + r];
+	target[1] = this->correctionG[curveOffset + g];
+	target[2] = this->correctionB[curveOffset + b];
+}
 
 //---------------------------------------------------------------------------------------
-// renderTime
+// setTimeColors
 //
-// Loads internal buffers with the current time representation
+// Sets the internal LED buffer or the fade target from an indexed source buffer using
+// the time colors, already corrected for each calibration profile
 //
-// -> target: If NULL, a local buffer is used and time is actually being displayed
-//            if not null, time is not being displayed, but the given buffer is being
-//            filled with palette indexes representing the time
+// -> buf: indexed source buffer (0 = background, 1 = foreground, 2 = seconds)
+//    immediately: if true, display buffer immediately; fade to new colors if false
 // <- --
 //---------------------------------------------------------------------------------------
-void LEDFunctionsClass::renderTime(uint8_t *target, int h, int m, int s, int ms)
+void LEDFunctionsClass::setTimeColors(const uint8_t *buf, bool immediately)
 {
-	this->fillBackground(s, ms, target);
-
-	// set static LEDs
-	target[0] = 1; // E
-	target[1] = 1; // S
+	uint8_t *target = immediately ? this->currentValues : Scratch.mode<rgb_buffer_t>()->data;
+	uint32_t led, mapping, index;
+	const uint8_t *color;
 
-	target[3] = 1; // I
-	target[4] = 1; // S
-	target[5] = 1; // T
-
-	// minutes 1...4 for the corners
-	for(int i=0; i<=((m%5)-1); i++) target[10 * 11 + i] = 1;
-
-	// iterate over minutes_template
-	int adjust_hour = 0;
-	for(leds_template_t t : LEDFunctionsClass::minutesTemplate)
-	{
-		// test if this template matches the current minute
-		if(m >= t.param1 && m <= t.param2)
-		{
-			// set all LEDs defined in this template
-			for(int i : t.LEDs) target[i] = 1;
-			adjust_hour = t.param0;
-			break;
-		}
-	}
-
-	// adjust hour display if necessary (e. g. 09:45 = quarter to *TEN* instead of NINE)
-	h += adjust_hour;
-	if(h > 23)	h -= 24;
-
-	// iterate over hours template
-	for(leds_template_t t : LEDFunctionsClass::hoursTemplate)
+	for (int i = 0; i < NUM_PIXELS; i++)
 	{
-		// test if this template matches the current hour
-		if((t.param1 == h || t.param2 == h) &&
-		   ((t.param0 == 1 && m < 5)  || // special case full hour
-			(t.param0 == 2 && m >= 5) || // special case hour + minutes
-			(t.param0 == 0)))            // normal case
-		{
-			// set all LEDs defined in this template
-			for(int i : t.LEDs) target[i] = 1;
-			break;
-		}
-	}
-
-	// DEBUG
-	static int last_minutes = -1;
-	if(last_minutes != this->m)
-	{
-		last_minutes = this->m;
-		Serial.printf("h=%i, m=%i, s=%i\r\n", this->h, this->m, this->s);
-		for(int y=0; y<10; y++)
-		{
-			for(int x=0; x<11; x++)
-			{
-				Serial.print(target[y*11+x]);
-				Serial.print(' ');
-			}
-			Serial.println(' ');
-		}
+		led = flashRead8(LEDFunctionsClass::mapping, i);
+		mapping = led * 3;
+		index = flashRead8(buf, i);
+		if (index > 2) index = 2;
+		color = &this->fusedTimeColors[Config.ledProfile[led] &
+				(NUM_CALIBRATION_PROFILES - 1)][index * 3];
+		target[mapping + 0] = color[0];
+		target[mapping + 1] = color[1];
+		target[mapping + 2] = color[2];
 	}
 }
 
 //---------------------------------------------------------------------------------------
-// renderHourglass
+// previewColor
 //
-// Immediately displays an animation step of the hourglass animation.
-// ATTENTION: Animation frames must start at 32 bit boundary each!
+// Shows a time color without changing Config. Several calls between two frames only
+// keep the newest color of each index, it is taken over by the next call to process().
 //
-// -> animationStep: Number of current frame [0...HOURGLASS_ANIMATION_FRAMES]
-//    green: Flag to switch the palette color 3 to green instead of yellow (used in the
-//           second half of the hourglass animation to indicate the short wait-for-OTA
-//           window)
+// -> index: 0 = background, 1 = foreground, 2 = seconds
+//    color: new color
 // <- --
 //---------------------------------------------------------------------------------------
-void LEDFunctionsClass::renderHourglass(uint8_t animationStep, bool green)
+void LEDFunctionsClass::previewColor(int index, palette_entry color)
 {
-	// colors in palette: black, white, yellow
-	palette_entry p[] = {{0, 0, 0}, {255, 255, 255}, {255, 255, 0}, {255, 255, 0}};
-
-	// delete red component in palette entry 3 to make this color green
-	if(green) p[3].r = 0;
-
-	if (animationStep >= HOURGLASS_ANIMATION_FRAMES) animationStep = 0;
-	this->set(hourglass_animation[animationStep], p, true);
+	if (index < 0 || index > 2) return;
+	this->previewColors[index] = color;
+	this->previewPending |= 1 << index;
+	this->previewActive = true;
+	this->lastPreview = millis();
 }
 
 //---------------------------------------------------------------------------------------
-// renderMatrix
+// endPreview
 //
-// Renders one frame of the matrix animation and displays it immediately
+// Returns to the time colors from Config with the next frame
 //
 // -> --
 // <- --
 //---------------------------------------------------------------------------------------
-void LEDFunctionsClass::renderMatrix()
+void LEDFunctionsClass::endPreview()
 {
-	// clear buffer
-	memset(this->currentValues, 0, sizeof(this->currentValues));
-
-	// sort by y coordinate for correct overlapping
-	std::sort(matrix.begin(), matrix.end());
-
-	// iterate over all matrix objects, move and render them
-	for (MatrixObject &m : this->matrix) m.render(this->currentValues);
-}
-
-const palette_entry LEDFunctionsClass::firePalette[256] = {
-	{0, 0, 0}, {4, 0, 0}, {8, 0, 0}, {12, 0, 0}, {16, 0, 0}, {20, 0, 0}, {24, 0, 0}, {28, 0, 0},
-	{32, 0, 0}, {36, 0, 0}, {40, 0, 0}, {44, 0, 0}, {48, 0, 0}, {52, 0, 0}, {56, 0, 0}, {60, 0, 0},
-	{64, 0, 0}, {68, 0, 0}, {72, 0, 0}, {76, 0, 0}, {80, 0, 0}, {85, 0, 0}, {89, 0, 0}, {93, 0, 0},
-	{97, 0, 0}, {101, 0, 0}, {105, 0, 0}, {109, 0, 0}, {113, 0, 0}, {117, 0, 0}, {121, 0, 0}, {125, 0, 0},
-	{129, 0, 0}, {133, 0, 0}, {137, 0, 0}, {141, 0, 0}, {145, 0, 0}, {149, 0, 0}, {153, 0, 0}, {157, 0, 0},
-	{161, 0, 0}, {165, 0, 0}, {170, 0, 0}, {174, 0, 0}, {178, 0, 0}, {182, 0, 0}, {186, 0, 0}, {190, 0, 0},
-	{194, 0, 0}, {198, 0, 0}, {202, 0, 0}, {206, 0, 0}, {210, 0, 0}, {214, 0, 0}, {218, 0, 0}, {222, 0, 0},
-	{226, 0, 0}, {230, 0, 0}, {234, 0, 0}, {238, 0, 0}, {242, 0, 0}, {246, 0, 0}, {250, 0, 0}, {255, 0, 0},
-	{255, 0, 0}, {255, 8, 0}, {255, 16, 0}, {255, 24, 0}, {255, 32, 0}, {255, 41, 0}, {255, 49, 0}, {255, 57, 0},
-	{255, 65, 0}, {255, 74, 0}, {255, 82, 0}, {255, 90, 0}, {255, 98, 0}, {255, 106, 0}, {255, 115, 0}, {255, 123, 0},
-	{255, 131, 0}, {255, 139, 0}, {255, 148, 0}, {255, 156, 0}, {255, 164, 0}, {255, 172, 0}, {255, 180, 0}, {255, 189, 0},
-	{255, 197, 0}, {255, 205, 0}, {255, 213, 0}, {255, 222, 0}, {255, 230, 0}, {255, 238, 0}, {255, 246, 0}, {255, 255, 0},
-	{255, 255, 0}, {255, 255, 1}, {255, 255, 3}, {255, 255, 4}, {255, 255, 6}, {255, 255, 8}, {255, 255, 9}, {255, 255, 11},
-	{255, 255, 12}, {255, 255, 14}, {255, 255, 16}, {255, 255, 17}, {255, 255, 19}, {255, 255, 20}, {255, 255, 22}, {255, 255, 24},
-	{255, 255, 25}, {255, 255, 27}, {255, 255, 28}, {255, 255, 30}, {255, 255, 32}, {255, 255, 33}, {255, 255, 35}, {255, 255, 36},
-	{255, 255, 38}, {255, 255, 40}, {255, 255, 41}, {255, 255, 43}, {255, 255, 44}, {255, 255, 46}, {255, 255, 48}, {255, 255, 49},
-	{255, 255, 51}, {255, 255, 52}, {255, 255, 54}, {255, 255, 56}, {255, 255, 57}, {255, 255, 59}, {255, 255, 60}, {255, 255, 62},
-	{255, 255, 64}, {255, 255, 65}, {255, 255, 67}, {255, 255, 68}, {255, 255, 70}, {255, 255, 72}, {255, 255, 73}, {255, 255, 75},
-	{255, 255, 76}, {255, 255, 78}, {255, 255, 80}, {255, 255, 81}, {255, 255, 83}, {255, 255, 85}, {255, 255, 86}, {255, 255, 88},
-	{255, 255, 89}, {255, 255, 91}, {255, 255, 93}, {255, 255, 94}, {255, 255, 96}, {255, 255, 97}, {255, 255, 99}, {255, 255, 101},
-	{255, 255, 102}, {255, 255, 104}, {255, 255, 105}, {255, 255, 107}, {255, 255, 109}, {255, 255, 110}, {255, 255, 112}, {255, 255, 113},
-	{255, 255, 115}, {255, 255, 117}, {255, 255, 118}, {255, 255, 120}, {255, 255, 121}, {255, 255, 123}, {255, 255, 125}, {255, 255, 126},
-	{255, 255, 128}, {255, 255, 129}, {255, 255, 131}, {255, 255, 133}, {255, 255, 134}, {255, 255, 136}, {255, 255, 137}, {255, 255, 139},
-	{255, 255, 141}, {255, 255, 142}, {255, 255, 144}, {255, 255, 145}, {255, 255, 147}, {255, 255, 149}, {255, 255, 150}, {255, 255, 152},
-	{255, 255, 153}, {255, 255, 155}, {255, 255, 157}, {255, 255, 158}, {255, 255, 160}, {255, 255, 161}, {255, 255, 163}, {255, 255, 165},
-	{255, 255, 166}, {255, 255, 168}, {255, 255, 170}, {255, 255, 171}, {255, 255, 173}, {255, 255, 174}, {255, 255, 176}, {255, 255, 178},
-	{255, 255, 179}, {255, 255, 181}, {255, 255, 182}, {255, 255, 184}, {255, 255, 186}, {255, 255, 187}, {255, 255, 189}, {255, 255, 190},
-	{255, 255, 192}, {255, 255, 194}, {255, 255, 195}, {255, 255, 197}, {255, 255, 198}, {255, 255, 200}, {255, 255, 202}, {255, 255, 203},
-	{255, 255, 205}, {255, 255, 206}, {255, 255, 208}, {255, 255, 210}, {255, 255, 211}, {255, 255, 213}, {255, 255, 214}, {255, 255, 216},
-	{255, 255, 218}, {255, 255, 219}, {255, 255, 221}, {255, 255, 222}, {255, 255, 224}, {255, 255, 226}, {255, 255, 227}, {255, 255, 229},
-	{255, 255, 230}, {255, 255, 232}, {255, 255, 234}, {255, 255, 235}, {255, 255, 237}, {255, 255, 238}, {255, 255, 240}, {255, 255, 242},
-	{255, 255, 243}, {255, 255, 245}, {255, 255, 246}, {255, 255, 248}, {255, 255, 250}, {255, 255, 251}, {255, 255, 253}, {255, 255, 255}
-};
-const palette_entry LEDFunctionsClass::plasmaPalette[256] = {
-	{255, 0, 0}, {255, 6, 0}, {255, 12, 0}, {255, 18, 0}, {255, 24, 0}, {255, 30, 0}, {255, 36, 0}, {255, 42, 0},
-	{255, 48, 0}, {255, 54, 0}, {255, 60, 0}, {255, 66, 0}, {255, 72, 0}, {255, 78, 0}, {255, 84, 0}, {255, 90, 0},
-	{255, 96, 0}, {255, 102, 0}, {255, 108, 0}, {255, 114, 0}, {255, 120, 0}, {255, 126, 0}, {255, 131, 0}, {255, 137, 0},
-	{255, 143, 0}, {255, 149, 0}, {255, 155, 0}, {255, 161, 0}, {255, 167, 0}, {255, 173, 0}, {255, 179, 0}, {255, 185, 0},
-	{255, 191, 0}, {255, 197, 0}, {255, 203, 0}, {255, 209, 0}, {255, 215, 0}, {255, 221, 0}, {255, 227, 0}, {255, 233, 0},
-	{255, 239, 0}, {255, 245, 0}, {255, 251, 0}, {253, 255, 0}, {247, 255, 0}, {241, 255, 0}, {235, 255, 0}, {229, 255, 0},
-	{223, 255, 0}, {217, 255, 0}, {211, 255, 0}, {205, 255, 0}, {199, 255, 0}, {193, 255, 0}, {187, 255, 0}, {181, 255, 0},
-	{175, 255, 0}, {169, 255, 0}, {163, 255, 0}, {157, 255, 0}, {151, 255, 0}, {145, 255, 0}, {139, 255, 0}, {133, 255, 0},
-	{128, 255, 0}, {122, 255, 0}, {116, 255, 0}, {110, 255, 0}, {104, 255, 0}, {98, 255, 0}, {92, 255, 0}, {86, 255, 0},
-	{80, 255, 0}, {74, 255, 0}, {68, 255, 0}, {62, 255, 0}, {56, 255, 0}, {50, 255, 0}, {44, 255, 0}, {38, 255, 0},
-	{32, 255, 0}, {26, 255, 0}, {20, 255, 0}, {14, 255, 0}, {8, 255, 0}, {2, 255, 0}, {0, 255, 4}, {0, 255, 10},
-	{0, 255, 16}, {0, 255, 22}, {0, 255, 28}, {0, 255, 34}, {0, 255, 40}, {0, 255, 46}, {0, 255, 52}, {0, 255, 58},
-	{0, 255, 64}, {0, 255, 70}, {0, 255, 76}, {0, 255, 82}, {0, 255, 88}, {0, 255, 94}, {0, 255, 100}, {0, 255, 106},
-	{0, 255, 112}, {0, 255, 118}, {0, 255, 124}, {0, 255, 129}, {0, 255, 135}, {0, 255, 141}, {0, 255, 147}, {0, 255, 153},
-	{0, 255, 159}, {0, 255, 165}, {0, 255, 171}, {0, 255, 177}, {0, 255, 183}, {0, 255, 189}, {0, 255, 195}, {0, 255, 201},
-	{0, 255, 207}, {0, 255, 213}, {0, 255, 219}, {0, 255, 225}, {0, 255, 231}, {0, 255, 237}, {0, 255, 243}, {0, 255, 249},
-	{0, 255, 255}, {0, 249, 255}, {0, 243, 255}, {0, 237, 255}, {0, 231, 255}, {0, 225, 255}, {0, 219, 255}, {0, 213, 255},
-	{0, 207, 255}, {0, 201, 255}, {0, 195, 255}, {0, 189, 255}, {0, 183, 255}, {0, 177, 255}, {0, 171, 255}, {0, 165, 255},
-	{0, 159, 255}, {0, 153, 255}, {0, 147, 255}, {0, 141, 255}, {0, 135, 255}, {0, 129, 255}, {0, 124, 255}, {0, 118, 255},
-	{0, 112, 255}, {0, 106, 255}, {0, 100, 255}, {0, 94, 255}, {0, 88, 255}, {0, 82, 255}, {0, 76, 255}, {0, 70, 255},
-	{0, 64, 255}, {0, 58, 255}, {0, 52, 255}, {0, 46, 255}, {0, 40, 255}, {0, 34, 255}, {0, 28, 255}, {0, 22, 255},
-	{0, 16, 255}, {0, 10, 255}, {0, 4, 255}, {2, 0, 255}, {8, 0, 255}, {14, 0, 255}, {20, 0, 255}, {26, 0, 255},
-	{32, 0, 255}, {38, 0, 255}, {44, 0, 255}, {50, 0, 255}, {56, 0, 255}, {62, 0, 255}, {68, 0, 255}, {74, 0, 255},
-	{80, 0, 255}, {86, 0, 255}, {92, 0, 255}, {98, 0, 255}, {104, 0, 255}, {110, 0, 255}, {116, 0, 255}, {122, 0, 255},
-	{128, 0, 255}, {133, 0, 255}, {139, 0, 255}, {145, 0, 255}, {151, 0, 255}, {157, 0, 255}, {163, 0, 255}, {169, 0, 255},
-	{175, 0, 255}, {181, 0, 255}, {187, 0, 255}, {193, 0, 255}, {199, 0, 255}, {205, 0, 255}, {211, 0, 255}, {217, 0, 255},
-	{223, 0, 255}, {229, 0, 255}, {235, 0, 255}, {241, 0, 255}, {247, 0, 255}, {253, 0, 255}, {255, 0, 251}, {255, 0, 245},
-	{255, 0, 239}, {255, 0, 233}, {255, 0, 227}, {255, 0, 221}, {255, 0, 215}, {255, 0, 209}, {255, 0, 203}, {255, 0, 197},
-	{255, 0, 191}, {255, 0, 185}, {255, 0, 179}, {255, 0, 173}, {255, 0, 167}, {255, 0, 161}, {255, 0, 155}, {255, 0, 149},
-	{255, 0, 143}, {255, 0, 137}, {255, 0, 131}, {255, 0, 126}, {255, 0, 120}, {255, 0, 114}, {255, 0, 108}, {255, 0, 102},
-	{255, 0, 96}, {255, 0, 90}, {255, 0, 84}, {255, 0, 78}, {255, 0, 72}, {255, 0, 66}, {255, 0, 60}, {255, 0, 54},
-	{255, 0, 48}, {255, 0, 42}, {255, 0, 36}, {255, 0, 30}, {255, 0, 24}, {255, 0, 18}, {255, 0, 12}, {255, 0, 6}
-};
-
-
-double _time = 0;
-void LEDFunctionsClass::renderPlasma()
-{
-    int color;
-    double cx, cy, xx, yy;
-
-    _time += 0.05;
-
-    for (int y=0; y<LEDFunctionsClass::height; y++)
-    {
-        yy = (double)y / (double)LEDFunctionsClass::height / 3.0;
-        for (int x=0; x<LEDFunctionsClass::width; x++)
-        {
-            xx = (double)x / (double)LEDFunctionsClass::width / 3.0;
-            cx = xx + 0.5 * sin(_time / 5.0);
-            cy = (double)y/(double)LEDFunctionsClass::height / 3.0 + 0.5 * sin(_time / 3.0);
-            color = (
-            	sin(
-                    sqrt(100 * (cx*cx + cy*cy) + 1 + _time) +
-                    6.0 * (xx * sin(_time/2) + yy * cos(_time/3) + _time / 4.0)
-                ) + 1.0
-			) * 128.0;
-            plasmaBuf[x + y * LEDFunctionsClass::width] = color;
-        }
-    }
-    this->set(plasmaBuf, (palette_entry*)plasmaPalette, true);
-}
-
-void LEDFunctionsClass::renderFire()
-{
-    int f;
-
-    // iterate over bottom row, create fire seed
-    for (int i = 0; i < LEDFunctionsClass::width; i++)
-    {
-        // only set hot spot with probability of 1/4
-        f = (random(4) == 0) ? random(256) : 0;
-
-        // update one pixel in bottom row
-        fireBuf[i + (LEDFunctionsClass::height - 1) * LEDFunctionsClass::width] = f;
-    }
-
-    int y1, y2, l, r;
-    for (int y = 0; y < LEDFunctionsClass::height - 1; y++)
-    {
-        y1 = y + 1; if (y1 >= LEDFunctionsClass::height) y1 = LEDFunctionsClass::height - 1;
-        y2 = y + 2; if (y2 >= LEDFunctionsClass::height) y2 = LEDFunctionsClass::height - 1;
-        for (int x = 0; x < LEDFunctionsClass::width; x++)
-        {
-            l = x - 1; if (l < 0) l = 0;
-            r = x + 1; if (r >= LEDFunctionsClass::width) r = LEDFunctionsClass::width - 1;
-            fireBuf[x + y * LEDFunctionsClass::width] =
-                ((fireBuf[y1 * LEDFunctionsClass::width + l]
-                + fireBuf[y1 * LEDFunctionsClass::width + x]
-                + fireBuf[y1 * LEDFunctionsClass::width + r]
-                + fireBuf[y2 * LEDFunctionsClass::width + x])
-                * 32) / 129;
-        }
-    }
-    this->set(fireBuf, (palette_entry*)firePalette, true);
-	delay(100);
+	this->previewActive = false;
+	this->previewPending = 0;
 }
 
 //---------------------------------------------------------------------------------------
-// renderStars
-//
-// Renders one frame of the stars animation and displays it immediately
+// isPreviewing
 //
 // -> --
-// <- --
+// <- true if preview colors are shown instead of the colors from Config
 //---------------------------------------------------------------------------------------
-void LEDFunctionsClass::renderStars()
+bool LEDFunctionsClass::isPreviewing()
 {
-	// clear buffer
-	memset(this->currentValues, 0, sizeof(this->currentValues));
-
-	for(StarObject &s : this->stars) s.render(this->currentValues, this->stars);
+	return this->previewActive;
 }
 
 //---------------------------------------------------------------------------------------
-// renderHeart
+// updateTimeColors
 //
-// Renders one frame of the heart animation and displays it immediately
+// Takes over the time colors from Config or the pending preview colors and rebuilds
+// the corrected colors if anything changed. Called once per frame.
 //
 // -> --
 // <- --
 //---------------------------------------------------------------------------------------
-void LEDFunctionsClass::renderHeart()
+void LEDFunctionsClass::updateTimeColors()
 {
-	palette_entry palette[2];
-	uint8_t heart[] = {
-		0, 1, 1, 1, 0, 0, 0, 1, 1, 1, 0,
-		1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0,
-		0, 0, 1, 1, 1, 1, 1, 1, 1, 0, 0,
-		0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0,
-		0, 0, 0, 0, 1, 1, 1, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		1, 1, 1, 1
-	};
-	palette[0] = {0, 0, 0};
-	palette[1] = {(uint8_t)this->heartBrightness, 0, 0};
-	this->set(heart, palette, true);
-
-	switch (this->heartState)
-	{
-	case 0:
-		if (this->heartBrightness >= 255) this->heartState = 1;
-		else this->heartBrightness += 32;
-		break;
+	if (this->previewActive && millis() - this->lastPreview > LIVE_PREVIEW_TIMEOUT)
+		this->endPreview();
 
-	case 1:
-		if (this->heartBrightness < 128) this->heartState = 2;
-		else this->heartBrightness -= 32;
-		break;
-
-	case 2:
-		if (this->heartBrightness >= 255) this->heartState = 3;
-		else this->heartBrightness += 32;
-		break;
-
-	case 3:
-	default:
-		if (this->heartBrightness <= 0) this->heartState = 0;
-		else this->heartBrightness -= 4;
-		break;
+	if (this->previewActive)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			if (this->previewPending & (1 << i)) this->timeColors[i] = this->previewColors[i];
+		}
+		this->previewPending = 0;
+	}
+	else
+	{
+		this->timeColors[0] = Config.bg;
+		this->timeColors[1] = Config.fg;
+		this->timeColors[2] = Config.s;
 	}
 
-	if (this->heartBrightness > 255) this->heartBrightness = 255;
-	if (this->heartBrightness < 0) this->heartBrightness = 0;
-}
-
-//---------------------------------------------------------------------------------------
-// prepareExplosion
-//
-// Prepare particles based on current screen state
-//
-//
-// -> source: buffer to read the currently active LEDs from
-// <- --
-//---------------------------------------------------------------------------------------
-void LEDFunctionsClass::prepareExplosion(uint8_t *source)
-{
-#define PARTICLE_COUNT 16
-#define PARTICLE_SPEED 0.15f
-
-	float vx, vy, angle;
-	int ofs = 0;
-	Particle *p;
-	int delay;
-
-	// compute angle increment
-	float angle_increment = 2.0f * 3.141592654f / (float)(PARTICLE_COUNT);
+	if (this->fusedVersion == Config.paletteVersion &&
+			memcmp(this->fusedSource, this->timeColors, sizeof(this->fusedSource)) == 0)
+		return;
 
-	// iterate over every position in the screen buffer
-	for(int y=0; y<LEDFunctionsClass::height; y++)
+	for (int p = 0; p < NUM_CALIBRATION_PROFILES; p++)
 	{
-		for(int x=0; x<LEDFunctionsClass::width; x++)
+		uint32_t curveOffset = p << 8;
+		for (int i = 0; i < 3; i++)
 		{
-			// create entry in particles vector if current pixel is foreground
-			if(source[ofs++] == 1)
-			{
-				// add a random delay of zero to approx. 3 seconds to each
-				// explosion
-				delay = random(300);
-
-				// start with angle of zero radians, assign velocity vector
-				// placed on a circle to each particle
-				angle = 0;
-				for(int i=0; i<PARTICLE_COUNT; i++)
-				{
-					// calculate particle speed vector based on angle and
-					// absolute speed value
-					vx = PARTICLE_SPEED * sin(angle);
-					vy = PARTICLE_SPEED * cos(angle);
-
-					// create new particle and add it to particles list
-					p = new Particle(x, y, vx, vy, delay);
-					this->particles.push_back(p);
-					angle += angle_increment;
-				}
-			}
+			const palette_entry &color = this->timeColors[i];
+			uint8_t *fused = &this->fusedTimeColors[p][i * 3];
+			fused[0] = this->correctionR[curveOffset + color.r];
+			fused[1] = this->correctionG[curveOffset + color.g];
+			fused[2] = this->correctionB[curveOffset + color.b];
 		}
 	}
+	memcpy(this->fusedSource, this->timeColors, sizeof(this->fusedSource));
+	this->fusedVersion = Config.paletteVersion;
 }
 
 //---------------------------------------------------------------------------------------
-// renderExplosion
+// fade
 //
-// Renders the exploding letters animation
+// Fade one step of the color values from this->currentValues[i] to the fade target
+// set by set(..., false). Uses non-linear fade speed depending on distance to target
+// value.
 //
 // -> --
 // <- --
 //---------------------------------------------------------------------------------------
-void LEDFunctionsClass::renderExplosion()
+void LEDFunctionsClass::fade()
 {
-	std::vector<Particle*> particlesToKeep;
-	uint8_t buf[NUM_PIXELS];
-
-	// load palette colors from configuration
-	palette_entry palette[] = {
-		{Config.bg.r, Config.bg.g, Config.bg.b},
-		{Config.fg.r, Config.fg.g, Config.fg.b},
-		{Config.s.r,  Config.s.g,  Config.s.b}};
-
-	// check if the displayed time has changed
-	if((this->m/5 != this->lastM/5) || (this->h != this->lastH))
-	{
-		// prepare new animation with old time
-		this->renderTime(buf, this->lastH, this->lastM, 0, 0);
-		this->prepareExplosion(buf);
-	}
-
-	this->lastM = this->m;
-	this->lastH = this->h;
-
-	// create empty buffer filled with seconds color
-	this->fillBackground(this->s, this->ms, buf);
-
-	// minutes 1...4 for the corners
-	for(int i=0; i<=((this->m%5)-1); i++) buf[10 * 11 + i] = 1;
-
-	// Do we have something to explode?
-	if(this->particles.size() > 0)
-	{
-		// transfer background created by fillBackground to target buffer
-		this->set(buf, palette, true);
-
-		// iterate over all particles
-		for(Particle *p : this->particles)
-		{
-			// move and render current particle
-			p->render(this->currentValues, palette);
-
-			// if particle is still active, keep it; kill it otherwise
-			if(p->alive) particlesToKeep.push_back(p); else delete p;
-		}
+	static int prescaler = 0;
+	if(++prescaler<2) return;
+	prescaler = 0;
 
-		// only keep active particles, discard the rest
-		// -> use particlesToKeep as new list
-		this->particles.swap(particlesToKeep);
-	}
-	else
+	uint8_t *targetValues = Scratch.mode<rgb_buffer_t>()->data;
+	int delta;
+	for (int i = 0; i < NUM_PIXELS * 3; i++)
 	{
-		// present the current time in boring mode with simple fading
-		this->renderTime(buf, this->h, this->m, this->s, this->ms);
-		this->set(buf, palette, false);
-		this->fade();
+		delta = targetValues[i] - this->currentValues[i];
+		if (delta > 64) this->currentValues[i] += 8;
+		else if (delta > 16) this->currentValues[i] += 4;
+		else if (delta > 0) this->currentValues[i]++;
+		else if (delta < -64) this->currentValues[i] -= 8;
+		else if (delta < -16) this->currentValues[i] -= 4;
+		else if (delta < 0) this->currentValues[i]--;
 	}
 }
 
 //---------------------------------------------------------------------------------------
-// prepareFlyingLetters
+// show
 //
-// Sets the current buffer as target state for flying letters, initializes current
-// positions of the letters below the visible area with some random jitter
+// Internal method, copies this->currentValues to WS2812 object while applying brightness
+// and the power limit. The channel sums for the current estimation are updated from the
+// pixels which changed since the last frame, and only those are passed to the WS2812
+// object unless the applied brightness changed as well.
 //
-// -> source: buffer to read the currently active LEDs from
+// -> --
 // <- --
 //---------------------------------------------------------------------------------------
-void LEDFunctionsClass::prepareFlyingLetters(uint8_t *source)
+void LEDFunctionsClass::show()
 {
-	// transfer the previous flying letters in the leaving letters vector to prepare for
-	// outgoing animation
-	this->leavingLetters.clear();
-	for(xy_t &p : this->arrivingLetters)
-	{
-		// delay every letter depending on its position
-		// and set new target coordinate
-		if(this->mode == DisplayMode::flyingLettersVerticalUp)
-		{
-			p.delay = p.y * 2 + p.x + 1 + random(5);
-			p.yTarget = -1;
-		}
-		else
-		{
-			p.delay = (LEDFunctionsClass::height - p.y - 1) * 2 + p.x + 1 + random(5);
-			p.yTarget = LEDFunctionsClass::height;
-		}
-		this->leavingLetters.push_back(p);
-	}
-
-	// initialize arriving letters from scratch
-	this->arrivingLetters.clear();
+	uint8_t *data = this->currentValues;
+	uint8_t *shown = this->shownValues;
+	uint32_t dirty[(NUM_PIXELS + 31) / 32] = {0};
 	int ofs = 0;
 
-	// iterate over every position in the screen buffer
-	for(int y=0; y<LEDFunctionsClass::height; y++)
+	// update channel sums from changed pixels
+	for (int i = 0; i < NUM_PIXELS; i++)
 	{
-		for(int x=0; x<LEDFunctionsClass::width; x++)
+		if (data[ofs + 0] != shown[ofs + 0] || data[ofs + 1] != shown[ofs + 1] ||
+				data[ofs + 2] != shown[ofs + 2])
 		{
-			// create entry in arrivingLetters vector if current pixel is foreground
-			if(source[ofs++] == 1)
+			for (int c = 0; c < 3; c++)
 			{
-				if(this->mode == DisplayMode::flyingLettersVerticalUp)
-				{
-					xy_t p = {x, y, x, LEDFunctionsClass::height,
-							y * 2 + x + 1 + random(5), 200, 0};
-					this->arrivingLetters.push_back(p);
-				}
-				else
-				{
-					xy_t p = {x, y, x, -1,
-							(LEDFunctionsClass::height - y - 1) * 2 + x + 1 + random(5),
-							200, 0};
-					this->arrivingLetters.push_back(p);
-				}
+				this->channelSum[c] += data[ofs + c] - shown[ofs + c];
+				shown[ofs + c] = data[ofs + c];
 			}
+			dirty[i >> 5] |= 1 << (i & 31);
 		}
+		ofs += 3;
 	}
 
-	// DEBUG
-	Serial.printf("h=%i, m=%i, s=%i, lastH=%i, lastM=%i\r\n", this->h, this->m, this->s, this->lastH, this->lastM);
-	Serial.println("leavingLetters:");
-	for(xy_t &p : this->leavingLetters)
-	{
-		Serial.printf("  counter=%i, delay=%i, speed=%i, x=%i, y=%i, xTarget=%i, yTarget=%i\r\n",
-				p.counter, p.delay, p.speed, p.x, p.y, p.xTarget, p.yTarget);
-	}
-	Serial.println("arrivingLetters:");
-	for(xy_t &p : this->arrivingLetters)
+	this->updatePowerLimit();
+	int brightness = (this->brightness * this->powerLimit) >> 8;
+	bool all = (brightness != this->shownBrightness);
+	this->shownBrightness = brightness;
+
+	// copy changed color values to LED object and display it
+	ofs = 0;
+	for (int i = 0; i < NUM_PIXELS; i++)
 	{
-		Serial.printf("  counter=%i, delay=%i, speed=%i, x=%i, y=%i, xTarget=%i, yTarget=%i\r\n",
-				p.counter, p.delay, p.speed, p.x, p.y, p.xTarget, p.yTarget);
+		if (all || (dirty[i >> 5] & (1 << (i & 31))))
+		{
+			this->pixels->setPixelColor(i,
+					pixels->Color(((int) data[ofs + 0] * brightness) >> 8,
+							      ((int) data[ofs + 1] * brightness) >> 8,
+							      ((int) data[ofs + 2] * brightness) >> 8));
+		}
+		ofs += 3;
 	}
+	this->pixels->show();
 }
 
 //---------------------------------------------------------------------------------------
-// renderFlyingLetters
+// updatePowerLimit
 //
-// Takes the current arrivingLetters and leavingLetters to render the flying letters
-// animation
+// Estimates the supply current from the channel sums and calculates the power limit
+// factor which keeps it below Config.powerBudget. The limit drops immediately and
+// recovers by POWER_LIMIT_RELEASE per frame to avoid visible pumping.
 //
 // -> --
 // <- --
 //---------------------------------------------------------------------------------------
-void LEDFunctionsClass::renderFlyingLetters()
+void LEDFunctionsClass::updatePowerLimit()
 {
-	uint8_t buf[NUM_PIXELS];
+	int idle = NUM_PIXELS * LED_IDLE_CURRENT;
 
-	// load palette colors from configuration
-	palette_entry palette[] = {
-		{Config.bg.r, Config.bg.g, Config.bg.b},
-		{Config.fg.r, Config.fg.g, Config.fg.b},
-		{Config.s.r,  Config.s.g,  Config.s.b}};
+	// current of all channels at full brightness, then at the current brightness
+	uint32_t full = (this->channelSum[0] * Config.channelCurrent[0] +
+			this->channelSum[1] * Config.channelCurrent[1] +
+			this->channelSum[2] * Config.channelCurrent[2]) / 255;
+	int variable = (full * this->brightness) >> 8;
+	this->demand = idle + variable;
 
-	// check if the displayed time has changed
-	if((this->m/5 != this->lastM/5) || (this->h != this->lastH))
+	int target = 256;
+	if (Config.powerBudget > 0 && this->demand > Config.powerBudget)
 	{
-		// prepare new animation
-		this->renderTime(buf, this->h, this->m, this->s, this->ms);
-		this->prepareFlyingLetters(buf);
+		int available = Config.powerBudget - idle;
+		target = (available > 0) ? (available << 8) / variable : 0;
 	}
 
-	this->lastM = this->m;
-	this->lastH = this->h;
-
-
-	// create empty buffer filled with seconds color
-	this->fillBackground(this->s, this->ms, buf);
-
-	// minutes 1...4 for the corners
-	for(int i=0; i<=((this->m%5)-1); i++) buf[10 * 11 + i] = 1;
+	if (target < this->powerLimit) this->powerLimit = target;
+	else if (target > this->powerLimit + POWER_LIMIT_RELEASE)
+		this->powerLimit += POWER_LIMIT_RELEASE;
+	else this->powerLimit = target;
 
-	// leaving letters animation has priority
-	if(this->leavingLetters.size() > 0)
-	{
-		// count actually moved letters to detect end of animation
-		int movedLetters = 0;
-
-		// iterate over all leavingLetters
-		for(xy_t &p : this->leavingLetters)
-		{
-			// draw letter only if inside visible area
-			if(p.x>=0 && p.y>=0 && p.x<LEDFunctionsClass::width
-					&& p.y<LEDFunctionsClass::height)
-				buf[p.x + p.y * LEDFunctionsClass::width] = 1;
-
-			// continue with next letter if the current letter already
-			// reached its target position
-			if(p.y == p.yTarget && p.x == p.xTarget) continue;
-			p.counter += p.speed;
-			movedLetters++;
-			if(p.counter >= 1000)
-			{
-				p.counter -= 1000;
-				if(p.delay>0)
-				{
-					// do not move if animation of current letter is delayed
-					p.delay--;
-				}
-				else
-				{
-					if(p.y > p.yTarget) p.y--; else p.y++;
-				}
-			}
-		}
-		if(movedLetters == 0) this->leavingLetters.clear();
-	}
-	else
-	{
-		// iterate over all arrivingLetters
-		for(xy_t &p : this->arrivingLetters)
-		{
-			// draw letter only if inside visible area
-			if(p.x>=0 && p.y>=0 && p.x<LEDFunctionsClass::width
-					&& p.y<LEDFunctionsClass::height)
-				buf[p.x + p.y * LEDFunctionsClass::width] = 1;
-
-			// continue with next letter if the current letter already
-			// reached its target position
-			if(p.y == p.yTarget && p.x == p.xTarget) continue;
-			p.counter += p.speed;
-			if(p.counter >= 1000)
-			{
-				p.counter -= 1000;
-				if(p.delay>0)
-				{
-					// do not move if animation of current letter is delayed
-					p.delay--;
-				}
-				else
-				{
-					if(p.y > p.yTarget) p.y--; else p.y++;
-				}
-			}
-		}
-	}
+	this->current = idle + ((variable * this->powerLimit) >> 8);
+}
 
-	// present the current content immediately without fading
-	this->set(buf, palette, true);
+//---------------------------------------------------------------------------------------
+// getCurrent
+//
+// -> --
+// <- estimated supply current of the last frame in mA, including the power limit
+//---------------------------------------------------------------------------------------
+int LEDFunctionsClass::getCurrent()
+{
+	return this->current;
 }
 
 //---------------------------------------------------------------------------------------
-// renderRed
+// getDemand
 //
-// Renders a complete red frame for testing purposes.
+// -> --
+// <- estimated supply current of the last frame in mA without the power limit
+//---------------------------------------------------------------------------------------
+int LEDFunctionsClass::getDemand()
+{
+	return this->demand;
+}
+
+//---------------------------------------------------------------------------------------
+// getPowerLimit
 //
 // -> --
-// <- --
+// <- power limit factor of the last frame [0...256], 256 = not limited
 //---------------------------------------------------------------------------------------
-void LEDFunctionsClass::renderRed()
+int LEDFunctionsClass::getPowerLimit()
 {
-	palette_entry palette[2];
-	uint8_t heart[] = {
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1
-	};
-	palette[0] = {0, 0, 0};
-	palette[1] = {32, 0, 0};
-	this->set(heart, palette, true);
+	return this->powerLimit;
 }
 
 //---------------------------------------------------------------------------------------
-// renderGreen
+// setDiagnostic
 //
-// Renders a complete green frame for testing purposes.
+// Starts a test pattern and enters debug mode, the pattern is computed on every call
+// of process() until debug mode ends or another pattern is selected
 //
-// -> --
+// -> pattern: test pattern, DiagnosticPattern::none stops it and keeps the LEDs
 // <- --
 //---------------------------------------------------------------------------------------
-void LEDFunctionsClass::renderGreen()
+void LEDFunctionsClass::setDiagnostic(DiagnosticPattern pattern)
 {
-	palette_entry palette[2];
-	uint8_t heart[] = {
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1
-	};
-	palette[0] = {0, 0, 0};
-	palette[1] = {0, 32, 0};
-	this->set(heart, palette, true);
+	this->diagnostic = pattern;
+	this->diagnosticStart = millis();
+	if(pattern != DiagnosticPattern::none) Config.debugMode = true;
 }
 
 //---------------------------------------------------------------------------------------
-// renderBlue
-//
-// Renders a complete blue frame for testing purposes.
+// getDiagnostic
 //
 // -> --
-// <- --
+// <- test pattern currently shown, DiagnosticPattern::none if there is none
 //---------------------------------------------------------------------------------------
-void LEDFunctionsClass::renderBlue()
+DiagnosticPattern LEDFunctionsClass::getDiagnostic()
 {
-	palette_entry palette[2];
-	uint8_t heart[] = {
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-		1, 1, 1, 1
-	};
-	palette[0] = {0, 0, 0};
-	palette[1] = {0, 0, 32};
-	this->set(heart, palette, true);
+	return Config.debugMode ? this->diagnostic : DiagnosticPattern::none;
 }
 
 //---------------------------------------------------------------------------------------
-// renderUpdate
+// renderDiagnostic
 //
-// Renders the OTA update screen with progress information depending on
-// Config.updateProgress
+// Computes the current frame of the test pattern. The raw values bypass the calibration
+// so each LED shows exactly what is sent to it, the power limiter still applies.
 //
 // -> --
 // <- --
 //---------------------------------------------------------------------------------------
-void LEDFunctionsClass::renderUpdate()
+void LEDFunctionsClass::renderDiagnostic()
 {
-	uint8_t update[] = {
-		0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0,
-		0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0,
-		0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0,
-		0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0,
-		0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0,
-		0, 1, 1, 1, 0, 0, 0, 1, 1, 1, 0,
-		0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0,
-		0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0,
-		0, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0,
-		1, 1, 1, 1
-	};
-	palette_entry p[] = {{0, 0, 0}, {255, 0, 0}, {42, 21, 0}, {255, 85, 0}};
-	for(int i=0; i<110; i++)
+	uint32_t t = millis() - this->diagnosticStart;
+	uint32_t step = t / DIAGNOSTIC_STEP_TIME;
+	uint8_t *data = this->currentValues;
+
+	memset(data, 0, sizeof(this->currentValues));
+	switch(this->diagnostic)
 	{
-		if(i<Config.updateProgress)
-		{
-			if(update[i] == 0) update[i] = 2;
-			else update[i] = 3;
-		}
+	case DiagnosticPattern::chase:
+		data[(step % NUM_PIXELS) * 3 + (step / NUM_PIXELS) % 3] = 255;
+		break;
+
+	case DiagnosticPattern::ramp:
+	{
+		uint32_t channel = (t / DIAGNOSTIC_RAMP_TIME) % 3;
+		uint8_t value = (t % DIAGNOSTIC_RAMP_TIME) * 256 / DIAGNOSTIC_RAMP_TIME;
+		for(int i = 0; i < NUM_PIXELS; i++) data[i * 3 + channel] = value;
+		break;
+	}
+
+	case DiagnosticPattern::white:
+		memset(data, 255, sizeof(this->currentValues));
+		break;
+
+	case DiagnosticPattern::walk:
+		memset(&data[mapPixel(step % NUM_PIXELS) * 3], 255, 3);
+		break;
+
+	default:
+		break;
 	}
-	this->set(update, p, true);
 }
 
 //---------------------------------------------------------------------------------------
-// renderUpdateComplete
+// mapPixel
 //
-// Renders the OTA update complete screen
+// Looks up the position of a pixel of the display buffer in the LED chain
 //
-// -> --
-// <- --
+// -> index: pixel index in display order (rows from top left, then the four corners)
+// <- LED index in the chain
 //---------------------------------------------------------------------------------------
-void LEDFunctionsClass::renderUpdateComplete()
+int LEDFunctionsClass::mapPixel(int index)
 {
-	const uint8_t update_ok[] = {
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0,
-		0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 0,
-		0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		1, 1, 1, 1
-	};
-	palette_entry p[] = {{0, 21, 0}, {0, 255, 0}};
-	this->set(update_ok, p, true);
+	return flashRead8(LEDFunctionsClass::mapping, index);
 }
 
 //---------------------------------------------------------------------------------------
-// renderUpdateError
+// getOffset
 //
-// Renders the OTA update error screen
+// Calculates the offset of a given RGB triplet inside the LED buffer.
+// Does range checking for x and y, uses the internal mapping table.
 //
-// -> --
+// -> x: x coordinate
+//    y: y coordinate
+// <- offset for given coordinates
+//---------------------------------------------------------------------------------------
+int LEDFunctionsClass::getOffset(int x, int y)
+{
+	if (x>=0 && y>=0 && x<LEDFunctionsClass::width && y<LEDFunctionsClass::height)
+	{
+		return flashRead8(LEDFunctionsClass::mapping, x + y*LEDFunctionsClass::width) * 3;
+	}
+	else
+	{
+		return 0;
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// fillBackground
+//
+// Initializes the buffer with either background (=0) or seconds progress (=2),
+// part of the background will be illuminated with color 2 depending on current
+// seconds/milliseconds value, whole screen is backlit when seconds = 59
+//
+// -> seconds, milliseconds: Time value which the fill process will base on
+//    buf: destination buffer
 // <- --
 //---------------------------------------------------------------------------------------
-void LEDFunctionsClass::renderUpdateError()
+void LEDFunctionsClass::fillBackground(int seconds, int milliseconds, uint8_t *buf)
 {
-	const uint8_t update_err[] = {
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0,
-		0, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0,
-		0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		1, 1, 1, 1
-	};
-	palette_entry p[] = {{0, 0, 0}, {255, 0, 0}};
-	this->set(update_err, p, true);
+	int pos = (((seconds * 1000 + milliseconds) * 110) / 60000) + 1;
+	for (int i = 0; i < NUM_PIXELS; i++) buf[i] = (i < pos) ? 2 : 0;
 }
 
+#endif
+
 //---------------------------------------------------------------------------------------
-// renderWifiManager
+#if 1 // rendering methods
+//---------------------------------------------------------------------------------------
+
+//---------------------------------------------------------------------------------------
+// renderTime
 //
-// Renders the WifiManager screen
+// Loads internal buffers with the current time representation
 //
-// -> --
+// -> target: If NULL, a local buffer is used and time is actually being displayed
+//            if not null, time is not being displayed, but the given buffer is being
+//            filled with palette indexes representing the time
 // <- --
 //---------------------------------------------------------------------------------------
-void LEDFunctionsClass::renderWifiManager()
+void LEDFunctionsClass::renderTime(uint8_t *target, int h, int m, int s, int ms)
 {
-	const uint8_t wifimanager[] = {
-		0, 0, 0, 1, 1, 1, 1, 0, 0, 0, 0,
-		0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 0,
-		0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0,
-		0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0,
-		0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0,
-		1, 1, 1, 1
-	};
-	palette_entry p[] = {{0, 0, 0}, {255, 255, 0}};
-	this->set(wifimanager, p, true);
+	this->fillBackground(s, ms, target);
+
+	// set static LEDs
+	target[0] = 1; // E
+	target[1] = 1; // S
+
+	target[3] = 1; // I
+	target[4] = 1; // S
+	target[5] = 1; // T
+
+	// minutes 1...4 for the corners
+	for(int i=0; i<=((m%5)-1); i++) target[10 * 11 + i] = 1;
+
+	// iterate over minutes_template
+	int adjust_hour = 0;
+	for(leds_template_t t : LEDFunctionsClass::minutesTemplate)
+	{
+		// test if this template matches the current minute
+		if(m >= t.param1 && m <= t.param2)
+		{
+			// set all LEDs defined in this template
+			for(int i : t.LEDs) target[i] = 1;
+			adjust_hour = t.param0;
+			break;
+		}
+	}
+
+	// adjust hour display if necessary (e. g. 09:45 = quarter to *TEN* instead of NINE)
+	h += adjust_hour;
+	if(h > 23)	h -= 24;
+
+	// iterate over hours template
+	for(leds_template_t t : LEDFunctionsClass::hoursTemplate)
+	{
+		// test if this template matches the current hour
+		if((t.param1 == h || t.param2 == h) &&
+		   ((t.param0 == 1 && m < 5)  || // special case full hour
+			(t.param0 == 2 && m >= 5) || // special case hour + minutes
+			(t.param0 == 0)))            // normal case
+		{
+			// set all LEDs defined in this template
+			for(int i : t.LEDs) target[i] = 1;
+			break;
+		}
+	}
+
+	// DEBUG
+	static int last_minutes = -1;
+	if(last_minutes != this->m)
+	{
+		last_minutes = this->m;
+		Serial.printf("h=%i, m=%i, s=%i\r\n", this->h, this->m, this->s);
+		for(int y=0; y<10; y++)
+		{
+			for(int x=0; x<11; x++)
+			{
+				Serial.print(target[y*11+x]);
+				Serial.print(' ');
+			}
+			Serial.println(' ');
+		}
+	}
 }
 
 #endif
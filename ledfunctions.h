@@ -23,9 +23,7 @@
 #include <vector>
 
 #include "config.h"
-#include "matrixobject.h"
-#include "starobject.h"
-#include "particle.h"
+#include "effect.h"
 
 typedef struct _leds_template_t
 {
@@ -33,14 +31,36 @@ typedef struct _leds_template_t
 	const std::vector<int> LEDs;
 } leds_template_t;
 
-typedef struct _xy_t
+// quiescent current of a single WS2812B in mA
+#define LED_IDLE_CURRENT 1
+
+// maximum increase of the power limit factor per frame, the limit drops immediately
+#define POWER_LIMIT_RELEASE 2
+
+// time in ms after the last preview color until the colors from Config are restored
+#define LIVE_PREVIEW_TIMEOUT 30000
+
+// time in ms each LED is lit by the chase and walk diagnostics and duration of one
+// channel ramp of the ramp diagnostic
+#define DIAGNOSTIC_STEP_TIME 60
+#define DIAGNOSTIC_RAMP_TIME 2048
+
+// test patterns generated while Config.debugMode is set:
+//  - chase: one LED after the other in chain order, red, green and blue in turn
+//  - ramp: all LEDs fade up one channel at a time
+//  - white: all LEDs full white, to check the supply under load
+//  - walk: one LED after the other in display order, reveals mapping errors
+enum class DiagnosticPattern
 {
-	int xTarget, yTarget, x, y, delay, speed, counter;
-} xy_t;
+	none, chase, ramp, white, walk
+};
 
-#define NUM_MATRIX_OBJECTS 25
-#define NUM_STARS 10
-#define NUM_BRIGHTNESS_CURVES 2
+// 256 entry color lookup table expanded from a gradient palette, stored once for each
+// calibration profile with the correction already applied
+typedef struct _color_lut_t
+{
+	uint8_t rgb[NUM_CALIBRATION_PROFILES][256 * 3];
+} color_lut_t;
 
 class LEDFunctionsClass
 {
@@ -52,71 +72,101 @@ public:
 	void setTime(int h, int m, int s, int ms);
 	void setBrightness(int brightness);
 	void setMode(DisplayMode newMode);
+	DisplayMode getMode();
+	void loadCalibration();
 	void show();
+	int getCurrent();
+	int getDemand();
+	int getPowerLimit();
+	void setDiagnostic(DiagnosticPattern pattern);
+	DiagnosticPattern getDiagnostic();
+
+	// helpers for the effects in effects.cpp
+	void fillBackground(int seconds, int milliseconds, uint8_t *buf);
+	void renderTime(uint8_t *target, int h, int m, int s, int ms);
+	void fade();
+	void set(const uint8_t *buf, const palette_entry palette[]);
+	void set(const uint8_t *buf, const palette_entry palette[], bool immediately);
+	void setLUT(const uint8_t *buf, const color_lut_t *lut);
+	void setTimeColors(const uint8_t *buf, bool immediately);
+	void setPixel(int index, uint8_t r, uint8_t g, uint8_t b);
+	void buildLUT(const gradient_t *gradient, color_lut_t *lut);
 
 	static int getOffset(int x, int y);
+	static int mapPixel(int index);
 	static const int width = 11;
 	static const int height = 10;
 	uint8_t currentValues[NUM_PIXELS * 3];
 
+	// colors of the time display (background, foreground, seconds), taken over from
+	// Config or from the live preview once per frame by process()
+	palette_entry timeColors[3];
+	void previewColor(int index, palette_entry color);
+	void endPreview();
+	bool isPreviewing();
+
+	// time as set by setTime(), read by the effects
+	int h = 0;
+	int m = 0;
+	int s = 0;
+	int ms = 0;
+
+	EffectRegistry effects;
+
 private:
 	static const std::vector<leds_template_t> hoursTemplate;
 	static const std::vector<leds_template_t> minutesTemplate;
-	static const palette_entry firePalette[];
-	static const palette_entry plasmaPalette[];
 
 	DisplayMode mode = DisplayMode::plain;
 
-
-	std::vector<Particle*> particles;
-	std::vector<xy_t> arrivingLetters;
-	std::vector<xy_t> leavingLetters;
-	std::vector<MatrixObject> matrix;
-	std::vector<StarObject> stars;
-	uint8_t targetValues[NUM_PIXELS * 3];
 	Adafruit_NeoPixel *pixels = NULL;
-	int heartBrightness = 0;
-	int heartState = 0;
 	int brightness = 96;
-	int h = 0;
-	int m = 0;
-	int s = 0;
-	int ms = 0;
-	int lastM = -1;
-	int lastH = -1;
 
-	void fillBackground(int seconds, int milliseconds, uint8_t *buf);
-	void renderRed();
-	void renderGreen();
-	void renderBlue();
-	void renderMatrix();
-	void renderHeart();
-	void renderFire();
-	void renderPlasma();
-	void renderStars();
-	void renderUpdate();
-	void renderUpdateComplete();
-	void renderUpdateError();
-	void renderHourglass(uint8_t animationStep, bool green);
-	void renderWifiManager();
-	void renderTime(uint8_t *target, int h, int m, int s, int ms);
-	void renderFlyingLetters();
-	void prepareFlyingLetters(uint8_t *source);
-	void renderExplosion();
-	void prepareExplosion(uint8_t *source);
-	void fade();
-	void set(const uint8_t *buf, palette_entry palette[]);
-	void set(const uint8_t *buf, palette_entry palette[], bool immediately);
-	void setBuffer(uint8_t *target, const uint8_t *source, palette_entry palette[]);
+	// power limiter: values and sum of each channel as last sent to the LEDs, limit
+	// factor [0...256] and brightness actually applied in the last frame
+	uint8_t shownValues[NUM_PIXELS * 3];
+	uint32_t channelSum[3] = {0, 0, 0};
+	int powerLimit = 256;
+	int shownBrightness = -1;
+	int demand = 0;
+	int current = 0;
+	void updatePowerLimit();
+
+	// test pattern shown in debug mode and time it was started
+	DiagnosticPattern diagnostic = DiagnosticPattern::none;
+	uint32_t diagnosticStart = 0;
+	void renderDiagnostic();
+
+	void setBuffer(uint8_t *target, const uint8_t *source, const palette_entry palette[]);
+
+	// live preview colors, previewPending has one bit for each color received since
+	// the last frame, only the newest value of each color is kept
+	palette_entry previewColors[3];
+	uint32_t previewPending = 0;
+	bool previewActive = false;
+	uint32_t lastPreview = 0;
+
+	// time colors with the correction of each calibration profile applied, rebuilt by
+	// updateTimeColors() when the colors or the calibration change
+	uint8_t fusedTimeColors[NUM_CALIBRATION_PROFILES][3 * 3];
+	palette_entry fusedSource[3];
+	uint32_t fusedVersion = 0;
+	void updateTimeColors();
+	static uint8_t calibrate(int value, int gain, int offset);
+
+	// brightness curves combined with the calibration profiles from Config, indexed by
+	// (profile << 8) + color value, compiled by loadCalibration()
+	uint8_t correctionR[256*NUM_CALIBRATION_PROFILES];
+	uint8_t correctionG[256*NUM_CALIBRATION_PROFILES];
+	uint8_t correctionB[256*NUM_CALIBRATION_PROFILES];
 
 	// this mapping table maps the linear memory buffer structure used throughout the
 	// project to the physical layout of the LEDs
-	static const uint32_t PROGMEM mapping[NUM_PIXELS];
+	static const uint8_t PROGMEM mapping[NUM_PIXELS];
 
-	static const uint32_t PROGMEM brightnessCurveSelect[NUM_PIXELS];
-	static const uint32_t PROGMEM brightnessCurvesR[256*NUM_BRIGHTNESS_CURVES];
-	static const uint32_t PROGMEM brightnessCurvesG[256*NUM_BRIGHTNESS_CURVES];
-	static const uint32_t PROGMEM brightnessCurvesB[256*NUM_BRIGHTNESS_CURVES];;
+	static const uint8_t PROGMEM brightnessCurvesR[256*NUM_BRIGHTNESS_CURVES];
+	static const uint8_t PROGMEM brightnessCurvesG[256*NUM_BRIGHTNESS_CURVES];
+	static const uint8_t PROGMEM brightnessCurvesB[256*NUM_BRIGHTNESS_CURVES];
 };
 
 extern LEDFunctionsClass LED;
@@ -0,0 +1,221 @@
+// ESP8266 Wordclock
+// Copyright (C) 2016 Thoralt Franz, https://github.com/thoralt
+//
+//  This class records the ambient light over time in fixed memory. The raw ADC
+//  samples of every second are aggregated to minimum, average and maximum and stored
+//  in a ring buffer together with the applied brightness and the override state. Each
+//  level is downsampled into the next coarser one while records are written, so every
+//  sample costs constant time:
+//   - level 0: 1 second records for the last 5 minutes
+//   - level 1: 1 minute records for the last day
+//   - level 2: 15 minute records for the last week
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <Arduino.h>
+#include "lighthistory.h"
+
+//---------------------------------------------------------------------------------------
+// global instance
+//---------------------------------------------------------------------------------------
+LightHistoryClass LightHistory = LightHistoryClass();
+
+// number of records of the previous level aggregated into one record of each level
+static const uint32_t levelRatio[LIGHT_HISTORY_LEVELS] = {1, 60, 15};
+
+//---------------------------------------------------------------------------------------
+// LightHistoryClass
+//
+// Constructor, initializes empty rings
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+LightHistoryClass::LightHistoryClass()
+{
+	this->rings[0] = {this->records0, LIGHT_HISTORY_SIZE_0, 0, 0};
+	this->rings[1] = {this->records1, LIGHT_HISTORY_SIZE_1, 0, 0};
+	this->rings[2] = {this->records2, LIGHT_HISTORY_SIZE_2, 0, 0};
+	reset(this->current);
+	for(int i = 0; i < LIGHT_HISTORY_LEVELS - 1; i++) reset(this->pending[i]);
+}
+
+//---------------------------------------------------------------------------------------
+// reset
+//
+// Clears an accumulator
+//
+// -> acc: accumulator to clear
+// <- --
+//---------------------------------------------------------------------------------------
+void LightHistoryClass::reset(accumulator_t &acc)
+{
+	acc.sum = 0;
+	acc.brightnessSum = 0;
+	acc.count = 0;
+	acc.min = UINT32_MAX;
+	acc.max = 0;
+	acc.override = false;
+}
+
+//---------------------------------------------------------------------------------------
+// add
+//
+// Adds a sample or a record to an accumulator
+//
+// -> acc: accumulator
+//    min, avg, max: ADC values of the sample or record
+//    brightness: applied brightness
+//    override: true if the brightness override was active
+// <- --
+//---------------------------------------------------------------------------------------
+void LightHistoryClass::add(accumulator_t &acc, uint32_t min, uint32_t avg,
+		uint32_t max, uint32_t brightness, bool override)
+{
+	acc.sum += avg;
+	acc.brightnessSum += brightness;
+	acc.count++;
+	if(min < acc.min) acc.min = min;
+	if(max > acc.max) acc.max = max;
+	if(override) acc.override = true;
+}
+
+//---------------------------------------------------------------------------------------
+// push
+//
+// Stores the aggregate of an accumulator as new record of a level and passes it on to
+// the next coarser level
+//
+// -> level: level to store the record in
+//    acc: accumulator with at least one sample
+// <- --
+//---------------------------------------------------------------------------------------
+void LightHistoryClass::push(int level, const accumulator_t &acc)
+{
+	ring_t &ring = this->rings[level];
+	light_record &r = ring.records[ring.head];
+	uint32_t brightness = acc.brightnessSum / acc.count;
+
+	r.min = acc.min;
+	r.avg = acc.sum / acc.count;
+	r.max = acc.max;
+	r.state = ((brightness > 255 ? 255 : brightness) & 0xFE) | (acc.override ? 1 : 0);
+
+	if(++ring.head >= ring.size) ring.head = 0;
+	if(ring.count < ring.size) ring.count++;
+
+	if(level >= LIGHT_HISTORY_LEVELS - 1) return;
+
+	accumulator_t &next = this->pending[level];
+	add(next, r.min, r.avg, r.max, r.state & 0xFE, acc.override);
+	if(next.count >= levelRatio[level + 1])
+	{
+		this->push(level + 1, next);
+		reset(next);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// sample
+//
+// Adds a raw ADC sample to the record of the current second
+//
+// -> adc: raw ADC value [0...1023]
+// <- --
+//---------------------------------------------------------------------------------------
+void LightHistoryClass::sample(uint32_t adc)
+{
+	adc >>= 2;
+	add(this->current, adc, adc, adc, 0, false);
+}
+
+//---------------------------------------------------------------------------------------
+// process
+//
+// Must be called repeatedly from main loop, closes the record of the current second
+// once per second
+//
+// -> adc: filtered ADC value, used if no raw sample was taken in the last second
+//    brightness: applied brightness [0...256]
+//    override: true if the brightness override is active
+// <- --
+//---------------------------------------------------------------------------------------
+void LightHistoryClass::process(uint32_t adc, uint32_t brightness, bool override)
+{
+	uint32_t now = millis();
+	if(now - this->lastSecond < 1000) return;
+	this->lastSecond = now;
+
+	if(this->current.count == 0) this->sample(adc);
+	this->current.brightnessSum = brightness * this->current.count;
+	this->current.override = override;
+	this->push(0, this->current);
+	reset(this->current);
+}
+
+//---------------------------------------------------------------------------------------
+// count
+//
+// -> level: history level
+// <- number of records stored in the level
+//---------------------------------------------------------------------------------------
+int LightHistoryClass::count(int level)
+{
+	if(level < 0 || level >= LIGHT_HISTORY_LEVELS) return 0;
+	return this->rings[level].count;
+}
+
+//---------------------------------------------------------------------------------------
+// size
+//
+// -> level: history level
+// <- maximum number of records in the level
+//---------------------------------------------------------------------------------------
+int LightHistoryClass::size(int level)
+{
+	if(level < 0 || level >= LIGHT_HISTORY_LEVELS) return 0;
+	return this->rings[level].size;
+}
+
+//---------------------------------------------------------------------------------------
+// interval
+//
+// -> level: history level
+// <- time covered by one record of the level in seconds
+//---------------------------------------------------------------------------------------
+uint32_t LightHistoryClass::interval(int level)
+{
+	uint32_t result = 1;
+	for(int i = 1; i <= level && i < LIGHT_HISTORY_LEVELS; i++) result *= levelRatio[i];
+	return result;
+}
+
+//---------------------------------------------------------------------------------------
+// get
+//
+// Returns a record of a level
+//
+// -> level: history level
+//    age: 0 for the newest record, count(level)-1 for the oldest one
+// <- record, all zero if level or age are out of range
+//---------------------------------------------------------------------------------------
+light_record LightHistoryClass::get(int level, int age)
+{
+	light_record result = {0, 0, 0, 0};
+	if(age < 0 || age >= this->count(level)) return result;
+
+	ring_t &ring = this->rings[level];
+	int index = ring.head - 1 - age;
+	if(index < 0) index += ring.size;
+	return ring.records[index];
+}
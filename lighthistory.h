@@ -0,0 +1,85 @@
+// ESP8266 Wordclock
+// Copyright (C) 2016 Thoralt Franz, https://github.com/thoralt
+//
+//  See lighthistory.cpp for description.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _LIGHTHISTORY_H_
+#define _LIGHTHISTORY_H_
+
+#include <stdint.h>
+
+// number of resolutions kept in the history
+#define LIGHT_HISTORY_LEVELS 3
+
+// 1 second for 5 minutes, 1 minute for 1 day, 15 minutes for 1 week
+#define LIGHT_HISTORY_SIZE_0 300
+#define LIGHT_HISTORY_SIZE_1 1440
+#define LIGHT_HISTORY_SIZE_2 672
+
+// aggregated light samples of one interval, ADC values are stored with 8 bit
+// resolution (adc >> 2), state holds the applied brightness >> 1 in bits 7...1 and
+// the override flag in bit 0
+typedef struct _light_record
+{
+	uint8_t min, avg, max;
+	uint8_t state;
+} light_record;
+
+class LightHistoryClass
+{
+public:
+	LightHistoryClass();
+	void sample(uint32_t adc);
+	void process(uint32_t adc, uint32_t brightness, bool override);
+	int count(int level);
+	int size(int level);
+	uint32_t interval(int level);
+	light_record get(int level, int age);
+
+private:
+	// running aggregation of the records for the next record of a level
+	typedef struct _accumulator_t
+	{
+		uint32_t sum, brightnessSum, count;
+		uint32_t min, max;
+		bool override;
+	} accumulator_t;
+
+	typedef struct _ring_t
+	{
+		light_record *records;
+		int size, head, count;
+	} ring_t;
+
+	light_record records0[LIGHT_HISTORY_SIZE_0];
+	light_record records1[LIGHT_HISTORY_SIZE_1];
+	light_record records2[LIGHT_HISTORY_SIZE_2];
+	ring_t rings[LIGHT_HISTORY_LEVELS];
+
+	// raw ADC samples of the current second
+	accumulator_t current;
+	// records of level 0 and 1 aggregated for the next record of level 1 and 2
+	accumulator_t pending[LIGHT_HISTORY_LEVELS - 1];
+	uint32_t lastSecond = 0;
+
+	static void reset(accumulator_t &acc);
+	static void add(accumulator_t &acc, uint32_t min, uint32_t avg, uint32_t max,
+			uint32_t brightness, bool override);
+	void push(int level, const accumulator_t &acc);
+};
+
+extern LightHistoryClass LightHistory;
+
+#endif
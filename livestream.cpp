@@ -0,0 +1,290 @@
+// ESP8266 Wordclock
+// Copyright (C) 2016 Thoralt Franz, https://github.com/thoralt
+//
+//  This class pushes the LED frame and state changes to browsers using server-sent
+//  events ("/events"). The handler in webserver.cpp hands the connection over to this
+//  class, which keeps it open and writes to it from the main loop:
+//   - "frame": base64 encoded list of changed pixels, 4 bytes each (index in display
+//     order, r, g, b), sent at most at the frame rate requested by the client. The
+//     first frame of a connection contains all pixels.
+//   - "state": same JSON structure as "/api/state", sent whenever it changes.
+//  An event is only written if it fits completely into the send buffer of the
+//  connection. Frames which do not fit are dropped; the next one contains all pixels
+//  which changed since the last delivered frame. The render loop never waits for a
+//  client.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <Arduino.h>
+#include "livestream.h"
+#include "ledfunctions.h"
+#include "webserver.h"
+
+//---------------------------------------------------------------------------------------
+// global instance
+//---------------------------------------------------------------------------------------
+LiveStreamClass LiveStream = LiveStreamClass();
+
+//---------------------------------------------------------------------------------------
+// LiveStreamClass
+//
+// Constructor, initializes empty client slots
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+LiveStreamClass::LiveStreamClass()
+{
+	for(int i = 0; i < LIVESTREAM_CLIENTS_MAX; i++) this->clients[i].active = false;
+	this->state[0] = 0;
+}
+
+//---------------------------------------------------------------------------------------
+// accept
+//
+// Takes over a connection from the web server and sends the response header of the
+// event stream
+//
+// -> client: connection of the "/events" request
+//    fps: requested frame rate, limited to [1...LIVESTREAM_FPS_MAX]
+// <- false if all client slots are in use
+//---------------------------------------------------------------------------------------
+bool LiveStreamClass::accept(WiFiClient client, int fps)
+{
+	stream_client *c = NULL;
+	for(int i = 0; i < LIVESTREAM_CLIENTS_MAX && !c; i++)
+	{
+		if(!this->clients[i].active || !this->clients[i].client.connected())
+			c = &this->clients[i];
+	}
+	if(!c) return false;
+
+	if(fps < 1) fps = 1;
+	if(fps > LIVESTREAM_FPS_MAX) fps = LIVESTREAM_FPS_MAX;
+
+	c->client = client;
+	c->client.setNoDelay(true);
+	c->active = true;
+	c->keyframe = true;
+	c->interval = 1000 / fps;
+	c->lastFrame = millis() - c->interval;
+	c->lastSend = millis();
+	c->stateVersion = this->stateVersion - 1;
+
+	static const char header[] =
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Type: text/event-stream\r\n"
+			"Cache-Control: no-cache\r\n"
+			"Connection: keep-alive\r\n\r\n"
+			"retry: 2000\n\n";
+	c->client.write((const uint8_t*) header, sizeof(header) - 1);
+
+	// send the current state with the first call to process()
+	this->lastStateCheck = millis() - LIVESTREAM_STATE_INTERVAL;
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+// clientCount
+//
+// -> --
+// <- number of connected clients
+//---------------------------------------------------------------------------------------
+int LiveStreamClass::clientCount()
+{
+	int count = 0;
+	for(int i = 0; i < LIVESTREAM_CLIENTS_MAX; i++)
+	{
+		if(this->clients[i].active) count++;
+	}
+	return count;
+}
+
+//---------------------------------------------------------------------------------------
+// process
+//
+// Must be called repeatedly from main loop after LED.process(), sends pending events
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void LiveStreamClass::process()
+{
+	int count = 0;
+	for(int i = 0; i < LIVESTREAM_CLIENTS_MAX; i++)
+	{
+		stream_client &c = this->clients[i];
+		if(c.active && !c.client.connected())
+		{
+			c.client.stop();
+			c.active = false;
+		}
+		if(c.active) count++;
+	}
+	if(!count) return;
+
+	uint32_t now = millis();
+	if(now - this->lastStateCheck >= LIVESTREAM_STATE_INTERVAL)
+	{
+		this->lastStateCheck = now;
+		this->updateState();
+	}
+
+	for(int i = 0; i < LIVESTREAM_CLIENTS_MAX; i++)
+	{
+		stream_client &c = this->clients[i];
+		if(!c.active) continue;
+
+		if(c.stateVersion != this->stateVersion &&
+				this->sendEvent(c, "state", this->state))
+		{
+			c.stateVersion = this->stateVersion;
+		}
+
+		if(now - c.lastFrame >= c.interval)
+		{
+			c.lastFrame = now;
+			this->sendFrame(c);
+		}
+
+		if(now - c.lastSend >= LIVESTREAM_KEEPALIVE) this->write(c, ":\n\n", 3);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// updateState
+//
+// Serializes the current state and increments stateVersion if it changed
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void LiveStreamClass::updateState()
+{
+	char buf[LIVESTREAM_STATE_SIZE];
+	WebServerClass::stateJson(buf, sizeof(buf));
+
+	uint32_t hash = 2166136261UL;
+	for(const char *p = buf; *p; p++) hash = (hash ^ (uint8_t)*p) * 16777619UL;
+	if(hash == this->stateHash && this->state[0]) return;
+
+	this->stateHash = hash;
+	memcpy(this->state, buf, sizeof(this->state));
+	this->stateVersion++;
+}
+
+//---------------------------------------------------------------------------------------
+// sendFrame
+//
+// Sends the pixels which changed since the last frame delivered to a client
+//
+// -> c: client
+// <- --
+//---------------------------------------------------------------------------------------
+void LiveStreamClass::sendFrame(stream_client &c)
+{
+	uint8_t delta[NUM_PIXELS * 4];
+	uint32_t length = 0;
+	for(int i = 0; i < NUM_PIXELS; i++)
+	{
+		const uint8_t *color = &LED.currentValues[LEDFunctionsClass::mapPixel(i) * 3];
+		if(!c.keyframe && memcmp(color, &c.shown[i * 3], 3) == 0) continue;
+		delta[length++] = i;
+		delta[length++] = color[0];
+		delta[length++] = color[1];
+		delta[length++] = color[2];
+	}
+	if(!length) return;
+
+	char data[(sizeof(delta) + 2) / 3 * 4 + 1];
+	base64(delta, length, data);
+	if(!this->sendEvent(c, "frame", data))
+	{
+		this->framesDropped++;
+		return;
+	}
+
+	for(uint32_t i = 0; i < length; i += 4) memcpy(&c.shown[delta[i] * 3], &delta[i + 1], 3);
+	c.keyframe = false;
+	this->framesSent++;
+}
+
+//---------------------------------------------------------------------------------------
+// sendEvent
+//
+// Sends a single line event to a client if it fits into the send buffer
+//
+// -> c: client
+//    event: event name
+//    data: event data, must not contain line breaks
+// <- true if the event was sent
+//---------------------------------------------------------------------------------------
+bool LiveStreamClass::sendEvent(stream_client &c, const char *event, const char *data)
+{
+	char head[32];
+	uint32_t headLength = snprintf(head, sizeof(head), "event: %s\ndata: ", event);
+	uint32_t dataLength = strlen(data);
+	if(c.client.availableForWrite() < (int)(headLength + dataLength + 2)) return false;
+
+	this->write(c, head, headLength);
+	this->write(c, data, dataLength);
+	this->write(c, "\n\n", 2);
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+// write
+//
+// Writes data to a client if it fits into the send buffer
+//
+// -> c: client
+//    data: data to write
+//    length: number of bytes
+// <- true if the data was written
+//---------------------------------------------------------------------------------------
+bool LiveStreamClass::write(stream_client &c, const char *data, uint32_t length)
+{
+	if(c.client.availableForWrite() < (int)length) return false;
+	c.client.write((const uint8_t*) data, length);
+	c.lastSend = millis();
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+// base64
+//
+// Encodes binary data as zero terminated base64 string
+//
+// -> data: binary data
+//    length: number of bytes
+//    target: buffer for at least (length + 2) / 3 * 4 + 1 characters
+// <- length of the string
+//---------------------------------------------------------------------------------------
+uint32_t LiveStreamClass::base64(const uint8_t *data, uint32_t length, char *target)
+{
+	static const char alphabet[] =
+			"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	char *p = target;
+	for(uint32_t i = 0; i < length; i += 3)
+	{
+		uint32_t v = data[i] << 16;
+		if(i + 1 < length) v |= data[i + 1] << 8;
+		if(i + 2 < length) v |= data[i + 2];
+		*p++ = alphabet[(v >> 18) & 0x3F];
+		*p++ = alphabet[(v >> 12) & 0x3F];
+		*p++ = i + 1 < length ? alphabet[(v >> 6) & 0x3F] : '=';
+		*p++ = i + 2 < length ? alphabet[v & 0x3F] : '=';
+	}
+	*p = 0;
+	return p - target;
+}
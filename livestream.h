@@ -0,0 +1,85 @@
+// ESP8266 Wordclock
+// Copyright (C) 2016 Thoralt Franz, https://github.com/thoralt
+//
+//  See livestream.cpp for description.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _LIVESTREAM_H_
+#define _LIVESTREAM_H_
+
+#include <stdint.h>
+#include <ESP8266WiFi.h>
+
+#include "config.h"
+
+// maximum number of simultaneously connected clients
+#define LIVESTREAM_CLIENTS_MAX 2
+
+// frame rate limits in frames per second
+#define LIVESTREAM_FPS_DEFAULT 10
+#define LIVESTREAM_FPS_MAX 25
+
+// interval of the state change check and of keep alive comments in ms
+#define LIVESTREAM_STATE_INTERVAL 250
+#define LIVESTREAM_KEEPALIVE 15000
+
+// maximum length of the JSON state
+#define LIVESTREAM_STATE_SIZE 384
+
+class LiveStreamClass
+{
+public:
+	LiveStreamClass();
+	bool accept(WiFiClient client, int fps);
+	void process();
+	int clientCount();
+
+	// frames sent to and dropped for slow clients
+	uint32_t framesSent = 0;
+	uint32_t framesDropped = 0;
+
+private:
+	typedef struct _stream_client
+	{
+		WiFiClient client;
+		bool active;
+		bool keyframe;
+		uint32_t interval;
+		uint32_t lastFrame;
+		uint32_t lastSend;
+		uint32_t stateVersion;
+
+		// frame as last sent to the client, in display order
+		uint8_t shown[NUM_PIXELS * 3];
+	} stream_client;
+
+	stream_client clients[LIVESTREAM_CLIENTS_MAX];
+
+	// JSON state as sent with the last state event, stateVersion is incremented on
+	// every change
+	char state[LIVESTREAM_STATE_SIZE];
+	uint32_t stateHash = 0;
+	uint32_t stateVersion = 0;
+	uint32_t lastStateCheck = 0;
+
+	void updateState();
+	void sendFrame(stream_client &c);
+	bool sendEvent(stream_client &c, const char *event, const char *data);
+	bool write(stream_client &c, const char *data, uint32_t length);
+	static uint32_t base64(const uint8_t *data, uint32_t length, char *target);
+};
+
+extern LiveStreamClass LiveStream;
+
+#endif
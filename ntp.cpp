@@ -2,11 +2,25 @@
 // Copyright (C) 2016 Thoralt Franz, https://github.com/thoralt
 //
 //  This module contains a simple NTP client. NTP packets are sent using UDP to a
-//  configurable NTP server. The server reply is processed and a callback is
-//  executed to notifiy the calling application of the current time. The internal
-//  state machine is called from an internal timer to take care of timeouts, the
-//  NTP request is retried automatically if no reply is being received. The request
-//  is being repeated every 59 minutes, so the calling module is updated regularly.
+//  configurable list of up to MAX_NTP_SERVERS servers (host names or IP addresses).
+//  Each round queries all of them at once, replies are checked for sanity (mode,
+//  stratum, leap indicator, root distance, Kiss-o'-Death codes) and the best one is
+//  selected by its delay and by how many of the recent requests the server answered.
+//  A callback is executed to notifiy the calling application of the offset of its
+//  clock and of the local time to UTC. Rounds without any valid reply are retried
+//  after 4 seconds, doubling up to 17 minutes. The request is repeated every 64
+//  seconds at first; the interval grows up to 68 minutes while the offsets stay
+//  small, so the calling module is updated regularly.
+//  The state machine is driven by process() from the main loop, which only compares
+//  the deadline of the current state while nothing is due. Host names are resolved
+//  with the asynchronous lwIP resolver, process() starts the lookup and picks up the
+//  address once the DNS callback has delivered it. Addresses are looked up again after
+//  NTP_DNS_TTL ms or if the server stops answering, the previous address is used
+//  until the lookup completes and kept if it fails. Replies are received by an lwIP callback, which only takes the arrival time
+//  (T4) and copies the packet into a single producer, single consumer ring buffer.
+//  process() takes the packets from there, so parsing, logging and the callback run
+//  in the main loop, while the arrival time does not depend on how long the loop
+//  takes.
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -24,155 +38,316 @@
 // This code is based on (heavily modified):
 // https://github.com/sandeepmistry/esp8266-Arduino/blob/master/esp8266com/esp8266/libraries/ESP8266WiFi/examples/NTPClient
 #include <Arduino.h>
+#include <ESP8266WiFi.h>
 #include <limits.h>
+#include <lwip/pbuf.h>
+#include <lwip/dns.h>
 #include "ntp.h"
+#include "clock.h"
 
 //---------------------------------------------------------------------------------------
 // CONSTANTS
 //---------------------------------------------------------------------------------------
-#define NTP_PACKET_SIZE 48
 #define LOCAL_PORT 2390
 #define NTP_TIMEOUT 5000
-#define TIMER_RESOLUTION 10
-#define NTP_RELOAD_INTERVAL (59*60*1000)
+
+// the poll interval is lengthened after NTP_STABLE_SAMPLES samples with an offset below
+// NTP_STABLE_OFFSET us and shortened by a factor of 4 by larger offsets
+#define NTP_STABLE_OFFSET 10000
+#define NTP_STABLE_SAMPLES 4
+
+// time in ms before a round without any valid reply is repeated, doubled with each
+// further failure up to NTP_RETRY_MIN << NTP_RETRY_STEPS (4 s ... 17 min)
+#define NTP_RETRY_MIN 4000
+#define NTP_RETRY_STEPS 8
+
+// host names are looked up again after NTP_DNS_TTL ms, failed lookups are retried
+// after NTP_DNS_RETRY ms, a lookup without answer is given up after NTP_DNS_TIMEOUT ms
+#define NTP_DNS_TTL 3600000
+#define NTP_DNS_RETRY 300000
+#define NTP_DNS_TIMEOUT 10000
+
+// a server which did not answer the last NTP_UNREACHABLE requests is looked up again
+#define NTP_UNREACHABLE 4
+
+// replies from servers with a higher stratum or a root distance (root delay / 2 +
+// root dispersion, 16.16 bit fixed point seconds) above 1.5 s are rejected
+#define NTP_MAX_STRATUM 15
+#define NTP_MAX_DISTANCE 0x18000
+
+// added to the delay in us for each of the last 8 requests a server did not answer,
+// so a reliable server is preferred to a slightly faster one which drops requests
+#define NTP_REACH_PENALTY 20000
 
 //---------------------------------------------------------------------------------------
 // global instance
 //---------------------------------------------------------------------------------------
 NtpClass NTP = NtpClass();
 
+// keeps the compiler from moving memory accesses across the queue indices
+#define NTP_BARRIER() __asm__ __volatile__("" ::: "memory")
+
 //---------------------------------------------------------------------------------------
-// tickerFunctionWrapper
+// receiveWrapper
 //
-// Static wrapper which is used as callback function for Ticker and takes supplied
-// argument to call the handler tickerFunction() of instance method
+// Static wrapper which is registered as lwIP receive callback and passes the packet
+// to receive() of the instance given as argument
 //
-// -> obj: Instance of class to call the method tickerFunctio() on
+// -> arg: Instance of class to call the method receive() on
+//    pcb, addr, port: UDP connection and sender (unused)
+//    p: received packet, freed by receive()
 // <- --
 //---------------------------------------------------------------------------------------
-void NtpClass::tickerFunctionWrapper(NtpClass *obj)
+void NtpClass::receiveWrapper(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+		const ip_addr_t *addr, uint16_t port)
 {
-	obj->tickerFunction();
+	((NtpClass*) arg)->receive(p);
 }
 
 //---------------------------------------------------------------------------------------
-// NtpClass
+// dnsWrapper
 //
-// Constructor, sets up a timer to trigger the internal state machine
+// Static wrapper which is registered as lwIP DNS callback and passes the result to
+// lookupFound() of the instance given as argument
 //
-// -> --
+// -> name: host name which was looked up
+//    ipaddr: address found, NULL if the lookup failed
+//    arg: Instance of class to call the method lookupFound() on
 // <- --
 //---------------------------------------------------------------------------------------
-NtpClass::NtpClass()
+void NtpClass::dnsWrapper(const char *name, const ip_addr_t *ipaddr, void *arg)
 {
-	this->ticker.attach_ms(TIMER_RESOLUTION, NtpClass::tickerFunctionWrapper,
-			this);
+	((NtpClass*) arg)->lookupFound(name, ipaddr);
 }
 
 //---------------------------------------------------------------------------------------
-// setServer
+// lookupFound
 //
-// Sets the current time server and schedules a new NTP request
+// Called by lwIP when a host name lookup has finished. Only stores the address, since
+// it runs outside the main loop. Answers to abandoned lookups are ignored.
 //
-// -> address: IP address of the new time server
+// -> name: host name which was looked up
+//    ipaddr: address found, NULL if the lookup failed
 // <- --
 //---------------------------------------------------------------------------------------
-void NtpClass::setServer(IPAddress address)
+void NtpClass::lookupFound(const char *name, const ip_addr_t *ipaddr)
 {
-	this->timeServer = address;
-	this->state = NtpState::waitingForReload;
-	this->timer = NTP_RELOAD_INTERVAL - 2000;
+	if (this->lookupServer < 0 || this->lookupDone || strcmp(name, this->lookupName) != 0)
+		return;
+	this->lookupAddress = ipaddr ? ip4_addr_get_u32(ip_2_ip4(ipaddr)) : 0;
+	NTP_BARRIER();
+	this->lookupDone = true;
 }
 
 //---------------------------------------------------------------------------------------
-// getServer
+// receive
 //
-// Gets the current time server
+// Called by lwIP for each received packet. Takes the arrival time and appends the
+// packet to the queue, drops it if the queue is full. Does nothing else, since it
+// runs outside the main loop.
+//
+// -> p: received packet
+// <- --
+//---------------------------------------------------------------------------------------
+void NtpClass::receive(struct pbuf *p)
+{
+	uint64_t received = Clock.now();
+	uint32_t head = this->queueHead;
+
+	if (head - this->queueTail < NTP_QUEUE_SIZE)
+	{
+		ntp_packet &packet = this->queue[head % NTP_QUEUE_SIZE];
+		packet.received = received;
+		packet.size = p->tot_len;
+		pbuf_copy_partial(p, packet.data, NTP_PACKET_SIZE, 0);
+		NTP_BARRIER();
+		this->queueHead = head + 1;
+	}
+	else
+	{
+		this->dropCount++;
+	}
+	pbuf_free(p);
+}
+
+//---------------------------------------------------------------------------------------
+// dequeue
+//
+// Takes the oldest packet from the queue
+//
+// -> packet: receives the packet
+// <- false if the queue is empty
+//---------------------------------------------------------------------------------------
+bool NtpClass::dequeue(ntp_packet &packet)
+{
+	uint32_t tail = this->queueTail;
+	if (tail == this->queueHead) return false;
+
+	NTP_BARRIER();
+	packet = this->queue[tail % NTP_QUEUE_SIZE];
+	NTP_BARRIER();
+	this->queueTail = tail + 1;
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+// schedule
+//
+// Sets the time at which the current state times out
+//
+// -> delay: time from now in ms
+// <- --
+//---------------------------------------------------------------------------------------
+void NtpClass::schedule(uint32_t delay)
+{
+	this->deadline = millis() + delay;
+}
+
+//---------------------------------------------------------------------------------------
+// setServers
+//
+// Sets the time servers and schedules a new NTP request
+//
+// -> servers: comma separated list of host names or IP addresses, entries beyond
+//             MAX_NTP_SERVERS are ignored
+// <- --
+//---------------------------------------------------------------------------------------
+void NtpClass::setServers(const char *servers)
+{
+	this->count = 0;
+	while (*servers && this->count < MAX_NTP_SERVERS)
+	{
+		size_t length = strcspn(servers, ",");
+		if (length > 0 && length < MAX_NTP_HOSTNAME)
+		{
+			ntp_server &server = this->servers[this->count++];
+			server = ntp_server();
+			memcpy(server.name, servers, length);
+			server.name[length] = 0;
+
+			// look up at once
+			server.resolveTime = millis() - NTP_DNS_RETRY;
+		}
+		servers += length;
+		if (*servers == ',') servers++;
+	}
+
+	// a lookup still running belongs to the previous list
+	this->lookupServer = -1;
+	this->selectedServer = -1;
+	this->pending = 0;
+	this->failures = 0;
+	this->pollExponent = NTP_POLL_MIN;
+	this->stableSamples = 0;
+	this->state = NtpState::waitingForReload;
+	this->schedule(2000);
+}
+
+//---------------------------------------------------------------------------------------
+// serverCount
 //
 // -> --
-// <- IPAddress current time server
+// <- number of configured time servers
 //---------------------------------------------------------------------------------------
-IPAddress NtpClass::getServer()
+int NtpClass::serverCount()
 {
-	return this->timeServer;
+	return this->count;
+}
+
+//---------------------------------------------------------------------------------------
+// getServer
+//
+// -> index: 0 ... serverCount() - 1, in the configured order
+// <- state of the time server
+//---------------------------------------------------------------------------------------
+const ntp_server &NtpClass::getServer(int index)
+{
+	return this->servers[index];
 }
 
 //---------------------------------------------------------------------------------------
 // begin
 //
 // Initializes the class and starts the first NTP request, automatically fires callback
-// upon success, repeats every 59 minutes
+// upon success, repeats with the adaptive poll interval
 //
-// -> ip: Address of an NTP server
-//	  callback: Function to receive the current time (hours, minutes, seconds, ms)
+// -> servers: comma separated list of host names or IP addresses of NTP servers
+//	  callback: Function to receive the offset of the local clock (UTC minus local
+//	            clock in microseconds) and of the local time to UTC in seconds
 //	  timezone: Hours difference from UTC (will be added to the received time, can be
 //			    negative)
 //    DST: if true, european daylight savings time is enabled and will be automatically
 //         adjusted depending on current date
 // <- --
 //---------------------------------------------------------------------------------------
-void NtpClass::begin(IPAddress ip, TNtpCallback callback, int timezone, bool DST)
+void NtpClass::begin(const char *servers, TNtpCallback callback, int timezone, bool DST)
 {
 	this->_callback = callback;
-	this->timeServer = ip;
 	this->tz = timezone * 3600;
 	this->useDST = DST;
 
-	this->udp.begin(LOCAL_PORT);
+	if (!this->pcb)
+	{
+		this->pcb = udp_new();
+		if (!this->pcb || udp_bind(this->pcb, IP_ADDR_ANY, LOCAL_PORT) != ERR_OK)
+		{
+			Serial.println("NtpClass::begin() could not open UDP port");
+			return;
+		}
+		udp_recv(this->pcb, NtpClass::receiveWrapper, this);
+	}
 
 	// wait 2 seconds before starting first request
 	Serial.println("NtpClass::begin() Waiting 2 seconds");
-	this->state = NtpState::waitingForReload;
-	this->timer = NTP_RELOAD_INTERVAL - 2000;
+	this->setServers(servers);
 }
 
 //---------------------------------------------------------------------------------------
-// tickerFunction
+// process
 //
-// Function to be called by the timer, drives the internal state machine
+// Drives the state machine, must be called from the main loop. Handles received
+// packets, sends the requests of a round once the poll interval has passed, resolves
+// host names before (one lookup at a time, the round waits only for servers without
+// address) and selects the best reply when all servers have answered or NTP_TIMEOUT
+// has passed.
 //
 // -> --
 // <- --
 //---------------------------------------------------------------------------------------
-void NtpClass::tickerFunction()
+void NtpClass::process()
 {
-	// increment timer variable
-	this->timer += TIMER_RESOLUTION;
+	ntp_packet packet;
+	while (this->dequeue(packet)) this->parse(packet);
+	if (this->lookupServer >= 0) this->checkLookup();
+	if (this->state == NtpState::waitingForReply && this->pending == 0)
+		this->finishRound();
+
+	if ((int32_t)(millis() - this->deadline) < 0) return;
 
 	switch (this->state)
 	{
-	case NtpState::startRequest:
-		this->udp.flush(); // clear previously received data
-		this->sendPacket(); // request new time data
-		this->timer = 0;
-		this->state = NtpState::waitingForReply;
-		this->syncInProgress = true;
-		break;
+	case NtpState::waitingForReload:
+		Serial.println("NtpClass: NTP reload timer expired.");
+		this->state = NtpState::startRequest;
+		// fall through
 
-	case NtpState::waitingForReply:
-		if (this->timer >= NTP_TIMEOUT)
-		{
-			Serial.println("NtpClass: NTP request timeout");
-			this->state = NtpState::startRequest;
-		}
-		else if (udp.parsePacket() > 0)
+	case NtpState::startRequest:
+		for (int i = 0; i < this->count && this->lookupServer < 0; i++)
 		{
-			Serial.println("NtpClass: Received NTP packet");
-			this->parse();
-			if (this->_callback)
-				this->_callback(this->h, this->m, this->s, this->ms);
-			this->timer = 0;
-			this->state = NtpState::waitingForReload;
-			this->syncInProgress = false;
+			if (this->needsResolve(this->servers[i])) this->resolve(i);
 		}
+
+		// a server without address is waited for, the others keep their previous one
+		if (this->lookupServer >= 0 && !this->servers[this->lookupServer].resolved) return;
+
+		this->syncInProgress = true;
+		this->schedule(NTP_TIMEOUT);
+		if (this->sendRequests() > 0) this->state = NtpState::waitingForReply;
+		else this->finishRound();
 		break;
 
-	case NtpState::waitingForReload:
-		if (this->timer >= NTP_RELOAD_INTERVAL)
-		{
-			Serial.println("NtpClass: NTP reload timer expired.");
-			this->state = NtpState::startRequest;
-		}
+	case NtpState::waitingForReply:
+		this->finishRound();
 		break;
 
 	case NtpState::idle:
@@ -181,6 +356,280 @@ void NtpClass::tickerFunction()
 	}
 }
 
+//---------------------------------------------------------------------------------------
+// needsResolve
+//
+// -> server: time server to check
+// <- true if the address of the server should be looked up before the next request
+//---------------------------------------------------------------------------------------
+bool NtpClass::needsResolve(const ntp_server &server)
+{
+	if (server.denied) return false;
+
+	uint32_t age = millis() - server.resolveTime;
+	if (!server.resolved) return age >= NTP_DNS_RETRY;
+
+	// the server may have moved to another address
+	if (server.polls >= NTP_UNREACHABLE && (server.reach & ((1 << NTP_UNREACHABLE) - 1)) == 0)
+		return true;
+
+	return age >= NTP_DNS_TTL;
+}
+
+//---------------------------------------------------------------------------------------
+// resolve
+//
+// Starts looking up the address of a time server. IP addresses and names in the DNS
+// cache are resolved at once, otherwise checkLookup() takes the result later.
+//
+// -> index: index of the time server
+// <- --
+//---------------------------------------------------------------------------------------
+void NtpClass::resolve(int index)
+{
+	ntp_server &server = this->servers[index];
+	IPAddress ip;
+	ip_addr_t address;
+
+	server.resolveTime = millis();
+	server.polls = 0;
+	if (ip.fromString(server.name))
+	{
+		this->setAddress(server, &ip);
+		return;
+	}
+
+	strcpy(this->lookupName, server.name);
+	this->lookupDone = false;
+	this->lookupServer = index;
+	err_t result = dns_gethostbyname(server.name, &address, NtpClass::dnsWrapper, this);
+	if (result == ERR_INPROGRESS) return;
+
+	this->lookupServer = -1;
+	ip = IPAddress(ip4_addr_get_u32(ip_2_ip4(&address)));
+	this->setAddress(server, (result == ERR_OK) ? &ip : NULL);
+}
+
+//---------------------------------------------------------------------------------------
+// checkLookup
+//
+// Takes the result of the running host name lookup once the DNS callback has
+// delivered it, gives the lookup up after NTP_DNS_TIMEOUT ms
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void NtpClass::checkLookup()
+{
+	if (!this->lookupDone && millis() - this->servers[this->lookupServer].resolveTime <
+			NTP_DNS_TIMEOUT) return;
+
+	NTP_BARRIER();
+	IPAddress ip(this->lookupAddress);
+	ntp_server &server = this->servers[this->lookupServer];
+	this->lookupServer = -1;
+	this->setAddress(server, (this->lookupDone && this->lookupAddress) ? &ip : NULL);
+}
+
+//---------------------------------------------------------------------------------------
+// setAddress
+//
+// Stores the result of a lookup, keeps the previous address if it failed
+//
+// -> server: time server which was looked up
+//    ip: address found, NULL if the lookup failed
+// <- --
+//---------------------------------------------------------------------------------------
+void NtpClass::setAddress(ntp_server &server, const IPAddress *ip)
+{
+	if (ip)
+	{
+		server.ip = *ip;
+		server.resolved = true;
+		Serial.printf("NtpClass: %s is %u.%u.%u.%u\r\n", server.name, (*ip)[0], (*ip)[1],
+				(*ip)[2], (*ip)[3]);
+	}
+	else
+	{
+		Serial.printf("NtpClass: could not resolve %s%s\r\n", server.name,
+				server.resolved ? ", using previous address" : "");
+	}
+}
+
+
+
+//---------------------------------------------------------------------------------------
+// sendRequests
+//
+// Starts a round by sending a request to each usable time server
+//
+// -> --
+// <- number of requests sent
+//---------------------------------------------------------------------------------------
+int NtpClass::sendRequests()
+{
+	this->pending = 0;
+	for (int i = 0; i < this->count; i++)
+	{
+		ntp_server &server = this->servers[i];
+		server.pending = false;
+		server.answered = false;
+		if (!server.resolved || server.denied) continue;
+
+		server.reach <<= 1;
+		if (server.polls < 8) server.polls++;
+		this->sendPacket(server);
+		server.pending = true;
+		this->pending++;
+	}
+	return this->pending;
+}
+
+//---------------------------------------------------------------------------------------
+// finishRound
+//
+// Selects the best reply of the round and passes it to the callback, schedules the
+// next round
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void NtpClass::finishRound()
+{
+	int best = -1;
+	int64_t bestScore = 0;
+
+	for (int i = 0; i < this->count; i++)
+	{
+		ntp_server &server = this->servers[i];
+		if (server.pending) Serial.printf("NtpClass: no reply from %s\r\n", server.name);
+		server.pending = false;
+		if (!server.answered) continue;
+
+		int64_t score = server.delay +
+				(int64_t)(8 - __builtin_popcount(server.reach)) * NTP_REACH_PENALTY;
+		if (best < 0 || score < bestScore)
+		{
+			best = i;
+			bestScore = score;
+		}
+	}
+
+	this->pending = 0;
+	this->state = NtpState::waitingForReload;
+	this->syncInProgress = false;
+
+	if (best < 0)
+	{
+		this->failures++;
+		uint32_t wait = NTP_RETRY_MIN << std::min((int) this->failures - 1, NTP_RETRY_STEPS);
+		Serial.printf("NtpClass: no valid reply, retrying in %u s\r\n", wait / 1000);
+		this->schedule(wait);
+		return;
+	}
+
+	const ntp_server &server = this->servers[best];
+	this->failures = 0;
+	this->selectedServer = best;
+	this->offset = server.offset;
+	this->lastOffset = constrain(this->offset, (int64_t) INT_MIN, (int64_t) INT_MAX);
+	this->lastDelay = server.delay;
+	this->updateLocalOffset();
+	Serial.printf("NtpClass: %s selected, offset=%ius, delay=%ius, local time: "
+			"%02i:%02i:%02i, date: %i-%02i-%02i, weekday=%i, DST=%i\r\n",
+			server.name, this->lastOffset, this->lastDelay, h, m, s, year, month, day,
+			weekday, this->localOffset != this->tz);
+
+	this->syncCount++;
+	if (this->_callback)
+		this->_callback(this->offset, this->localOffset);
+	this->adaptPollInterval();
+	this->record();
+	this->schedule(this->getPollInterval() * 1000);
+}
+
+//---------------------------------------------------------------------------------------
+// getPollInterval
+//
+// -> --
+// <- current time between two requests in seconds
+//---------------------------------------------------------------------------------------
+uint32_t NtpClass::getPollInterval()
+{
+	return 1 << this->pollExponent;
+}
+
+//---------------------------------------------------------------------------------------
+// adaptPollInterval
+//
+// Lengthens the poll interval while the clock stays close to the server time and
+// shortens it if the offset grows, so drift is measured over long intervals once the
+// frequency correction has settled
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void NtpClass::adaptPollInterval()
+{
+	if (this->offset > -NTP_STABLE_OFFSET && this->offset < NTP_STABLE_OFFSET)
+	{
+		if (++this->stableSamples >= NTP_STABLE_SAMPLES && this->pollExponent < NTP_POLL_MAX)
+		{
+			this->pollExponent++;
+			this->stableSamples = 0;
+		}
+	}
+	else
+	{
+		this->stableSamples = 0;
+		this->pollExponent = std::max(this->pollExponent - 2, NTP_POLL_MIN);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// record
+//
+// Adds the result of the last synchronization to the history
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void NtpClass::record()
+{
+	ntp_sample &sample = this->history[this->historyNext];
+	sample.time = Clock.monotonic() / 1000000;
+	sample.offset = this->lastOffset;
+	sample.delay = this->lastDelay;
+	sample.drift = Clock.getDrift();
+	sample.poll = this->pollExponent;
+	sample.server = this->selectedServer;
+
+	this->historyNext = (this->historyNext + 1) % NTP_HISTORY_SIZE;
+	if (this->historyLength < NTP_HISTORY_SIZE) this->historyLength++;
+}
+
+//---------------------------------------------------------------------------------------
+// historyCount
+//
+// -> --
+// <- number of samples in the history
+//---------------------------------------------------------------------------------------
+int NtpClass::historyCount()
+{
+	return this->historyLength;
+}
+
+//---------------------------------------------------------------------------------------
+// getSample
+//
+// -> age: 0 = newest sample ... historyCount() - 1 = oldest sample
+// <- sample
+//---------------------------------------------------------------------------------------
+ntp_sample NtpClass::getSample(int age)
+{
+	return this->history[(this->historyNext - 1 - age + NTP_HISTORY_SIZE) % NTP_HISTORY_SIZE];
+}
+
 //---------------------------------------------------------------------------------------
 // dayOfWeek
 //
@@ -256,24 +705,133 @@ bool NtpClass::isDSTactive()
 //---------------------------------------------------------------------------------------
 // parse
 //
-// Reads the received UDP packet and decodes the current time, stores result in (this)
+// Checks a received UDP packet, matches it to the pending request of a server and
+// calculates offset and delay from the four timestamps: request sent (T1, local),
+// request received (T2, server), reply sent (T3, server) and reply received (T4,
+// local)
+//    offset = ((T2 - T1) + (T3 - T4)) / 2
+//    delay = (T4 - T1) - (T3 - T2)
+// Stores the result in the server entry if the reply passes the sanity checks.
 //
-// -> --
+// -> packet: received packet
 // <- --
 //---------------------------------------------------------------------------------------
-void NtpClass::parse()
+void NtpClass::parse(const ntp_packet &packet)
 {
-	byte buf[NTP_PACKET_SIZE];
-	bool DST = false;
+	static const uint8_t zero[8] = {0};
+	const uint8_t *buf = packet.data;
+	ntp_server *server = NULL;
 
-	Serial.print("NtpClass::parse() (");
-	Serial.print(this->timer);
+	// the server returns our transmit timestamp as originate timestamp, extension
+	// fields and a MAC may follow the 48 byte header and are ignored
+	for (int i = 0; i < this->count && packet.size >= NTP_PACKET_SIZE; i++)
+	{
+		if (this->servers[i].pending &&
+				memcmp(&buf[24], this->servers[i].originate, 8) == 0)
+		{
+			server = &this->servers[i];
+			break;
+		}
+	}
+	if (!server)
+	{
+		this->reject(NULL, "unexpected packet");
+		return;
+	}
+	server->pending = false;
+	this->pending--;
+
+	int leap = buf[0] >> 6;
+	int version = (buf[0] >> 3) & 0x07;
+	int mode = buf[0] & 0x07;
+	int stratum = buf[1];
+
+	if (mode != 4 || version < 3 || version > 4)
+	{
+		this->reject(server, "no server reply");
+		return;
+	}
+
+	// Kiss-o'-Death, the reference ID holds a code instead
+	if (stratum == 0)
+	{
+		if (memcmp(&buf[12], "DENY", 4) == 0 || memcmp(&buf[12], "RSTR", 4) == 0)
+		{
+			server->denied = true;
+			this->reject(server, "access denied");
+		}
+		else if (memcmp(&buf[12], "RATE", 4) == 0)
+		{
+			this->pollExponent = std::min(this->pollExponent + 1, NTP_POLL_MAX);
+			this->reject(server, "rate exceeded");
+		}
+		else this->reject(server, "kiss-o'-death");
+		return;
+	}
+
+	if (stratum > NTP_MAX_STRATUM || leap == 3)
+	{
+		this->reject(server, "server not synchronized");
+		return;
+	}
+	if (this->readUint32(&buf[4]) / 2 + this->readUint32(&buf[8]) > NTP_MAX_DISTANCE)
+	{
+		this->reject(server, "root distance too large");
+		return;
+	}
+	if (memcmp(&buf[32], zero, 8) == 0 || memcmp(&buf[40], zero, 8) == 0)
+	{
+		this->reject(server, "timestamp missing");
+		return;
+	}
+
+	int64_t t1 = server->requestTime;
+	int64_t t2 = this->readTimestamp(&buf[32]);
+	int64_t t3 = this->readTimestamp(&buf[40]);
+	int64_t t4 = packet.received;
+	int64_t delay = (t4 - t1) - (t3 - t2);
+	if (delay < 0 || delay > NTP_TIMEOUT * 1000)
+	{
+		this->reject(server, "invalid delay");
+		return;
+	}
+
+	server->offset = ((t2 - t1) + (t3 - t4)) / 2;
+	server->delay = delay;
+	server->answered = true;
+	server->reach |= 1;
+}
+
+//---------------------------------------------------------------------------------------
+// reject
+//
+// Counts and logs a discarded reply
+//
+// -> server: server which sent the reply, NULL if unknown
+//    reason: text for the log
+// <- --
+//---------------------------------------------------------------------------------------
+void NtpClass::reject(ntp_server *server, const char *reason)
+{
+	this->rejectCount++;
+	Serial.printf("NtpClass: reply from %s rejected, %s\r\n",
+			server ? server->name : "unknown server", reason);
+}
 
-	this->udp.read(buf, NTP_PACKET_SIZE);
-	this->udp.flush(); // discard additional data
-	unsigned long highWord = word(buf[40], buf[41]);
-	unsigned long lowWord = word(buf[42], buf[43]);
-	unsigned long secsSince1970 = (highWord << 16 | lowWord) - 2208988800ULL;
+//---------------------------------------------------------------------------------------
+// updateLocalOffset
+//
+// Calculates the current date and local time from the offset of the last
+// synchronization and the offset of the local time to UTC (time zone and DST).
+// Results are placed in (this).
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void NtpClass::updateLocalOffset()
+{
+	unsigned long secsSince1970 = (Clock.now() + this->offset) / 1000000;
+	this->localOffset = this->tz;
 
 	// calculate date and time from timestamp
 	this->decodeTime(secsSince1970 + this->tz);
@@ -283,30 +841,79 @@ void NtpClass::parse()
 	if(this->useDST)
 	{
 		// check if we are inside DST window
-		DST = this->isDSTactive();
-		if(DST)
+		if(this->isDSTactive())
 		{
 			// decode date/time again using DST offset
 			this->decodeTime(secsSince1970 + this->tz + 3600);
+			this->localOffset += 3600;
 		}
 	}
-	Serial.printf("ms), local time: %02i:%02i:%02i, date: %i-%02i-%02i, "
-			"weekday=%i, DST=%i\r\n", h, m, s, year, month, day, weekday, DST);
 }
 
 //---------------------------------------------------------------------------------------
-// sendNTPpacket
+// readUint32
+//
+// -> buf: first byte of a 32 bit big endian value
+// <- value
+//---------------------------------------------------------------------------------------
+uint32_t NtpClass::readUint32(const uint8_t *buf)
+{
+	return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | (buf[2] << 8) | buf[3];
+}
+
+//---------------------------------------------------------------------------------------
+// readTimestamp
+//
+// Converts an NTP timestamp (seconds since 1900 and 32 bit fraction, big endian)
+//
+// -> buf: first byte of the timestamp
+// <- UTC in microseconds since 1970
+//---------------------------------------------------------------------------------------
+uint64_t NtpClass::readTimestamp(const uint8_t *buf)
+{
+	uint32_t seconds = this->readUint32(buf);
+	uint32_t fraction = this->readUint32(&buf[4]);
+	return (uint64_t)(seconds - 2208988800UL) * 1000000 +
+			(((uint64_t) fraction * 1000000) >> 32);
+}
+
+//---------------------------------------------------------------------------------------
+// writeTimestamp
+//
+// Converts a time to an NTP timestamp (seconds since 1900 and 32 bit fraction, big
+// endian)
+//
+// -> buf: first byte of the timestamp
+//    time: microseconds since 1970
+// <- --
+//---------------------------------------------------------------------------------------
+void NtpClass::writeTimestamp(uint8_t *buf, uint64_t time)
+{
+	uint32_t seconds = time / 1000000 + 2208988800UL;
+	uint32_t fraction = ((uint64_t)(time % 1000000) << 32) / 1000000;
+	for (int i = 0; i < 4; i++)
+	{
+		buf[i] = seconds >> (24 - i * 8);
+		buf[i + 4] = fraction >> (24 - i * 8);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// sendPacket
 //
 // Requests time from an NTP server
 //
-// -> --
+// -> server: time server, receives the time and timestamp of the request
 // <- --
 //---------------------------------------------------------------------------------------
-void NtpClass::sendPacket()
+void NtpClass::sendPacket(ntp_server &server)
 {
-	uint8_t buf[NTP_PACKET_SIZE];
+	struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, NTP_PACKET_SIZE, PBUF_RAM);
+	if (!p) return;
+	uint8_t *buf = (uint8_t*) p->payload;
+	ip_addr_t address;
 
-	Serial.println("NtpClass::sendPacket()");
+	Serial.printf("NtpClass::sendPacket() %s\r\n", server.name);
 	memset(buf, 0, NTP_PACKET_SIZE);
 	buf[0] = 0b11100011;
 	buf[1] = 0;
@@ -316,11 +923,15 @@ void NtpClass::sendPacket()
 	buf[13] = 0x4E;
 	buf[14] = 49;
 	buf[15] = 52;
-	this->udp.beginPacket(this->timeServer, 123);
-	this->udp.write(buf, NTP_PACKET_SIZE);
-	this->udp.endPacket();
 
-	this->timer = 0;
+	// the server returns the transmit timestamp unchanged, T1 of the offset calculation
+	server.requestTime = Clock.now();
+	this->writeTimestamp(&buf[40], server.requestTime);
+	memcpy(server.originate, &buf[40], sizeof(server.originate));
+
+	IP_ADDR4(&address, server.ip[0], server.ip[1], server.ip[2], server.ip[3]);
+	udp_sendto(this->pcb, p, &address, 123);
+	pbuf_free(p);
 }
 
 //---------------------------------------------------------------------------------------
@@ -335,7 +946,7 @@ void NtpClass::sendPacket()
 void NtpClass::setTimeZone(int timeZone)
 {
 	this->tz = timeZone * 3600;
-	this->timer = NTP_RELOAD_INTERVAL - 1000;
+	if (this->state == NtpState::waitingForReload) this->schedule(1000);
 }
 
 //---------------------------------------------------------------------------------------
@@ -22,24 +22,112 @@
 #define _NTP_H_
 
 #include <stdint.h>
-#include <Ticker.h>
-#include <WiFiUdp.h>
+#include <IPAddress.h>
+#include <lwip/udp.h>
 
-// type definition for NTP callback
-typedef void (*TNtpCallback)(uint8_t, uint8_t, uint8_t, uint8_t);
+#include "config.h"
+
+// type definition for NTP callback, receives the offset of the local clock in
+// microseconds (UTC minus local clock) and the seconds the local time is ahead of UTC
+typedef void (*TNtpCallback)(int64_t, int32_t);
+
+// range of the poll interval as power of 2 in seconds (64 s ... 68 min)
+#define NTP_POLL_MIN 6
+#define NTP_POLL_MAX 12
+
+// number of samples kept for statistics
+#define NTP_HISTORY_SIZE 32
+
+// size of an NTP packet without extension fields, number of received packets which
+// can wait for the main loop (power of 2)
+#define NTP_PACKET_SIZE 48
+#define NTP_QUEUE_SIZE 8
+
+// packet as received by the UDP callback
+typedef struct _ntp_packet
+{
+	// UTC in microseconds when the packet arrived (T4), size of the UDP payload of
+	// which only the first NTP_PACKET_SIZE bytes are kept
+	uint64_t received;
+	uint16_t size;
+	uint8_t data[NTP_PACKET_SIZE];
+} ntp_packet;
+
+// state of a configured server
+typedef struct _ntp_server
+{
+	// host name or IP address as configured, the address it resolved to (kept while
+	// the name can not be resolved again) and time of the last lookup
+	char name[MAX_NTP_HOSTNAME];
+	IPAddress ip;
+	bool resolved;
+	uint32_t resolveTime;
+
+	// one bit for each of the last 8 requests, set if a valid reply was received
+	// (newest in bit 0), number of requests sent since the last lookup (up to 8)
+	uint8_t reach;
+	uint8_t polls;
+
+	// server asked not to be queried any more (Kiss-o'-Death DENY or RSTR)
+	bool denied;
+
+	// request of the current round: local send time and transmit timestamp as sent,
+	// reply received and its offset and delay in us
+	bool pending;
+	bool answered;
+	uint64_t requestTime;
+	uint8_t originate[8];
+	int64_t offset;
+	int32_t delay;
+} ntp_server;
+
+// result of a synchronization
+typedef struct _ntp_sample
+{
+	// seconds since boot
+	uint32_t time;
+
+	// offset and delay in us, frequency correction of the clock afterwards in ppb
+	int32_t offset;
+	int32_t delay;
+	int32_t drift;
+
+	// poll interval as power of 2 in seconds, index of the server
+	uint8_t poll;
+	uint8_t server;
+} ntp_sample;
 
 class NtpClass
 {
 public:
 	// public methods
-	NtpClass();
-	void begin(IPAddress ip, TNtpCallback callback, int timezone, bool DST);
-	void setServer(IPAddress address);
-	IPAddress getServer();
+	void begin(const char *servers, TNtpCallback callback, int timezone, bool DST);
+	void process();
+	void setServers(const char *servers);
+	int serverCount();
+	const ntp_server &getServer(int index);
 	void setTimeZone(int timeZone);
+	uint32_t getPollInterval();
+	int historyCount();
+	ntp_sample getSample(int age);
 
 	// public members
 	bool syncInProgress = false;
+	uint32_t syncCount = 0;
+
+	// result of the last synchronization in microseconds: error of the local clock
+	// (server time minus local time, saturated, the first synchronization after boot
+	// exceeds the range) and round trip delay without the server's processing time,
+	// server it was taken from, number of replies discarded by the sanity checks and
+	// number of consecutive rounds without any valid reply
+	int32_t lastOffset = 0;
+	int32_t lastDelay = 0;
+	int selectedServer = -1;
+	uint32_t rejectCount = 0;
+	uint32_t failures = 0;
+
+	// number of packets dropped because the queue was full
+	volatile uint32_t dropCount = 0;
 
 private:
 	enum class NtpState
@@ -48,20 +136,56 @@ private:
 	};
 
 	int lastSunday(int year, int month, int lastDayInMonth);
-	static void tickerFunctionWrapper(NtpClass *obj);
+	static void receiveWrapper(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+			const ip_addr_t *addr, uint16_t port);
+	static void dnsWrapper(const char *name, const ip_addr_t *ipaddr, void *arg);
+	void lookupFound(const char *name, const ip_addr_t *ipaddr);
 	int dayOfWeek(int y, int m, int d);
 	void decodeTime(long long t);
-	void tickerFunction();
+	uint32_t readUint32(const uint8_t *buf);
+	uint64_t readTimestamp(const uint8_t *buf);
+	void writeTimestamp(uint8_t *buf, uint64_t time);
+	void receive(struct pbuf *p);
+	bool dequeue(ntp_packet &packet);
+	void schedule(uint32_t delay);
 	bool isDSTactive();
-	void sendPacket();
-	void parse();
+	bool needsResolve(const ntp_server &server);
+	void resolve(int index);
+	void checkLookup();
+	void setAddress(ntp_server &server, const IPAddress *ip);
+	int sendRequests();
+	void sendPacket(ntp_server &server);
+	void parse(const ntp_packet &packet);
+	void reject(ntp_server *server, const char *reason);
+	void finishRound();
+	void updateLocalOffset();
+	void adaptPollInterval();
+	void record();
 
-	IPAddress timeServer;
-	Ticker ticker;
-	WiFiUDP udp;
+	ntp_server servers[MAX_NTP_SERVERS];
+	int count = 0;
+	int pending = 0;
+	struct udp_pcb *pcb = NULL;
 	NtpState state = NtpState::idle;
 	TNtpCallback _callback = NULL;
-	int timer = 0;
+
+	// millis() at which the current state times out
+	uint32_t deadline = 0;
+
+	// host name lookup in progress: index of the server (-1 if none) and its name,
+	// set by the DNS callback when the lookup has finished with the address found
+	// (0 if it failed)
+	int lookupServer = -1;
+	char lookupName[MAX_NTP_HOSTNAME];
+	volatile bool lookupDone = false;
+	volatile uint32_t lookupAddress = 0;
+
+	// received packets, written by the UDP callback only (queueHead) and read by
+	// process() only (queueTail), each index increments once per packet
+	ntp_packet queue[NTP_QUEUE_SIZE];
+	volatile uint32_t queueHead = 0;
+	volatile uint32_t queueTail = 0;
+
 	int h = 0;
 	int m = 0;
 	int s = 0;
@@ -70,9 +194,20 @@ private:
 	int day = 0;
 	int weekday = 0;
 	int yearday = 0;
-	int ms = 0;
 	int tz = 0;
 	bool useDST = false;
+	int32_t localOffset = 0;
+	int64_t offset = 0;
+
+	// poll interval as power of 2 in seconds, number of consecutive samples with small
+	// offset (lengthens the interval)
+	int pollExponent = NTP_POLL_MIN;
+	int stableSamples = 0;
+
+	// ring buffer of the last samples, historyNext is the index of the next sample
+	ntp_sample history[NTP_HISTORY_SIZE];
+	int historyNext = 0;
+	int historyLength = 0;
 };
 
 extern NtpClass NTP;
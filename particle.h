@@ -37,7 +37,7 @@ public:
 	bool alive;
 
 	Particle(float x, float y, float vx, float vy, int delay);
-	virtual ~Particle();
+	~Particle();
 
 	void render(uint8_t *target, palette_entry palette[]);
 	float distance();
@@ -0,0 +1,210 @@
+// ESP8266 Wordclock
+// Copyright (C) 2016 Thoralt Franz, https://github.com/thoralt
+//
+//  This class decodes pixel frames received on the serial port, so the clock can be
+//  driven by ambient light software over USB. Two framings are accepted:
+//   - Adalight: "Ada", LED count - 1 (16 bit, big endian), checksum (count high byte
+//     ^ count low byte ^ 0x55), then r, g, b for each LED
+//   - TPM2: 0xC9, 0xDA (data frame), payload size (16 bit, big endian), payload,
+//     0x36 as end byte
+//  Pixels are expected in display order (rows from top left, then the four corners).
+//  The main loop passes every received byte to decode(), which advances the decoder
+//  by that single byte, so a partial frame never delays rendering. Complete frames
+//  are collected in a separate buffer and only copied to the LED buffer once the
+//  checksum or end byte has been verified, a frame is therefore never shown half
+//  updated. While frames arrive the main loop shows DisplayMode::stream, after
+//  Config.streamTimeout ms without a frame the clock is shown again. Bytes which do
+//  not start a frame are left to the serial command handler unless frames are being
+//  received, stray bytes between frames are dropped then. After a corrupted frame
+//  the rest of it is dropped as well until the start of the next frame is found or
+//  the line has been silent for SERIAL_FRAME_TIMEOUT ms, so pixel data never ends up
+//  in the command handler.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <Arduino.h>
+#include "serialstream.h"
+#include "ledfunctions.h"
+
+//---------------------------------------------------------------------------------------
+// global instance
+//---------------------------------------------------------------------------------------
+SerialStreamClass SerialStream = SerialStreamClass();
+
+// TPM2 framing bytes
+#define TPM2_START 0xC9
+#define TPM2_TYPE_DATA 0xDA
+#define TPM2_END 0x36
+
+// time in ms after which an incomplete frame is discarded
+#define SERIAL_FRAME_TIMEOUT 100
+
+//---------------------------------------------------------------------------------------
+// SerialStreamClass
+//
+// Constructor, clears the frame buffer
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+SerialStreamClass::SerialStreamClass()
+{
+	memset(this->frame, 0, sizeof(this->frame));
+}
+
+//---------------------------------------------------------------------------------------
+// decode
+//
+// Advances the decoder by one received byte
+//
+// -> c: received byte
+// <- false if the byte is not part of a frame and should be handled as command
+//---------------------------------------------------------------------------------------
+bool SerialStreamClass::decode(uint8_t c)
+{
+	uint32_t now = millis();
+
+	// a frame interrupted by lost bytes would swallow the start of the next one, after
+	// a pause commands are accepted again
+	if(this->state != State::idle && now - this->lastByte > SERIAL_FRAME_TIMEOUT)
+	{
+		if(this->state != State::discard) this->errors++;
+		this->state = State::idle;
+	}
+	this->lastByte = now;
+
+	switch(this->state)
+	{
+	case State::idle:
+	case State::discard:
+		if(c == 'A') this->state = State::adaD;
+		else if(c == TPM2_START) this->state = State::tpm2Type;
+		else if(this->state == State::idle) return this->isActive();
+		break;
+
+	case State::adaD:
+		if(c == 'd') this->state = State::adaA;
+		else this->fail();
+		break;
+
+	case State::adaA:
+		if(c == 'a') this->state = State::adaCountHigh;
+		else this->fail();
+		break;
+
+	case State::adaCountHigh:
+		this->countHigh = c;
+		this->state = State::adaCountLow;
+		break;
+
+	case State::adaCountLow:
+		this->countLow = c;
+		this->state = State::adaChecksum;
+		break;
+
+	case State::adaChecksum:
+		if(c != (this->countHigh ^ this->countLow ^ 0x55))
+		{
+			this->fail();
+			break;
+		}
+		this->length = (((this->countHigh << 8) | this->countLow) + 1) * 3;
+		this->received = 0;
+		this->state = State::adaData;
+		break;
+
+	case State::adaData:
+		if(this->received < sizeof(this->frame)) this->frame[this->received] = c;
+		if(++this->received >= this->length) this->commit();
+		break;
+
+	case State::tpm2Type:
+		if(c == TPM2_TYPE_DATA) this->state = State::tpm2SizeHigh;
+		else this->fail();
+		break;
+
+	case State::tpm2SizeHigh:
+		this->length = c << 8;
+		this->state = State::tpm2SizeLow;
+		break;
+
+	case State::tpm2SizeLow:
+		this->length |= c;
+		this->received = 0;
+		this->state = this->length ? State::tpm2Data : State::tpm2End;
+		break;
+
+	case State::tpm2Data:
+		if(this->received < sizeof(this->frame)) this->frame[this->received] = c;
+		if(++this->received >= this->length) this->state = State::tpm2End;
+		break;
+
+	case State::tpm2End:
+		if(c == TPM2_END) this->commit();
+		else this->fail();
+		break;
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+// isActive
+//
+// -> --
+// <- true while frames are received, the main loop shows DisplayMode::stream then
+//---------------------------------------------------------------------------------------
+bool SerialStreamClass::isActive()
+{
+	if(this->active && millis() - this->lastFrame > (uint32_t) Config.streamTimeout)
+		this->active = false;
+	return this->active;
+}
+
+//---------------------------------------------------------------------------------------
+// commit
+//
+// Copies the completely received frame to the LED buffer
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void SerialStreamClass::commit()
+{
+	uint32_t pixels = this->received / 3;
+	if(pixels > NUM_PIXELS) pixels = NUM_PIXELS;
+	for(uint32_t i = 0; i < pixels; i++)
+	{
+		LED.setPixel(i, this->frame[i * 3 + 0], this->frame[i * 3 + 1],
+				this->frame[i * 3 + 2]);
+	}
+
+	this->frames++;
+	this->lastFrame = millis();
+	this->active = true;
+	this->state = State::idle;
+}
+
+//---------------------------------------------------------------------------------------
+// fail
+//
+// Discards the frame being received. The remaining bytes of the frame are dropped
+// until the start of the next one or a pause of SERIAL_FRAME_TIMEOUT ms.
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void SerialStreamClass::fail()
+{
+	this->errors++;
+	this->state = State::discard;
+}
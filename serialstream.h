@@ -0,0 +1,67 @@
+// ESP8266 Wordclock
+// Copyright (C) 2016 Thoralt Franz, https://github.com/thoralt
+//
+//  See serialstream.cpp for description.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _SERIALSTREAM_H_
+#define _SERIALSTREAM_H_
+
+#include <stdint.h>
+
+#include "config.h"
+
+// baud rate of the serial port and size of its receive buffer, which has to hold the
+// bytes arriving during one main loop
+#define SERIAL_BAUD 460800
+#define SERIAL_RX_BUFFER 1024
+
+class SerialStreamClass
+{
+public:
+	SerialStreamClass();
+	bool decode(uint8_t c);
+	bool isActive();
+
+	// frames taken over into the LED buffer and frames with a bad checksum, end byte
+	// or header
+	uint32_t frames = 0;
+	uint32_t errors = 0;
+
+private:
+	enum class State
+	{
+		idle, discard, adaD, adaA, adaCountHigh, adaCountLow, adaChecksum, adaData,
+		tpm2Type, tpm2SizeHigh, tpm2SizeLow, tpm2Data, tpm2End
+	};
+
+	State state = State::idle;
+	uint8_t countHigh = 0;
+	uint8_t countLow = 0;
+	uint32_t length = 0;
+	uint32_t received = 0;
+	bool active = false;
+	uint32_t lastFrame = 0;
+	uint32_t lastByte = 0;
+
+	// frame being received, in display order
+	uint8_t frame[NUM_PIXELS * 3];
+
+	void commit();
+	void fail();
+};
+
+extern SerialStreamClass SerialStream;
+
+#endif
@@ -37,10 +37,11 @@ StarObject::StarObject()
 // Assigns new random coordinates and speed, retries until new coordinates have a
 // distance of minimum 2 LEDs.
 //
-// -> allStars: Reference to outer container for distance calculation to other stars
+// -> allStars: Array with all stars for distance calculation to other stars
+//    count: Number of stars in allStars
 // <- --
 //---------------------------------------------------------------------------------------
-void StarObject::randomize(std::vector<StarObject> &allStars)
+void StarObject::randomize(StarObject *allStars, int count)
 {
 	// set coordinates of self to default value
 	this->x = -1;
@@ -61,8 +62,10 @@ void StarObject::randomize(std::vector<StarObject> &allStars)
 		retryCount++;
 
 		// iterate over all other stars and check distance to newly generated coordinate
-		for (StarObject s : allStars)
+		for (int i = 0; i < count; i++)
 		{
+			StarObject &s = allStars[i];
+
 			// skip if default value
 			if (s.x == -1) continue;
 
@@ -91,11 +94,12 @@ void StarObject::randomize(std::vector<StarObject> &allStars)
 // Updates the state of the star object. Increases brightness up to maximum, then
 // decreases to zero, then randomizes to new coordinates and speed and starts again.
 //
-// -> allStars: Reference to vector containing all stars, necessary for distance
-//              calculation when creating new random position
+// -> allStars: Array containing all stars, necessary for distance calculation when
+//              creating new random position
+//    count: Number of stars in allStars
 // <- --
 //---------------------------------------------------------------------------------------
-void StarObject::update(std::vector<StarObject> &allStars)
+void StarObject::update(StarObject *allStars, int count)
 {
 	// increase or decrease brightness depending on current state
 	if (this->state == 0)
@@ -116,7 +120,7 @@ void StarObject::update(std::vector<StarObject> &allStars)
 			// switch to increasing mode and get new random coordinates
 			this->brightness = 0;
 			this->state = 0;
-			this->randomize(allStars);
+			this->randomize(allStars, count);
 		}
 	}
 }
@@ -127,13 +131,14 @@ void StarObject::update(std::vector<StarObject> &allStars)
 // Updates own status (see StarObject::update()) and renders self to buffer.
 //
 // -> buf: RGB buffer for LED colors
-//    allStars: Reference to vector containing all stars, necessary for distance
-//              calculation when creating new random position
+//    allStars: Array containing all stars, necessary for distance calculation when
+//              creating new random position
+//    count: Number of stars in allStars
 // <- --
 //---------------------------------------------------------------------------------------
-void StarObject::render(uint8_t* buf, std::vector<StarObject> &allStars)
+void StarObject::render(uint8_t* buf, StarObject *allStars, int count)
 {
-	this->update(allStars);
+	this->update(allStars, count);
 
 	// write brightness to target buffer
 	int offset = LEDFunctionsClass::getOffset(this->x, this->y);
@@ -19,15 +19,14 @@
 #ifndef STAROBJECT_H_
 #define STAROBJECT_H_
 
-#include <vector>
 #include <stdint.h>
 
 class StarObject
 {
 public:
 	StarObject();
-	void render(uint8_t *buf, std::vector<StarObject> &allStars);
-	void randomize(std::vector<StarObject> &allStars);
+	void render(uint8_t *buf, StarObject *allStars, int count);
+	void randomize(StarObject *allStars, int count);
 
 private:
 	const static int minimumDistanceSquared = 5;
@@ -37,7 +36,7 @@ private:
 	int count = 0;
 	int brightness = 0;
 	int state = 0;
-	void update(std::vector<StarObject> &allStars);
+	void update(StarObject *allStars, int count);
 };
 
 #endif /* STAROBJECT_H_ */
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+# ESP8266 Wordclock
+# Copyright (C) 2016 Thoralt Franz, https://github.com/thoralt
+#
+#  Checks that web requests do not allocate heap memory, e. g.
+#    tools/alloc_test.py wordclock.local --repeat 10
+#  The firmware has to be compiled with -DWEB_COUNT_ALLOCATIONS and linked with
+#  -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc, otherwise nothing is counted and
+#  the test passes trivially. Requests a set of read-only routes, then compares the
+#  per-route "allocs" of /webstats and the total "allocations" of /info before and
+#  after. Every counted allocation belongs to a request of its route, so each of them
+#  is reported and the exit code is 1 if there was any.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+import argparse
+import json
+import sys
+import urllib.request
+
+# routes without side effects, static files are counted under "*"
+PATHS = ('/info', '/getcolors', '/getheartbeat', '/getntpserver', '/getadc', '/getmode',
+         '/gettimezone', '/getpalette?name=fire', '/getcalibration', '/getpower',
+         '/getlightcurve', '/lighthistory?level=0', '/lighthistory?level=0&format=bin',
+         '/api/state', '/webstats', '/ntpstats', '/', '/index.css')
+
+
+def get(host, path):
+    with urllib.request.urlopen('http://%s%s' % (host, path), timeout=10) as reply:
+        return reply.read()
+
+
+def route_allocs(host):
+    stats = json.loads(get(host, '/webstats'))
+    return {route['path']: route['allocs'] for route in stats['routes']}
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Checks that web requests do not '
+                                     'allocate heap memory')
+    parser.add_argument('host', help='host name or IP address of the clock')
+    parser.add_argument('--repeat', type=int, default=3,
+                        help='number of requests per route')
+    args = parser.parse_args()
+
+    before = route_allocs(args.host)
+    total = json.loads(get(args.host, '/info'))['allocations']
+    for _ in range(args.repeat):
+        for path in PATHS:
+            get(args.host, path)
+    total = json.loads(get(args.host, '/info'))['allocations'] - total
+    after = route_allocs(args.host)
+
+    failed = False
+    for path in sorted(after):
+        allocs = after[path] - before.get(path, 0)
+        if allocs:
+            print('%s: %d allocations' % (path, allocs))
+            failed = True
+    if total:
+        print('/info: %d allocations in total' % total)
+        failed = True
+    print('FAILED' if failed else 'OK')
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,28 @@
+#!/bin/sh
+# ESP8266 Wordclock
+# Copyright (C) 2016 Thoralt Franz, https://github.com/thoralt
+#
+#  Creates gzip compressed copies of the web interface files in data/. Run this
+#  before uploading the file system image; the web server sends the compressed copy
+#  to every browser which accepts it and falls back to the plain file otherwise.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+set -e
+cd "$(dirname "$0")/../data"
+for f in *.html *.css *.js; do
+	[ -f "$f" ] || continue
+	# -n omits name and time stamp, so unchanged files keep their entity tag
+	gzip -9 -n -c "$f" > "$f.gz"
+	echo "$f: $(wc -c < "$f") -> $(wc -c < "$f.gz") bytes"
+done
@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+# ESP8266 Wordclock
+# Copyright (C) 2016 Thoralt Franz, https://github.com/thoralt
+#
+#  Minimal NTP server to test the time synchronization of the clock, e. g.
+#    sudo tools/ntp_server.py --offset 2.5 --delay 40
+#  and set the IP address of the computer as NTP server in the web interface. The
+#  server time is the system time shifted by --offset seconds, --delay adds network
+#  delay in ms (half before receiving, half before sending, like a symmetric link), so
+#  the clock should report a delay of about --delay ms and show the shifted time to
+#  the millisecond. Each reply is logged with the timestamps of the request.
+#  Several instances on the local addresses 127.0.0.x (--address) stand in for a list
+#  of servers; --leap 3 (unsynchronized) and --kod DENY, RSTR or RATE (Kiss-o'-Death)
+#  send replies the clock has to reject.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+import argparse
+import socket
+import struct
+import time
+
+NTP_EPOCH = 2208988800
+
+
+def timestamp(t):
+    seconds = int(t)
+    return struct.pack('>II', (seconds + NTP_EPOCH) & 0xFFFFFFFF,
+                       int((t - seconds) * (1 << 32)) & 0xFFFFFFFF)
+
+
+def reply(request, received, transmit, stratum, leap=0, kod=None):
+    # version 4, mode 4 (server), poll copied from the request; a Kiss-o'-Death reply
+    # has stratum 0 and the code as reference ID
+    refid = b'LOCL'
+    if kod:
+        stratum = 0
+        refid = kod.encode('ascii')[:4].ljust(4)
+    return (struct.pack('>BBbbII', (leap << 6) | 0x24, stratum, request[2], -20, 0, 0) +
+            refid + timestamp(received) + request[40:48] + timestamp(received) +
+            timestamp(transmit))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Minimal NTP server for testing')
+    parser.add_argument('--address', default='', help='local address to bind to')
+    parser.add_argument('--port', type=int, default=123)
+    parser.add_argument('--offset', type=float, default=0, help='seconds added to the system time')
+    parser.add_argument('--delay', type=float, default=0, help='simulated round trip delay in ms')
+    parser.add_argument('--stratum', type=int, default=1)
+    parser.add_argument('--leap', type=int, default=0, choices=range(4),
+                        help='leap indicator, 3 = not synchronized')
+    parser.add_argument('--kod', help='reply with this Kiss-o\'-Death code')
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind((args.address, args.port))
+    while True:
+        request, address = sock.recvfrom(512)
+        if len(request) < 48:
+            continue
+        # half of the delay on the way to the server, half on the way back
+        time.sleep(args.delay / 2000)
+        received = time.time() + args.offset
+        packet = reply(request, received, time.time() + args.offset, args.stratum,
+                       args.leap, args.kod)
+        time.sleep(args.delay / 2000)
+        sock.sendto(packet, address)
+        print('%s: originate %s, receive %.6f' % (address[0], request[40:48].hex(),
+                                                 received))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+# ESP8266 Wordclock
+# Copyright (C) 2016 Thoralt Franz, https://github.com/thoralt
+#
+#  Sends a moving test pattern to the UDP or serial pixel input of the clock, e. g.
+#    tools/stream_test.py 192.168.178.95 --protocol e131 --universe 1 --fps 44
+#    tools/stream_test.py /dev/ttyUSB0 --protocol adalight
+#  Stop it with Ctrl+C, the clock returns to the time display after the configured
+#  stream timeout (E1.31 sends a stream termination packet instead). For the serial
+#  protocols the target may also be a pty to test a decoder on the host.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+import argparse
+import os
+import socket
+import struct
+import termios
+import time
+
+NUM_PIXELS = 114
+PORTS = {'artnet': 6454, 'e131': 5568, 'ddp': 4048}
+SERIAL_PROTOCOLS = ('adalight', 'tpm2')
+SERIAL_BAUD = termios.B460800
+
+
+def artnet(data, universe, sequence):
+    return (b'Art-Net\0' + struct.pack('<H', 0x5000) + struct.pack('>HBBHH', 14,
+            sequence, 0, universe, len(data)) + data)
+
+
+def e131(data, universe, sequence, options=0):
+    dmp = struct.pack('>HBBHHH', 0x7000 | (10 + len(data) + 1), 0x02, 0xa1, 0, 1,
+                      len(data) + 1) + b'\0' + data
+    framing = (struct.pack('>HI', 0x7000 | (77 + len(dmp)), 0x02) +
+               b'wordclock stream_test'.ljust(64, b'\0') +
+               struct.pack('>BHBBH', 100, 0, sequence, options, universe) + dmp)
+    return (struct.pack('>HH', 0x10, 0) + b'ASC-E1.17\0\0\0' +
+            struct.pack('>HI', 0x7000 | (22 + len(framing)), 0x04) + bytes(16) + framing)
+
+
+def ddp(data, universe, sequence):
+    return struct.pack('>BBBBIH', 0x41, sequence & 0x0F, 0x0B, 1, 0, len(data)) + data
+
+
+def adalight(data, universe, sequence):
+    count = len(data) // 3 - 1
+    high, low = count >> 8, count & 0xFF
+    return b'Ada' + bytes((high, low, high ^ low ^ 0x55)) + data
+
+
+def tpm2(data, universe, sequence):
+    return struct.pack('>BBH', 0xC9, 0xDA, len(data)) + data + b'\x36'
+
+
+def open_serial(path):
+    fd = os.open(path, os.O_WRONLY | os.O_NOCTTY)
+    if os.isatty(fd):
+        attr = termios.tcgetattr(fd)
+        attr[0] = attr[1] = attr[3] = 0
+        attr[2] = termios.CS8 | termios.CREAD | termios.CLOCAL
+        attr[4] = attr[5] = SERIAL_BAUD
+        termios.tcsetattr(fd, termios.TCSANOW, attr)
+    return lambda packet: os.write(fd, packet)
+
+
+def frame(t):
+    # dim rainbow with a bright column moving from left to right
+    column = (t // 3) % 11
+    data = bytearray()
+    for i in range(NUM_PIXELS):
+        x = i % 11 if i < 110 else (0, 10, 10, 0)[i - 110]
+        hue = (x * 23 + t * 4) % 256
+        data += bytes((255, 255, 255) if x == column else (hue // 4, (255 - hue) // 4, 16))
+    return bytes(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Sends a test pattern to the pixel input')
+    parser.add_argument('host', help='IP address of the clock (127.0.0.1 for a local '
+                        'receiver) or serial device for adalight and tpm2')
+    parser.add_argument('--protocol', choices=list(PORTS) + list(SERIAL_PROTOCOLS),
+                        default='artnet')
+    parser.add_argument('--universe', type=int, default=1)
+    parser.add_argument('--fps', type=float, default=44)
+    args = parser.parse_args()
+
+    encode = {'artnet': artnet, 'e131': e131, 'ddp': ddp, 'adalight': adalight,
+              'tpm2': tpm2}[args.protocol]
+    if args.protocol in SERIAL_PROTOCOLS:
+        send = open_serial(args.host)
+    else:
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        target = (args.host, PORTS[args.protocol])
+        send = lambda packet: sock.sendto(packet, target)
+    t = 0
+    try:
+        while True:
+            send(encode(frame(t), args.universe, t & 0xFF))
+            t += 1
+            time.sleep(1 / args.fps)
+    except KeyboardInterrupt:
+        if args.protocol == 'e131':
+            send(e131(frame(t), args.universe, t & 0xFF, 0x40))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,303 @@
+// ESP8266 Wordclock
+// Copyright (C) 2016 Thoralt Franz, https://github.com/thoralt
+//
+//  This class receives pixel data from lighting controllers over UDP, so the clock can
+//  be used as a fixture of 114 RGB pixels in display order (rows from top left, then
+//  the four corners, 3 channels each). Supported protocols:
+//   - Art-Net (ArtDmx, port 6454) for the port address Config.streamUniverse
+//   - E1.31 / sACN (port 5568, unicast or multicast) for universe Config.streamUniverse
+//   - DDP (port 4048), data offset in bytes, any destination id
+//  The pixel data of each packet is read straight from the receive buffer into
+//  LEDFunctionsClass::currentValues through the mapping table and the calibration.
+//  While packets arrive the main loop shows them with DisplayMode::stream; after
+//  Config.streamTimeout ms of silence (or an E1.31 stream termination) the clock is
+//  shown again. At most UDPSTREAM_PACKETS_MAX packets per port are handled per main
+//  loop, so a flood of packets can not starve NTP and the web server.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <Arduino.h>
+#include "udpstream.h"
+#include "ledfunctions.h"
+
+//---------------------------------------------------------------------------------------
+// global instance
+//---------------------------------------------------------------------------------------
+UdpStreamClass UdpStream = UdpStreamClass();
+
+// packet identifiers
+static const uint8_t artnetId[8] = {'A', 'r', 't', '-', 'N', 'e', 't', 0};
+static const uint8_t e131Id[12] = {'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0};
+
+// header sizes
+#define ARTNET_HEADER_SIZE 18
+#define E131_HEADER_SIZE 126
+#define DDP_HEADER_SIZE 10
+
+// DDP flags
+#define DDP_FLAG_VERSION_MASK 0xC0
+#define DDP_FLAG_VERSION_1 0x40
+#define DDP_FLAG_TIMECODE 0x10
+#define DDP_FLAG_STORAGE 0x08
+#define DDP_FLAG_REPLY 0x04
+#define DDP_FLAG_QUERY 0x02
+#define DDP_FLAG_PUSH 0x01
+
+// E1.31 options
+#define E131_OPTION_PREVIEW 0x80
+#define E131_OPTION_TERMINATED 0x40
+
+//---------------------------------------------------------------------------------------
+// UdpStreamClass
+//
+// Constructor, currently empty
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+UdpStreamClass::UdpStreamClass()
+{
+}
+
+//---------------------------------------------------------------------------------------
+// begin
+//
+// Opens the UDP ports, must be called after the WiFi connection has been established
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void UdpStreamClass::begin()
+{
+	this->artnet.begin(UDPSTREAM_PORT_ARTNET);
+	this->ddp.begin(UDPSTREAM_PORT_DDP);
+	this->listen();
+}
+
+//---------------------------------------------------------------------------------------
+// listen
+//
+// Opens the E1.31 port and joins the multicast group of the configured universe
+// (239.255.<universe high byte>.<universe low byte>), unicast packets are received too
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void UdpStreamClass::listen()
+{
+	this->universe = Config.streamUniverse;
+	this->e131.stop();
+	this->e131.beginMulticast(WiFi.localIP(),
+			IPAddress(239, 255, this->universe >> 8, this->universe & 0xFF),
+			UDPSTREAM_PORT_E131);
+}
+
+//---------------------------------------------------------------------------------------
+// process
+//
+// Must be called repeatedly from main loop, decodes received packets and ends the
+// stream after Config.streamTimeout ms without data
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void UdpStreamClass::process()
+{
+	if(this->universe < 0) return;
+	if(this->universe != Config.streamUniverse) this->listen();
+
+	this->receive(this->artnet, &UdpStreamClass::decodeArtNet);
+	this->receive(this->e131, &UdpStreamClass::decodeE131);
+	this->receive(this->ddp, &UdpStreamClass::decodeDDP);
+
+	if(this->active && millis() - this->lastFrame > (uint32_t) Config.streamTimeout)
+		this->active = false;
+}
+
+//---------------------------------------------------------------------------------------
+// isActive
+//
+// -> --
+// <- true while pixel data is received, the main loop shows DisplayMode::stream then
+//---------------------------------------------------------------------------------------
+bool UdpStreamClass::isActive()
+{
+	return this->active;
+}
+
+//---------------------------------------------------------------------------------------
+// receive
+//
+// Decodes up to UDPSTREAM_PACKETS_MAX waiting packets of one port
+//
+// -> udp: socket of the port
+//    decode: decoder of the protocol, returns true if the packet completed a frame
+// <- --
+//---------------------------------------------------------------------------------------
+void UdpStreamClass::receive(WiFiUDP &udp, bool (UdpStreamClass::*decode)(int size))
+{
+	int size;
+	for(int i = 0; i < UDPSTREAM_PACKETS_MAX && (size = udp.parsePacket()) > 0; i++)
+	{
+		this->packets++;
+		if((this->*decode)(size))
+		{
+			this->frames++;
+			this->lastFrame = millis();
+			this->active = true;
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// decodeArtNet
+//
+// Decodes an ArtDmx packet of the configured port address, other opcodes are ignored
+//
+// -> size: size of the packet
+// <- true if pixel data has been taken over
+//---------------------------------------------------------------------------------------
+bool UdpStreamClass::decodeArtNet(int size)
+{
+	uint8_t header[ARTNET_HEADER_SIZE];
+	if(size < ARTNET_HEADER_SIZE ||
+			this->artnet.read(header, sizeof(header)) != sizeof(header) ||
+			memcmp(header, artnetId, sizeof(artnetId)) != 0)
+	{
+		this->errors++;
+		return false;
+	}
+
+	// OpCode is little endian, everything else big endian
+	if(header[8] != 0x00 || header[9] != 0x50) return false;
+	if(((header[15] << 8) | header[14]) != Config.streamUniverse) return false;
+
+	uint32_t length = (header[16] << 8) | header[17];
+	if(length > (uint32_t)(size - ARTNET_HEADER_SIZE)) length = size - ARTNET_HEADER_SIZE;
+	this->readPixels(this->artnet, 0, length);
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+// decodeE131
+//
+// Decodes an E1.31 data packet of the configured universe. Preview data is ignored, a
+// packet with the stream terminated option ends the stream immediately.
+//
+// -> size: size of the packet
+// <- true if pixel data has been taken over
+//---------------------------------------------------------------------------------------
+bool UdpStreamClass::decodeE131(int size)
+{
+	uint8_t header[E131_HEADER_SIZE];
+	if(size < E131_HEADER_SIZE ||
+			this->e131.read(header, sizeof(header)) != sizeof(header) ||
+			header[0] != 0x00 || header[1] != 0x10 ||
+			memcmp(header + 4, e131Id, sizeof(e131Id)) != 0)
+	{
+		this->errors++;
+		return false;
+	}
+
+	// root vector VECTOR_ROOT_E131_DATA, framing vector VECTOR_E131_DATA_PACKET,
+	// DMP vector VECTOR_DMP_SET_PROPERTY and DMX512 null start code
+	if(header[21] != 0x04 || header[43] != 0x02 || header[117] != 0x02 ||
+			header[125] != 0x00) return false;
+	if(((header[113] << 8) | header[114]) != Config.streamUniverse) return false;
+	if(header[112] & E131_OPTION_PREVIEW) return false;
+	if(header[112] & E131_OPTION_TERMINATED)
+	{
+		this->active = false;
+		return false;
+	}
+
+	// property value count includes the start code
+	uint32_t length = (header[123] << 8) | header[124];
+	length = length ? length - 1 : 0;
+	if(length > (uint32_t)(size - E131_HEADER_SIZE)) length = size - E131_HEADER_SIZE;
+	this->readPixels(this->e131, 0, length);
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+// decodeDDP
+//
+// Decodes a DDP data packet. A frame may be split into several packets, it is complete
+// with the packet which has the push flag set.
+//
+// -> size: size of the packet
+// <- true if the packet completed a frame
+//---------------------------------------------------------------------------------------
+bool UdpStreamClass::decodeDDP(int size)
+{
+	uint8_t header[DDP_HEADER_SIZE + 4];
+	if(size < DDP_HEADER_SIZE ||
+			this->ddp.read(header, DDP_HEADER_SIZE) != DDP_HEADER_SIZE ||
+			(header[0] & DDP_FLAG_VERSION_MASK) != DDP_FLAG_VERSION_1)
+	{
+		this->errors++;
+		return false;
+	}
+
+	// queries, replies and storage commands carry no pixel data
+	if(header[0] & (DDP_FLAG_QUERY | DDP_FLAG_REPLY | DDP_FLAG_STORAGE)) return false;
+
+	int headerSize = DDP_HEADER_SIZE;
+	if(header[0] & DDP_FLAG_TIMECODE)
+	{
+		headerSize += 4;
+		if(size < headerSize || this->ddp.read(header + DDP_HEADER_SIZE, 4) != 4)
+		{
+			this->errors++;
+			return false;
+		}
+	}
+
+	uint32_t offset = ((uint32_t)header[4] << 24) | ((uint32_t)header[5] << 16) |
+			(header[6] << 8) | header[7];
+	uint32_t length = (header[8] << 8) | header[9];
+	if(length > (uint32_t)(size - headerSize)) length = size - headerSize;
+	this->readPixels(this->ddp, offset, length);
+	return (header[0] & DDP_FLAG_PUSH) != 0;
+}
+
+//---------------------------------------------------------------------------------------
+// readPixels
+//
+// Reads RGB triplets from the current packet directly into the LED buffer. Channels of
+// a pixel split across two packets and channels beyond the last pixel are skipped.
+//
+// -> udp: socket with the current packet, positioned at the first channel
+//    offset: channel index of the first channel in the packet
+//    length: number of channels in the packet
+// <- --
+//---------------------------------------------------------------------------------------
+void UdpStreamClass::readPixels(WiFiUDP &udp, uint32_t offset, uint32_t length)
+{
+	uint8_t rgb[3];
+
+	// align to the start of the next pixel
+	while(length && offset % 3)
+	{
+		udp.read();
+		offset++;
+		length--;
+	}
+
+	for(uint32_t pixel = offset / 3; length >= 3 && pixel < NUM_PIXELS; pixel++)
+	{
+		if(udp.read(rgb, 3) != 3) break;
+		LED.setPixel(pixel, rgb[0], rgb[1], rgb[2]);
+		length -= 3;
+	}
+}
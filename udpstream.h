@@ -0,0 +1,69 @@
+// ESP8266 Wordclock
+// Copyright (C) 2016 Thoralt Franz, https://github.com/thoralt
+//
+//  See udpstream.cpp for description.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef _UDPSTREAM_H_
+#define _UDPSTREAM_H_
+
+#include <stdint.h>
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+
+#include "config.h"
+
+// UDP ports of the supported protocols
+#define UDPSTREAM_PORT_ARTNET 6454
+#define UDPSTREAM_PORT_E131 5568
+#define UDPSTREAM_PORT_DDP 4048
+
+// maximum number of packets read from each port per call of process(), further
+// packets wait for the next main loop
+#define UDPSTREAM_PACKETS_MAX 4
+
+class UdpStreamClass
+{
+public:
+	UdpStreamClass();
+	void begin();
+	void process();
+	bool isActive();
+
+	// received packets, frames taken over into the LED buffer and malformed packets
+	uint32_t packets = 0;
+	uint32_t frames = 0;
+	uint32_t errors = 0;
+
+private:
+	WiFiUDP artnet;
+	WiFiUDP e131;
+	WiFiUDP ddp;
+
+	// E1.31 universe whose multicast group has been joined, -1 before begin()
+	int universe = -1;
+	bool active = false;
+	uint32_t lastFrame = 0;
+
+	void listen();
+	void receive(WiFiUDP &udp, bool (UdpStreamClass::*decode)(int size));
+	bool decodeArtNet(int size);
+	bool decodeE131(int size);
+	bool decodeDDP(int size);
+	void readPixels(WiFiUDP &udp, uint32_t offset, uint32_t length);
+};
+
+extern UdpStreamClass UdpStream;
+
+#endif
@@ -19,10 +19,16 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <Arduino.h>
 #include <FS.h>
-#include <ArduinoJson.h>
+#include <stdarg.h>
 
 #include "ledfunctions.h"
+#include "effects.h"
 #include "brightness.h"
+#include "lighthistory.h"
+#include "livestream.h"
+#include "udpstream.h"
+#include "serialstream.h"
+#include "clock.h"
 #include "webserver.h"
 #include "ntp.h"
 
@@ -31,16 +37,129 @@
 //---------------------------------------------------------------------------------------
 WebServerClass WebServer = WebServerClass();
 
+//---------------------------------------------------------------------------------------
+// heap allocation counter
+//
+// If the sketch is compiled with -DWEB_COUNT_ALLOCATIONS and linked with
+// -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc every heap allocation passes through
+// the functions below. dispatch() compares the counter before and after a handler.
+//---------------------------------------------------------------------------------------
+#ifdef WEB_COUNT_ALLOCATIONS
+static volatile uint32_t heapAllocations = 0;
+
+extern "C"
+{
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+	heapAllocations++;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+	heapAllocations++;
+	return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	heapAllocations++;
+	return __real_realloc(ptr, size);
+}
+}
+#endif
+
+//---------------------------------------------------------------------------------------
+// names of the reset reasons in rst_info, as returned by ESP.getResetReason()
+//---------------------------------------------------------------------------------------
+static const char resetReasons[][24] PROGMEM = {
+	"Power on", "Hardware Watchdog", "Exception", "Software Watchdog",
+	"Software/System restart", "Deep-Sleep Wake", "External System"};
+
+//---------------------------------------------------------------------------------------
+// content types of served files by file name extension
+//---------------------------------------------------------------------------------------
+static const struct
+{
+	char extension[8];
+	char type[24];
+} PROGMEM mimeTypes[] = {
+	{"htm", "text/html"},
+	{"html", "text/html"},
+	{"css", "text/css"},
+	{"js", "application/javascript"},
+	{"json", "application/json"},
+	{"png", "image/png"},
+	{"gif", "image/gif"},
+	{"jpg", "image/jpeg"},
+	{"ico", "image/x-icon"},
+	{"svg", "image/svg+xml"},
+	{"xml", "text/xml"},
+	{"pdf", "application/x-pdf"},
+	{"zip", "application/x-zip"},
+	{"gz", "application/x-gzip"}};
+
+//---------------------------------------------------------------------------------------
+// URL handlers, requests which match none of them are handled by handleNotFound()
+//---------------------------------------------------------------------------------------
+const web_route PROGMEM WebServerClass::routes[] = {
+	{"/setcolor", HTTP_ANY, &WebServerClass::handleSetColor, NULL},
+	{"/info", HTTP_ANY, &WebServerClass::handleInfo, NULL},
+	{"/saveconfig", HTTP_ANY, &WebServerClass::handleSaveConfig, NULL},
+	{"/loadconfig", HTTP_ANY, &WebServerClass::handleLoadConfig, NULL},
+	{"/setheartbeat", HTTP_ANY, &WebServerClass::handleSetHeartbeat, NULL},
+	{"/getheartbeat", HTTP_ANY, &WebServerClass::handleGetHeartbeat, NULL},
+	{"/getcolors", HTTP_ANY, &WebServerClass::handleGetColors, NULL},
+	{"/getntpserver", HTTP_ANY, &WebServerClass::handleGetNtpServer, NULL},
+	{"/setntpserver", HTTP_ANY, &WebServerClass::handleSetNtpServer, NULL},
+	{"/h", HTTP_ANY, &WebServerClass::handleH, NULL},
+	{"/m", HTTP_ANY, &WebServerClass::handleM, NULL},
+	{"/r", HTTP_ANY, &WebServerClass::handleR, NULL},
+	{"/g", HTTP_ANY, &WebServerClass::handleG, NULL},
+	{"/b", HTTP_ANY, &WebServerClass::handleB, NULL},
+	{"/brightness", HTTP_ANY, &WebServerClass::handleSetBrightness, NULL},
+	{"/getadc", HTTP_ANY, &WebServerClass::handleGetADC, NULL},
+	{"/setmode", HTTP_ANY, &WebServerClass::handleSetMode, NULL},
+	{"/getmode", HTTP_ANY, &WebServerClass::handleGetMode, NULL},
+	{"/settimezone", HTTP_ANY, &WebServerClass::handleSetTimeZone, NULL},
+	{"/gettimezone", HTTP_ANY, &WebServerClass::handleGetTimeZone, NULL},
+	{"/debug", HTTP_ANY, &WebServerClass::handleDebug, NULL},
+	{"/pixels", HTTP_POST, &WebServerClass::handlePixels, &WebServerClass::receivePixels},
+	{"/getpalette", HTTP_ANY, &WebServerClass::handleGetPalette, NULL},
+	{"/setpalette", HTTP_ANY, &WebServerClass::handleSetPalette, NULL},
+	{"/getcalibration", HTTP_ANY, &WebServerClass::handleGetCalibration, NULL},
+	{"/setcalibration", HTTP_ANY, &WebServerClass::handleSetCalibration, NULL},
+	{"/getpower", HTTP_ANY, &WebServerClass::handleGetPower, NULL},
+	{"/setpower", HTTP_ANY, &WebServerClass::handleSetPower, NULL},
+	{"/getlightcurve", HTTP_ANY, &WebServerClass::handleGetLightCurve, NULL},
+	{"/setlightcurve", HTTP_ANY, &WebServerClass::handleSetLightCurve, NULL},
+	{"/lighthistory", HTTP_ANY, &WebServerClass::handleLightHistory, NULL},
+	{"/api/state", HTTP_ANY, &WebServerClass::handleApiState, NULL},
+	{"/api/update", HTTP_POST, &WebServerClass::handleApiUpdate, NULL},
+	{"/events", HTTP_ANY, &WebServerClass::handleEvents, NULL},
+	{"/api/preview", HTTP_ANY, &WebServerClass::handleApiPreview, NULL},
+	{"/webstats", HTTP_ANY, &WebServerClass::handleWebStats, NULL},
+	{"/ntpstats", HTTP_ANY, &WebServerClass::handleNtpStats, NULL}};
+
+const int WebServerClass::routeCount = sizeof(WebServerClass::routes) / sizeof(web_route);
+
 //---------------------------------------------------------------------------------------
 // WebServerClass
 //
-// Constructor, currently empty
+// Constructor, clears the request statistics
 //
 // -> --
 // <- --
 //---------------------------------------------------------------------------------------
 WebServerClass::WebServerClass()
 {
+	memset(this->stats, 0, sizeof(this->stats));
+	this->response[0] = 0;
+	for (int i = 0; i < WEB_TRANSFERS_MAX; i++) this->transfers[i].active = false;
 }
 
 //---------------------------------------------------------------------------------------
@@ -71,29 +190,25 @@ void WebServerClass::begin()
 
 	this->server = new ESP8266WebServer(80);
 
-	this->server->on("/setcolor", std::bind(&WebServerClass::handleSetColor, this));
-	this->server->on("/info", std::bind(&WebServerClass::handleInfo, this));
-	this->server->on("/saveconfig", std::bind(&WebServerClass::handleSaveConfig, this));
-	this->server->on("/loadconfig", std::bind(&WebServerClass::handleLoadConfig, this));
-	this->server->on("/setheartbeat", std::bind(&WebServerClass::handleSetHeartbeat, this));
-	this->server->on("/getheartbeat", std::bind(&WebServerClass::handleGetHeartbeat, this));
-	this->server->on("/getcolors", std::bind(&WebServerClass::handleGetColors, this));
-	this->server->on("/getntpserver", std::bind(&WebServerClass::handleGetNtpServer, this));
-	this->server->on("/setntpserver", std::bind(&WebServerClass::handleSetNtpServer, this));
-	this->server->on("/h", std::bind(&WebServerClass::handleH, this));
-	this->server->on("/m", std::bind(&WebServerClass::handleM, this));
-	this->server->on("/r", std::bind(&WebServerClass::handleR, this));
-	this->server->on("/g", std::bind(&WebServerClass::handleG, this));
-	this->server->on("/b", std::bind(&WebServerClass::handleB, this));
-	this->server->on("/brightness", std::bind(&WebServerClass::handleSetBrightness, this));
-	this->server->on("/getadc", std::bind(&WebServerClass::handleGetADC, this));
-	this->server->on("/setmode", std::bind(&WebServerClass::handleSetMode, this));
-	this->server->on("/getmode", std::bind(&WebServerClass::handleGetMode, this));
-	this->server->on("/settimezone", std::bind(&WebServerClass::handleSetTimeZone, this));
-	this->server->on("/gettimezone", std::bind(&WebServerClass::handleGetTimeZone, this));
-	this->server->on("/debug", std::bind(&WebServerClass::handleDebug, this));
-
-	this->server->onNotFound(std::bind(&WebServerClass::handleNotFound, this));
+	static_assert(sizeof(routes) / sizeof(routes[0]) <= WEB_ROUTES_MAX,
+			"route table exceeds WEB_ROUTES_MAX");
+	web_route route;
+	for (int i = 0; i < routeCount; i++)
+	{
+		memcpy_P(&route, &routes[i], sizeof(route));
+		if (route.body)
+		{
+			this->server->on(route.path, route.method, [this, i]() { this->dispatch(i); },
+					[this, i]() { this->receiveBody(i); });
+		}
+		else this->server->on(route.path, route.method, [this, i]() { this->dispatch(i); });
+	}
+	this->server->onNotFound([this]() { this->dispatch(routeCount); });
+
+	static const char *headers[] = {"If-None-Match", "Accept-Encoding", "Content-Type"};
+	this->server->collectHeaders(headers, sizeof(headers) / sizeof(headers[0]));
+	this->indexFiles();
+
 	this->server->begin();
 }
 
@@ -107,497 +222,1872 @@ void WebServerClass::begin()
 //---------------------------------------------------------------------------------------
 void WebServerClass::process()
 {
+	uint32_t start = micros();
 	this->server->handleClient();
+	this->continueTransfers(start);
+
+	this->lastStall = micros() - start;
+	if (this->lastStall > this->maxStall) this->maxStall = this->lastStall;
 }
 
 //---------------------------------------------------------------------------------------
-// serveFile
+// dispatch
 //
-// Looks up a given file name in internal flash file system, streams the file if found
+// Calls the handler of a route and records its latency and the heap allocations made
+// until the handler returns
 //
-// -> path: name of the file; "index.html" will be added if name ends with "/"
-// <- true: file was found and served to client
-//	false: file not found
+// -> route: index in routes[], routeCount for handleNotFound()
+// <- --
 //---------------------------------------------------------------------------------------
-bool WebServerClass::serveFile(String path)
+void WebServerClass::dispatch(int route)
 {
-	Serial.println("WebServerClass::serveFile(): " + path);
-	if (path.endsWith("/"))
-		path += "index.html";
-	if (SPIFFS.exists(path))
+	uint32_t start = micros();
+#ifdef WEB_COUNT_ALLOCATIONS
+	uint32_t firstAllocation = heapAllocations;
+#endif
+	this->clearResponse();
+
+	if (route < routeCount)
 	{
-		File file = SPIFFS.open(path, "r");
-		this->server->streamFile(file, this->contentType(path));
-		file.close();
-		return true;
+		web_handler_t handler;
+		memcpy_P(&handler, &routes[route].handler, sizeof(handler));
+		(this->*handler)();
 	}
-	return false;
+	else this->handleNotFound();
+
+	uint32_t duration = micros() - start;
+
+	route_stat &stat = this->stats[route];
+#ifdef WEB_COUNT_ALLOCATIONS
+	// everything the handler allocated, including sending the reply
+	uint32_t allocations = heapAllocations - firstAllocation;
+	stat.allocs += allocations;
+	this->allocations += allocations;
+#endif
+	stat.count++;
+	stat.total += duration;
+	if (duration > stat.max) stat.max = duration;
 }
 
 //---------------------------------------------------------------------------------------
-// contentType
+// receiveBody
 //
-// Returns an HTML content type based on a given file name extension
+// Calls the body handler of a route for the next part of the raw request body
 //
-// -> filename: name of the file
-// <- HTML content type matching file extension
+// -> route: index in routes[]
+// <- --
 //---------------------------------------------------------------------------------------
-String WebServerClass::contentType(String filename)
+void WebServerClass::receiveBody(int route)
 {
-	if (this->server->hasArg("download")) return "application/octet-stream";
-	else if (filename.endsWith(".htm")) return "text/html";
-	else if (filename.endsWith(".html")) return "text/html";
-	else if (filename.endsWith(".css")) return "text/css";
-	else if (filename.endsWith(".js")) return "application/javascript";
-	else if (filename.endsWith(".png")) return "image/png";
-	else if (filename.endsWith(".gif")) return "image/gif";
-	else if (filename.endsWith(".jpg")) return "image/jpeg";
-	else if (filename.endsWith(".ico")) return "image/x-icon";
-	else if (filename.endsWith(".xml")) return "text/xml";
-	else if (filename.endsWith(".pdf")) return "application/x-pdf";
-	else if (filename.endsWith(".zip")) return "application/x-zip";
-	else if (filename.endsWith(".gz")) return "application/x-gzip";
-	return "text/plain";
+	web_handler_t handler;
+	memcpy_P(&handler, &routes[route].body, sizeof(handler));
+	(this->*handler)();
 }
 
 //---------------------------------------------------------------------------------------
-// handleM
+// clearResponse
 //
-// Handles the /m request, increments the minutes counter (for testing purposes)
+// Empties the response buffer
 //
 // -> --
 // <- --
 //---------------------------------------------------------------------------------------
-extern int h, m;
-void WebServerClass::handleM()
+void WebServerClass::clearResponse()
 {
-	if(++m>59) m = 0;
-	this->server->send(200, "text/plain", "OK");
+	this->responseLength = 0;
+	this->response[0] = 0;
 }
 
 //---------------------------------------------------------------------------------------
-// handleH
+// append
 //
-// Handles the /h request, increments the hours counter (for testing purposes)
+// Appends formatted text to the response buffer, output which does not fit is cut off
 //
-// -> --
+// -> format: printf() format string
+//    ...: arguments
 // <- --
 //---------------------------------------------------------------------------------------
-void WebServerClass::handleH()
+void WebServerClass::append(const char *format, ...)
 {
-	if(++h>23) h = 0;
-	this->server->send(200, "text/plain", "OK");
+	size_t space = sizeof(this->response) - this->responseLength;
+	va_list args;
+	va_start(args, format);
+	int n = vsnprintf(this->response + this->responseLength, space, format, args);
+	va_end(args);
+	if (n > 0) this->responseLength += ((size_t)n < space) ? n : space - 1;
 }
 
 //---------------------------------------------------------------------------------------
-// handleR
+// respond
 //
-// Handles the /r request, sets LED matrix to all red (for testing purposes)
+// Sends a complete reply
 //
-// -> --
+// -> code: HTTP status code
+//    type: content type, may reside in PROGMEM
+//    content: body, usually this->response
+//    length: length of the body
 // <- --
 //---------------------------------------------------------------------------------------
-void WebServerClass::handleR()
+void WebServerClass::respond(int code, PGM_P type, const char *content, size_t length)
 {
-	LED.setMode(DisplayMode::red);
-	this->server->send(200, "text/plain", "OK");
+	this->server->send_P(code, type, content, length);
 }
 
 //---------------------------------------------------------------------------------------
-// handleG
+// sendText
 //
-// Handles the /g request, sets LED matrix to all green (for testing purposes)
+// Sends a short plain text reply like "OK" or "ERR"
 //
-// -> --
+// -> code: HTTP status code
+//    text: body
 // <- --
 //---------------------------------------------------------------------------------------
-void WebServerClass::handleG()
+void WebServerClass::sendText(int code, const char *text)
 {
-	LED.setMode(DisplayMode::green);
-	this->server->send(200, "text/plain", "OK");
+	this->respond(code, PSTR("text/plain"), text, strlen(text));
 }
 
 //---------------------------------------------------------------------------------------
-// handleB
+// beginChunked
 //
-// Handles the /b request, sets LED matrix to all blue (for testing purposes)
+// Sends the header of a reply with unknown length, the body is collected in the
+// response buffer and sent by sendChunk()
 //
-// -> --
+// -> type: content type
 // <- --
 //---------------------------------------------------------------------------------------
-void WebServerClass::handleB()
+void WebServerClass::beginChunked(const char *type)
 {
-	LED.setMode(DisplayMode::blue);
-	this->server->send(200, "text/plain", "OK");
+	this->clearResponse();
+	this->server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+	this->server->send(200, type, "");
 }
 
-void WebServerClass::handleSetBrightness()
+//---------------------------------------------------------------------------------------
+// sendChunk
+//
+// Sends the content of the response buffer as next part of a reply started with
+// beginChunked() once WEB_CHUNK_SIZE bytes have been collected
+//
+// -> last: true to send the remaining content regardless of its length and to end the
+//          reply
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::sendChunk(bool last)
 {
-	if(this->server->hasArg("value"))
+	if (this->responseLength && (last || this->responseLength >= WEB_CHUNK_SIZE))
 	{
-		Brightness.brightnessOverride = this->server->arg("value").toInt();
-		this->server->send(200, "text/plain", "OK");
+		this->server->sendContent_P(this->response, this->responseLength);
+		this->clearResponse();
 	}
+	if (last) this->server->sendContent("");
 }
 
-void WebServerClass::handleDebug()
+//---------------------------------------------------------------------------------------
+// findArg
+//
+// Looks up a request argument. The names are compared by index, so no String is built
+// for the name or the value.
+//
+// -> name: name of the argument
+// <- value of the argument, valid until the request has been handled, NULL if the
+//    argument is missing
+//---------------------------------------------------------------------------------------
+const char *WebServerClass::findArg(const char *name)
 {
-	if(this->server->hasArg("led") &&
-			   this->server->hasArg("r") &&
-			   this->server->hasArg("g") &&
-			   this->server->hasArg("b"))
+	for (int i = 0; i < this->server->args(); i++)
 	{
-		int led = this->server->arg("led").toInt();
-		int r = this->server->arg("r").toInt();
-		int g = this->server->arg("g").toInt();
-		int b = this->server->arg("b").toInt();
-		if(led < 0) led = 0;
-		if(led >= NUM_PIXELS) led = NUM_PIXELS - 1;
-		if(r < 0) r = 0;
-		if(r > 255) r = 255;
-		if(g < 0) g = 0;
-		if(g > 255) g = 255;
-		if(b < 0) b = 0;
-		if(b > 255) b = 255;
-
-		LED.currentValues[led*3+0] = r;
-		LED.currentValues[led*3+1] = g;
-		LED.currentValues[led*3+2] = b;
-		LED.show();
-		Config.debugMode = 1;
+		if (strcmp(this->server->argName(i).c_str(), name) == 0)
+			return this->server->arg(i).c_str();
 	}
+	return NULL;
+}
 
-	if(this->server->hasArg("clear"))
+//---------------------------------------------------------------------------------------
+// findHeader
+//
+// Looks up a request header collected in begin(), names are compared case-insensitive
+//
+// -> name: name of the header
+// <- value of the header, valid until the request has been handled, empty string if
+//    the header is missing
+//---------------------------------------------------------------------------------------
+const char *WebServerClass::findHeader(const char *name)
+{
+	for (int i = 0; i < this->server->headers(); i++)
 	{
-		for(int i=0; i<3*NUM_PIXELS; i++) LED.currentValues[i] = 0;
-		LED.show();
+		if (strcasecmp(this->server->headerName(i).c_str(), name) == 0)
+			return this->server->header(i).c_str();
 	}
+	return "";
+}
 
-	if(this->server->hasArg("end"))
-	{
-		Config.debugMode = 0;
-	}
-	this->server->send(200, "text/plain", "OK");
+//---------------------------------------------------------------------------------------
+// getArg
+//
+// Copies the value of a request argument into a buffer
+//
+// -> name: name of the argument
+//    buf: target buffer, receives an empty string if the argument is not usable
+//    size: size of the buffer
+// <- false if the argument is missing or too long for the buffer
+//---------------------------------------------------------------------------------------
+bool WebServerClass::getArg(const char *name, char *buf, size_t size)
+{
+	buf[0] = 0;
+	const char *value = this->findArg(name);
+	if (!value) return false;
+	size_t length = strlen(value);
+	if (length >= size) return false;
+	memcpy(buf, value, length + 1);
+	return true;
 }
 
-void WebServerClass::handleGetADC()
+//---------------------------------------------------------------------------------------
+// getIntArg
+//
+// Reads a numeric request argument
+//
+// -> name: name of the argument
+//    fallback: result if the argument is missing
+// <- value of the argument, 0 if it is not a number
+//---------------------------------------------------------------------------------------
+long WebServerClass::getIntArg(const char *name, long fallback)
 {
-	int __attribute__ ((unused)) temp = Brightness.value(); // to trigger A/D conversion
-	this->server->send(200, "text/plain", String(Brightness.avg));
+	const char *value = this->findArg(name);
+	return value ? atol(value) : fallback;
 }
 
 //---------------------------------------------------------------------------------------
-// handleSetTimeZone
+// isArg
 //
-// Handles the /settimezone request. Saves the time zone
+// Compares a request argument with a value
+//
+// -> name: name of the argument
+//    value: expected value
+// <- true if the argument is present and equal to value
+//---------------------------------------------------------------------------------------
+bool WebServerClass::isArg(const char *name, const char *value)
+{
+	const char *arg = this->findArg(name);
+	return arg && strcmp(arg, value) == 0;
+}
+
+//---------------------------------------------------------------------------------------
+// findTransfer
+//
+// Looks for a transfer slot which is not in use
 //
 // -> --
-// <- --
+// <- index into transfers[], -1 if all slots are busy
 //---------------------------------------------------------------------------------------
-void WebServerClass::handleSetTimeZone()
+int WebServerClass::findTransfer()
 {
-	int newTimeZone = -999;
-	if(this->server->hasArg("value"))
+	for (int i = 0; i < WEB_TRANSFERS_MAX; i++)
 	{
-		newTimeZone = this->server->arg("value").toInt();
-		if(newTimeZone < - 12 || newTimeZone > 14)
-		{
-			this->server->send(400, "text/plain", "ERR");
-		}
-		else
-		{
-			Config.timeZone = newTimeZone;
-			Config.save();
-			NTP.setTimeZone(Config.timeZone);
-			this->server->send(200, "text/plain", "OK");
-		}
+		if (!this->transfers[i].active) return i;
 	}
+	return -1;
 }
 
 //---------------------------------------------------------------------------------------
-// handleGetTimeZone
+// checkTransfer
 //
-// Handles the /gettimezone request, delivers offset to UTC in hours.
+// Checks whether a file can be sent without blocking. Files up to WEB_TRANSFER_CHUNK
+// bytes are written at once, larger ones need a free transfer slot. Otherwise the
+// file is closed and the client is asked to try again later.
 //
-// -> --
-// <- --
+// -> file: opened file
+// <- true: file may be passed to sendFile()
+//	false: request has been answered with status 503
 //---------------------------------------------------------------------------------------
-void WebServerClass::handleGetTimeZone()
+bool WebServerClass::checkTransfer(File &file)
 {
-	this->server->send(200, "text/plain", String(Config.timeZone));
+	if (file.size() <= WEB_TRANSFER_CHUNK || this->findTransfer() >= 0) return true;
+	file.close();
+	this->server->sendHeader("Retry-After", "1");
+	this->sendText(503, "Busy");
+	return false;
 }
 
 //---------------------------------------------------------------------------------------
-// handleSetMode
+// sendFile
 //
-// Handles the /setmode request. Sets the display mode to one of the allowed values,
-// saves it as the new default mode.
+// Sends a file from the flash file system which has passed checkTransfer(). Large
+// files are handed over to continueTransfers(), small ones are sent right away.
 //
-// -> --
+// -> file: opened file, closed when it has been sent
+//    type: content type, may reside in PROGMEM
 // <- --
 //---------------------------------------------------------------------------------------
-void WebServerClass::handleSetMode()
+void WebServerClass::sendFile(File &file, PGM_P type)
 {
-	DisplayMode mode = DisplayMode::invalid;
+	const char *extension = strrchr(file.name(), '.');
+	if (extension && strcmp(extension, ".gz") == 0)
+		this->server->sendHeader("Content-Encoding", "gzip");
+	this->server->setContentLength(file.size());
+	this->server->send_P(200, type, "", 0);
 
-	if(this->server->hasArg("value"))
+	int slot = (file.size() > WEB_TRANSFER_CHUNK) ? this->findTransfer() : -1;
+	if (slot >= 0)
 	{
-		// handle each allowed value for safety
-		if(this->server->arg("value") == "0") mode = DisplayMode::plain;
-		if(this->server->arg("value") == "1") mode = DisplayMode::fade;
-		if(this->server->arg("value") == "2") mode = DisplayMode::flyingLettersVerticalUp;
-		if(this->server->arg("value") == "3") mode = DisplayMode::flyingLettersVerticalDown;
-		if(this->server->arg("value") == "4") mode = DisplayMode::explode;
+		web_transfer &t = this->transfers[slot];
+		t.client = this->server->client();
+		t.file = file;
+		t.historyLevel = -1;
+		t.active = true;
+		return;
 	}
 
-	if(mode == DisplayMode::invalid)
-	{
-		this->server->send(400, "text/plain", "ERR");
-	}
-	else
-	{
-		LED.setMode(mode);
-		Config.defaultMode = mode;
-		Config.save();
-		this->server->send(200, "text/plain", "OK");
-	}
+	// fits into the send buffer of the connection
+	uint8_t buf[WEB_TRANSFER_CHUNK];
+	WiFiClient client = this->server->client();
+	size_t n = file.read(buf, sizeof(buf));
+	client.write(buf, n);
+	file.close();
 }
 
 //---------------------------------------------------------------------------------------
-// handleGetMode
+// readHistory
 //
-// Handles the /getmode request and returns the current default display mode.
+// Copies the next light history records of a transfer into a buffer, oldest first
 //
-// -> --
-// <- --
+// -> t: transfer started by handleLightHistory()
+//    buf: destination
+//    size: size of buf in bytes
+// <- number of bytes copied, 0 if not even one record fits
 //---------------------------------------------------------------------------------------
-void WebServerClass::handleGetMode()
+size_t WebServerClass::readHistory(web_transfer &t, uint8_t *buf, size_t size)
 {
-	int mode = 0;
-	switch(Config.defaultMode)
+	size_t n = 0;
+	while (t.historyAge >= 0 && n + sizeof(light_record) <= size)
 	{
-	case DisplayMode::plain:
-		mode = 0; break;
-	case DisplayMode::fade:
-		mode = 1; break;
-	case DisplayMode::flyingLettersVerticalUp:
-		mode = 2; break;
-	case DisplayMode::flyingLettersVerticalDown:
-		mode = 3; break;
-	case DisplayMode::explode:
-		mode = 4; break;
-	default:
-		mode = 0; break;
+		light_record r = LightHistory.get(t.historyLevel, t.historyAge--);
+		memcpy(buf + n, &r, sizeof(r));
+		n += sizeof(r);
 	}
-	this->server->send(200, "text/plain", String(mode));
+	return n;
 }
 
 //---------------------------------------------------------------------------------------
-// handleNotFound
+// continueTransfers
 //
-// Handles all requests not bound to other handlers, tries to serve a file if found in
-// flash, responds with 404 otherwise
+// Sends further parts of the files and light histories handed over by sendFile() and
+// handleLightHistory() as long as the send buffers of the connections accept data
+// and the time budget is not used up
 //
-// -> --
+// -> start: start of the current process() call in microseconds
 // <- --
 //---------------------------------------------------------------------------------------
-void WebServerClass::handleNotFound()
+void WebServerClass::continueTransfers(uint32_t start)
 {
-	// first, try to serve the requested file from flash
-	if (!serveFile(this->server->uri()))
-	{
-		// create 404 message if no file was found for this URI
-		String message = "File Not Found\n\n";
-		message += "URI: ";
-		message += this->server->uri();
-		message += "\nMethod: ";
-		message += (this->server->method() == HTTP_GET) ? "GET" : "POST";
-		message += "\nArguments: ";
-		message += this->server->args();
-		message += "\n";
-		for (uint8_t i = 0; i < this->server->args(); i++)
+	uint8_t buf[WEB_TRANSFER_CHUNK];
+	for (int i = 0; i < WEB_TRANSFERS_MAX; i++)
+	{
+		web_transfer &t = this->transfers[i];
+		while (t.active && micros() - start < WEB_TIME_BUDGET)
 		{
-			message += " " + this->server->argName(i) + ": "
-					+ this->server->arg(i) + "\n";
+			bool done = (t.historyLevel < 0) ? !t.file.available() : t.historyAge < 0;
+			if (!t.client.connected() || done)
+			{
+				// the connection belongs to ESP8266WebServer, which may keep it alive
+				// for the next request
+				if (t.historyLevel < 0) t.file.close();
+				t.client = WiFiClient();
+				t.active = false;
+				break;
+			}
+
+			int n = t.client.availableForWrite();
+			if (n <= 0) break;
+			if (n > (int)sizeof(buf)) n = sizeof(buf);
+			if (t.historyLevel < 0) n = t.file.read(buf, n);
+			else n = readHistory(t, buf, n);
+			if (n <= 0) break;
+			t.client.write(buf, n);
 		}
-		this->server->send(404, "text/plain", message);
 	}
 }
 
 //---------------------------------------------------------------------------------------
-// handleGetNtpServer
+// serveFile
 //
-// Delivers the currently configured NTP server IP address
+// Looks up a given file name in internal flash file system, streams the file if found
 //
-// -> --
-// <- --
+// -> uri: name of the file; "index.html" will be added if name ends with "/"
+// <- true: file was found and served to client
+//	false: file not found
 //---------------------------------------------------------------------------------------
-void WebServerClass::handleGetNtpServer()
+bool WebServerClass::serveFile(const char *uri)
 {
-	this->server->send(200, "application/json", Config.ntpserver.toString());
+	// room for the name of the compressed variant
+	char path[STATIC_PATH_MAX + 3];
+	size_t length = strlen(uri);
+	const char *index = (length && uri[length - 1] == '/') ? "index.html" : "";
+	if (length + strlen(index) >= STATIC_PATH_MAX) return false;
+	snprintf(path, sizeof(path), "%s%s", uri, index);
+
+	const static_file *f = this->findFile(path);
+	if (!f)
+	{
+		// files which did not fit into the index are served without validation
+		if (!SPIFFS.exists(path)) return false;
+		File file = SPIFFS.open(path, "r");
+		if (this->checkTransfer(file)) this->sendFile(file, this->contentType(path));
+		return true;
+	}
+
+	// prefer the compressed variant if the client accepts it
+	int variant = (f->exists[1] && (!f->exists[0] ||
+			strstr(this->findHeader("Accept-Encoding"), "gzip"))) ? 1 : 0;
+	char etag[16];
+	snprintf(etag, sizeof(etag), "\"%08x%s\"", f->etag[variant], variant ? "gz" : "");
+
+	// the page itself is revalidated on every load, everything it references is cached
+	const char *extension = strrchr(path, '.');
+	bool html = extension && strcmp(extension, ".html") == 0;
+
+	// open the file first, a busy reply must not carry the validators
+	PGM_P type = this->contentType(path);
+	bool modified = strcmp(this->findHeader("If-None-Match"), etag) != 0;
+	File file;
+	if (modified)
+	{
+		if (variant) strcat(path, ".gz");
+		file = SPIFFS.open(path, "r");
+		if (!file) return false;
+		if (!this->checkTransfer(file)) return true;
+	}
+
+	this->server->sendHeader("ETag", etag);
+	this->server->sendHeader("Cache-Control", html ? "no-cache" : "max-age=604800");
+	if (f->exists[0] && f->exists[1]) this->server->sendHeader("Vary", "Accept-Encoding");
+
+	if (!modified)
+	{
+		this->respond(304, PSTR("text/plain"), "", 0);
+		return true;
+	}
+
+	this->sendFile(file, type);
+	return true;
 }
 
 //---------------------------------------------------------------------------------------
-// handleSetNtpServer
+// hashFile
 //
-// Sets a new IP address for the NTP client
+// Calculates the FNV-1a hash of the content of a file
 //
-// -> --
-// <- --
+// -> file: opened file, read until the end
+// <- hash
 //---------------------------------------------------------------------------------------
-void WebServerClass::handleSetNtpServer()
+uint32_t WebServerClass::hashFile(File &file)
 {
-	if (this->server->hasArg("ip"))
+	uint8_t buf[128];
+	uint32_t hash = 2166136261UL;
+	size_t n;
+	while ((n = file.read(buf, sizeof(buf))) > 0)
 	{
-		IPAddress ip;
-		if (ip.fromString(this->server->arg("ip")))
-		{
-			// set IP address in config
-			Config.ntpserver = ip;
-			Config.save();
-
-			// set IP address in client
-			NTP.setServer(ip);
-		}
+		for (size_t i = 0; i < n; i++) hash = (hash ^ buf[i]) * 16777619UL;
 	}
-	this->server->send(200, "application/json", "OK");
+	return hash;
 }
 
 //---------------------------------------------------------------------------------------
-// handleInfo
+// indexFiles
 //
-// Handles requests to "/info", replies with JSON structure containing system status
+// Builds the index of files in the flash file system with the entity tags of the plain
+// and the gzip compressed variant of each file
 //
 // -> --
 // <- --
 //---------------------------------------------------------------------------------------
-void WebServerClass::handleInfo()
+void WebServerClass::indexFiles()
 {
-	StaticJsonBuffer<512> jsonBuffer;
-	char buf[512];
-	JsonObject& json = jsonBuffer.createObject();
-	json["heap"] = ESP.getFreeHeap();
-	json["sketchsize"] = ESP.getSketchSize();
-	json["sketchspace"] = ESP.getFreeSketchSpace();
-	json["cpufrequency"] = ESP.getCpuFreqMHz();
-	json["chipid"] = ESP.getChipId();
-	json["sdkversion"] = ESP.getSdkVersion();
-	json["bootversion"] = ESP.getBootVersion();
-	json["bootmode"] = ESP.getBootMode();
-	json["flashid"] = ESP.getFlashChipId();
-	json["flashspeed"] = ESP.getFlashChipSpeed();
-	json["flashsize"] = ESP.getFlashChipRealSize();
-	json["resetreason"] = ESP.getResetReason();
-	json["resetinfo"] = ESP.getResetInfo();
-//	switch(LED.getMode())
-//	{
-//	case DisplayMode::plain:
-//		json["mode"] = "plain"; break;
-//	case DisplayMode::fade:
-//		json["mode"] = "fade"; break;
-//	case DisplayMode::flyingLettersVertical:
-//		json["mode"] = "flyingLettersVertical"; break;
-//	case DisplayMode::matrix:
-//		json["mode"] = "matrix"; break;
-//	case DisplayMode::heart:
-//		json["mode"] = "heart"; break;
-//	case DisplayMode::stars:
-//		json["mode"] = "stars"; break;
-//	case DisplayMode::red:
-//		json["mode"] = "red"; break;
-//	case DisplayMode::green:
-//		json["mode"] = "green"; break;
-//	case DisplayMode::blue:
-//		json["mode"] = "blue"; break;
-//	case DisplayMode::yellowHourglass:
-//		json["mode"] = "yellowHourglass"; break;
-//	case DisplayMode::greenHourglass:
-//		json["mode"] = "greenHourglass"; break;
-//	case DisplayMode::update:
-//		json["mode"] = "update"; break;
-//	case DisplayMode::updateComplete:
-//		json["mode"] = "updateComplete"; break;
-//	case DisplayMode::updateError:
-//		json["mode"] = "updateError"; break;
-//	case DisplayMode::wifiManager:
-//		json["mode"] = "wifiManager"; break;
-//	default:
-//		json["mode"] = "unknown"; break;
-//	}
-
-	json.printTo(buf, sizeof(buf));
-	this->server->send(200, "application/json", buf);
+	this->fileCount = 0;
+	Dir dir = SPIFFS.openDir("/");
+	while (dir.next())
+	{
+		// only runs once in begin(), so the file names may be Strings
+		String name = dir.fileName();
+		int variant = name.endsWith(".gz") ? 1 : 0;
+		if (variant) name = name.substring(0, name.length() - 3);
+		if (name.length() >= STATIC_PATH_MAX) continue;
+
+		static_file *f = (static_file*) this->findFile(name.c_str());
+		if (!f)
+		{
+			if (this->fileCount >= STATIC_FILES_MAX) continue;
+			f = &this->files[this->fileCount++];
+			memset(f, 0, sizeof(static_file));
+			name.toCharArray(f->path, sizeof(f->path));
+		}
+
+		File file = dir.openFile("r");
+		f->etag[variant] = hashFile(file);
+		f->exists[variant] = true;
+		file.close();
+	}
 }
 
 //---------------------------------------------------------------------------------------
-// extractColor
+// findFile
 //
-// Converts the given web server argument to a color struct
-// -> argName: Name of the web server argument
-//	result: Pointer to palette_entry struct to receive result
-// <- --
+// -> path: name of the file without ".gz"
+// <- index entry of the file, NULL if the file is not indexed
 //---------------------------------------------------------------------------------------
-void WebServerClass::extractColor(String argName, palette_entry& result)
+const static_file *WebServerClass::findFile(const char *path)
 {
-	char c[3];
-
-	if (this->server->hasArg(argName) && this->server->arg(argName).length() == 6)
+	for (int i = 0; i < this->fileCount; i++)
 	{
-		String color = this->server->arg(argName);
-		color.substring(0, 2).toCharArray(c, sizeof(c));
-		result.r = strtol(c, NULL, 16);
-		color.substring(2, 4).toCharArray(c, sizeof(c));
-		result.g = strtol(c, NULL, 16);
-		color.substring(4, 6).toCharArray(c, sizeof(c));
-		result.b = strtol(c, NULL, 16);
+		if (strcmp(this->files[i].path, path) == 0) return &this->files[i];
 	}
+	return NULL;
 }
 
 //---------------------------------------------------------------------------------------
-// handleSetColor
+// contentType
 //
-// Handles the "/setcolor" request, expects arguments:
-//	/setcolor?fg=xxxxxx&bg=yyyyyy&s=zzzzzz
-//	with xxxxxx, yyyyyy and zzzzzz being hexadecimal HTML colors (without leading '#')
+// Returns an HTML content type based on a given file name extension
 //
-// -> --
-// <- --
+// -> filename: name of the file
+// <- HTML content type matching file extension, resides in PROGMEM
 //---------------------------------------------------------------------------------------
-void WebServerClass::handleSetColor()
+PGM_P WebServerClass::contentType(const char *filename)
 {
-	this->extractColor("fg", Config.fg);
-	this->extractColor("bg", Config.bg);
-	this->extractColor("s", Config.s);
-	this->server->send(200, "text/plain", "OK");
-	Config.saveDelayed();
+	if (this->findArg("download")) return PSTR("application/octet-stream");
+
+	const char *extension = strrchr(filename, '.');
+	if (extension)
+	{
+		for (uint32_t i = 0; i < sizeof(mimeTypes) / sizeof(mimeTypes[0]); i++)
+		{
+			if (strcmp_P(extension + 1, mimeTypes[i].extension) == 0) return mimeTypes[i].type;
+		}
+	}
+	return PSTR("text/plain");
 }
 
 //---------------------------------------------------------------------------------------
-// handleSaveConfig
+// handleM
 //
-// Saves the current configuration to EEPROM
+// Handles the /m request, increments the minutes counter (for testing purposes)
 //
 // -> --
 // <- --
 //---------------------------------------------------------------------------------------
-void WebServerClass::handleSaveConfig()
+void WebServerClass::handleM()
 {
-	Config.save();
-	this->server->send(200, "text/plain", "OK");
+	clock_time_t time;
+	Clock.getLocalTime(time);
+	Clock.adjust(time.m == 59 ? -59 * 60 : 60);
+	this->sendText(200, "OK");
 }
 
 //---------------------------------------------------------------------------------------
-// handleLoadConfig
+// handleH
 //
-// Loads the current configuration from EEPROM
+// Handles the /h request, increments the hours counter (for testing purposes)
 //
 // -> --
 // <- --
 //---------------------------------------------------------------------------------------
-void WebServerClass::handleLoadConfig()
+void WebServerClass::handleH()
+{
+	clock_time_t time;
+	Clock.getLocalTime(time);
+	Clock.adjust(time.h == 23 ? -23 * 3600 : 3600);
+	this->sendText(200, "OK");
+}
+
+//---------------------------------------------------------------------------------------
+// handleR
+//
+// Handles the /r request, sets LED matrix to all red (for testing purposes)
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleR()
+{
+	LED.setMode(DisplayMode::red);
+	this->sendText(200, "OK");
+}
+
+//---------------------------------------------------------------------------------------
+// handleG
+//
+// Handles the /g request, sets LED matrix to all green (for testing purposes)
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleG()
+{
+	LED.setMode(DisplayMode::green);
+	this->sendText(200, "OK");
+}
+
+//---------------------------------------------------------------------------------------
+// handleB
+//
+// Handles the /b request, sets LED matrix to all blue (for testing purposes)
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleB()
+{
+	LED.setMode(DisplayMode::blue);
+	this->sendText(200, "OK");
+}
+
+void WebServerClass::handleSetBrightness()
+{
+	if(this->findArg("value"))
+	{
+		Brightness.brightnessOverride = this->getIntArg("value", 0);
+		this->sendText(200, "OK");
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// handleDebug
+//
+// Handles the /debug request. Enters debug mode and sets a single LED in chain order
+// (led, r, g, b), starts a test pattern (pattern=chase|ramp|white|walk|none), clears
+// all LEDs (clear) or returns to the clock (end).
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleDebug()
+{
+	static const char *const patterns[] = {"none", "chase", "ramp", "white", "walk"};
+	char pattern[8];
+	if(this->getArg("pattern", pattern, sizeof(pattern)))
+	{
+		int i = sizeof(patterns) / sizeof(patterns[0]) - 1;
+		while(i >= 0 && strcmp(pattern, patterns[i]) != 0) i--;
+		if(i < 0)
+		{
+			this->sendText(400, "Unknown pattern");
+			return;
+		}
+		LED.setDiagnostic((DiagnosticPattern) i);
+	}
+
+	if(this->findArg("led") &&
+			   this->findArg("r") &&
+			   this->findArg("g") &&
+			   this->findArg("b"))
+	{
+		int led = this->getIntArg("led", 0);
+		int r = this->getIntArg("r", 0);
+		int g = this->getIntArg("g", 0);
+		int b = this->getIntArg("b", 0);
+		if(led < 0) led = 0;
+		if(led >= NUM_PIXELS) led = NUM_PIXELS - 1;
+		if(r < 0) r = 0;
+		if(r > 255) r = 255;
+		if(g < 0) g = 0;
+		if(g > 255) g = 255;
+		if(b < 0) b = 0;
+		if(b > 255) b = 255;
+
+		LED.currentValues[led*3+0] = r;
+		LED.currentValues[led*3+1] = g;
+		LED.currentValues[led*3+2] = b;
+		LED.setDiagnostic(DiagnosticPattern::none);
+		LED.show();
+		Config.debugMode = 1;
+	}
+
+	if(this->findArg("clear"))
+	{
+		LED.setDiagnostic(DiagnosticPattern::none);
+		for(int i=0; i<3*NUM_PIXELS; i++) LED.currentValues[i] = 0;
+		LED.show();
+	}
+
+	if(this->findArg("end"))
+	{
+		LED.setDiagnostic(DiagnosticPattern::none);
+		Config.debugMode = 0;
+	}
+	this->sendText(200, "OK");
+}
+
+//---------------------------------------------------------------------------------------
+// receivePixels
+//
+// Decodes the next part of the body of a /pixels request into pixelFrame. The body is
+// read raw because ESP8266WebServer cuts the "plain" argument off at the first zero
+// byte, which every frame with a dark channel contains.
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::receivePixels()
+{
+	HTTPRaw &raw = this->server->raw();
+	if (raw.status == RAW_START)
+	{
+		this->pixelBinary = strncmp(this->findHeader("Content-Type"),
+				"application/octet-stream", 24) == 0;
+		this->pixelLength = 0;
+		this->pixelValid = true;
+		return;
+	}
+	if (raw.status == RAW_ABORTED) this->pixelValid = false;
+	if (raw.status != RAW_WRITE) return;
+
+	size_t size = this->pixelBinary ? NUM_PIXELS * 3 : NUM_PIXELS * 6;
+	for (size_t i = 0; i < raw.currentSize; i++, this->pixelLength++)
+	{
+		// longer bodies are only counted
+		if (this->pixelLength >= size) continue;
+		uint8_t c = raw.buf[i];
+		if (this->pixelBinary)
+		{
+			this->pixelFrame[this->pixelLength] = c;
+			continue;
+		}
+
+		if (!isxdigit(c)) this->pixelValid = false;
+		uint8_t nibble = (c <= '9') ? c - '0' : (c | 0x20) - 'a' + 10;
+		if (this->pixelLength & 1) this->pixelFrame[this->pixelLength / 2] |= nibble;
+		else this->pixelFrame[this->pixelLength / 2] = nibble << 4;
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// handlePixels
+//
+// Handles the /pixels POST request. Sets all LEDs at once from the request body, either
+// NUM_PIXELS * 3 raw bytes (Content-Type: application/octet-stream) or the same as
+// hexadecimal string, and enters debug mode. Pixels are in chain order and sent to the
+// LEDs uncalibrated, with order=display they are in display order and calibrated.
+// The body has already been decoded by receivePixels().
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handlePixels()
+{
+	uint32_t size = this->pixelBinary ? NUM_PIXELS * 3 : NUM_PIXELS * 6;
+	size_t length = this->pixelLength;
+	this->pixelLength = 0;
+
+	if(!this->pixelValid || length != size)
+	{
+		this->append("Expected %u %s", size, this->pixelBinary ? "bytes" : "hex digits");
+		this->respond(400, PSTR("text/plain"), this->response, this->responseLength);
+		return;
+	}
+
+	LED.setDiagnostic(DiagnosticPattern::none);
+	if(this->isArg("order", "display"))
+	{
+		for(int i = 0; i < NUM_PIXELS; i++)
+		{
+			LED.setPixel(i, this->pixelFrame[i * 3 + 0], this->pixelFrame[i * 3 + 1],
+					this->pixelFrame[i * 3 + 2]);
+		}
+	}
+	else
+	{
+		memcpy(LED.currentValues, this->pixelFrame, sizeof(this->pixelFrame));
+	}
+	LED.show();
+	Config.debugMode = 1;
+	this->sendText(200, "OK");
+}
+
+void WebServerClass::handleGetADC()
+{
+	// filtered value with two decimals
+	uint32_t value = (Brightness.avg * 100 + (1 << (BRIGHTNESS_AVG_SHIFT - 1)))
+			>> BRIGHTNESS_AVG_SHIFT;
+	this->append("%u.%02u", value / 100, value % 100);
+	this->respond(200, PSTR("text/plain"), this->response, this->responseLength);
+}
+
+//---------------------------------------------------------------------------------------
+// handleSetTimeZone
+//
+// Handles the /settimezone request. Saves the time zone
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleSetTimeZone()
+{
+	int newTimeZone = -999;
+	if(this->findArg("value"))
+	{
+		newTimeZone = this->getIntArg("value", 0);
+		if(newTimeZone < - 12 || newTimeZone > 14)
+		{
+			this->sendText(400, "ERR");
+		}
+		else
+		{
+			Config.timeZone = newTimeZone;
+			Config.saveDelayed();
+			NTP.setTimeZone(Config.timeZone);
+			this->sendText(200, "OK");
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// handleGetTimeZone
+//
+// Handles the /gettimezone request, delivers offset to UTC in hours.
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleGetTimeZone()
+{
+	this->append("%d", Config.timeZone);
+	this->respond(200, PSTR("text/plain"), this->response, this->responseLength);
+}
+
+//---------------------------------------------------------------------------------------
+// handleSetMode
+//
+// Handles the /setmode request. Sets the display mode to one of the allowed values,
+// saves it as the new default mode.
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleSetMode()
+{
+	DisplayMode mode = DisplayMode::invalid;
+
+	char value[2];
+	if(this->getArg("value", value, sizeof(value)) && isdigit(value[0]))
+	{
+		mode = modeFromIndex(value[0] - '0');
+	}
+
+	if(mode == DisplayMode::invalid)
+	{
+		this->sendText(400, "ERR");
+	}
+	else
+	{
+		LED.setMode(mode);
+		Config.defaultMode = mode;
+		Config.saveDelayed();
+		this->sendText(200, "OK");
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// handleGetMode
+//
+// Handles the /getmode request and returns the current default display mode.
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleGetMode()
+{
+	this->append("%d", modeToIndex(Config.defaultMode));
+	this->respond(200, PSTR("text/plain"), this->response, this->responseLength);
+}
+
+//---------------------------------------------------------------------------------------
+// handleNotFound
+//
+// Handles all requests not bound to other handlers, tries to serve a file if found in
+// flash, responds with 404 otherwise
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleNotFound()
+{
+	// first, try to serve the requested file from flash
+	char uri[STATIC_PATH_MAX];
+	this->server->uri().toCharArray(uri, sizeof(uri));
+	if (this->server->uri().length() < sizeof(uri) && serveFile(uri)) return;
+
+	// create 404 message if no file was found for this URI
+	this->append("File Not Found\n\nURI: %s\nMethod: %s\nArguments: %d\n",
+			this->server->uri().c_str(),
+			(this->server->method() == HTTP_GET) ? "GET" : "POST", this->server->args());
+	for (int i = 0; i < this->server->args(); i++)
+	{
+		this->append(" %s: %s\n", this->server->argName(i).c_str(),
+				this->server->arg(i).c_str());
+	}
+	this->respond(404, PSTR("text/plain"), this->response, this->responseLength);
+}
+
+//---------------------------------------------------------------------------------------
+// handleGetNtpServer
+//
+// Delivers the currently configured NTP servers (comma separated)
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleGetNtpServer()
+{
+	this->append("%s", Config.ntpServers);
+	this->respond(200, PSTR("application/json"), this->response, this->responseLength);
+}
+
+//---------------------------------------------------------------------------------------
+// handleSetNtpServer
+//
+// Sets new NTP servers for the NTP client, argument "ip" holds a comma separated list
+// of host names or IP addresses, an invalid list is rejected with status 400
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleSetNtpServer()
+{
+	char servers[NTP_SERVER_LIST_SIZE];
+	if (!this->getArg("ip", servers, sizeof(servers)) ||
+			!ConfigClass::isValidNtpServers(servers))
+	{
+		this->sendText(400, "ERR");
+		return;
+	}
+
+	// set servers in config
+	strcpy(Config.ntpServers, servers);
+	Config.saveDelayed();
+
+	// set servers in client
+	NTP.setServers(Config.ntpServers);
+	this->sendText(200, "OK");
+}
+
+//---------------------------------------------------------------------------------------
+// handleInfo
+//
+// Handles requests to "/info", replies with JSON structure containing system status
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleInfo()
+{
+	this->append("{\"heap\":%u,\"sketchsize\":%u,\"sketchspace\":%u,"
+			"\"cpufrequency\":%u,\"chipid\":%u,\"sdkversion\":\"%s\",\"bootversion\":%u,"
+			"\"bootmode\":%u,\"flashid\":%u,\"flashspeed\":%u,\"flashsize\":%u,",
+			ESP.getFreeHeap(), ESP.getSketchSize(), ESP.getFreeSketchSpace(),
+			ESP.getCpuFreqMHz(), ESP.getChipId(), ESP.getSdkVersion(), ESP.getBootVersion(),
+			ESP.getBootMode(), ESP.getFlashChipId(), ESP.getFlashChipSpeed(),
+			ESP.getFlashChipRealSize());
+
+	// same text as ESP.getResetReason() and ESP.getResetInfo() without building Strings
+	const rst_info *reset = ESP.getResetInfoPtr();
+	char reason[sizeof(resetReasons[0])] = "Unknown";
+	if (reset->reason < sizeof(resetReasons) / sizeof(resetReasons[0]))
+		memcpy_P(reason, resetReasons[reset->reason], sizeof(reason));
+	this->append("\"resetreason\":\"%s\",\"resetinfo\":\"", reason);
+	if (reset->reason >= REASON_WDT_RST && reset->reason <= REASON_SOFT_WDT_RST)
+	{
+		this->append("Fatal exception:%u flag:%u (%s) epc1:0x%08x epc2:0x%08x epc3:0x%08x "
+				"excvaddr:0x%08x depc:0x%08x", reset->exccause, reset->reason, reason,
+				reset->epc1, reset->epc2, reset->epc3, reset->excvaddr, reset->depc);
+	}
+	else this->append("flag: %u", reset->reason);
+	this->append("\",\"allocations\":%u,", this->allocations);
+
+	// active effect and the arena bytes it holds
+	Effect *effect = LED.effects.current();
+	this->append("\"mode\":\"%s\",\"effectheap\":%u,\"flashtables\":%u,",
+			effect ? effect->name : "none", (uint32_t)LED.effects.memoryInUse(),
+			(uint32_t)effectTablesInFlash());
+
+	// EEPROM configuration store
+	this->append("\"eeprom\":{\"slot\":%d,\"sequence\":%u,\"commits\":%u,"
+			"\"skipped\":%u,\"lastcommitus\":%u,\"maxcommitus\":%u,\"pending\":%s},",
+			Config.activeSlot, Config.sequence, Config.commitCount, Config.skippedCommits,
+			Config.lastCommitTime, Config.maxCommitTime,
+			(Config.delayedWriteTimer > 0 || Config.delayedWriteFlag) ? "true" : "false");
+
+	// UDP pixel input
+	this->append("\"udpstream\":{\"active\":%s,\"packets\":%u,\"frames\":%u,"
+			"\"errors\":%u},", UdpStream.isActive() ? "true" : "false", UdpStream.packets,
+			UdpStream.frames, UdpStream.errors);
+	this->append("\"serialstream\":{\"active\":%s,\"frames\":%u,\"errors\":%u},",
+			SerialStream.isActive() ? "true" : "false", SerialStream.frames,
+			SerialStream.errors);
+
+	// last NTP synchronization, offset and delay in microseconds
+	this->append("\"ntp\":{\"syncs\":%u,\"offset\":%d,\"delay\":%d,\"rejected\":%u},",
+			NTP.syncCount, NTP.lastOffset, NTP.lastDelay, NTP.rejectCount);
+
+	// live preview clients
+	this->append("\"livestream\":{\"clients\":%d,\"sent\":%u,\"dropped\":%u},",
+			LiveStream.clientCount(), LiveStream.framesSent, LiveStream.framesDropped);
+
+	// arena bytes each effect allocates while it is active
+	this->append("\"effects\":{");
+	bool first = true;
+	for(int i = 0; i < NUM_DISPLAY_MODES; i++)
+	{
+		effect = LED.effects.get((DisplayMode)i);
+		if(!effect || !effect->stateSize()) continue;
+		this->append("%s\"%s\":%u", first ? "" : ",", effect->name,
+				(uint32_t)effect->stateSize());
+		first = false;
+	}
+	this->append("}}");
+
+	this->respond(200, PSTR("application/json"), this->response, this->responseLength);
+}
+
+//---------------------------------------------------------------------------------------
+// modeToIndex
+//
+// Converts a display mode to the mode index used by the web interface
+//
+// -> mode: display mode
+// <- index [0...4], 0 for modes which can not be selected
+//---------------------------------------------------------------------------------------
+int WebServerClass::modeToIndex(DisplayMode mode)
+{
+	switch(mode)
+	{
+	case DisplayMode::plain:
+		return 0;
+	case DisplayMode::fade:
+		return 1;
+	case DisplayMode::flyingLettersVerticalUp:
+		return 2;
+	case DisplayMode::flyingLettersVerticalDown:
+		return 3;
+	case DisplayMode::explode:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// modeFromIndex
+//
+// Converts a mode index of the web interface to a display mode
+//
+// -> index: mode index
+// <- display mode, DisplayMode::invalid if the index can not be selected
+//---------------------------------------------------------------------------------------
+DisplayMode WebServerClass::modeFromIndex(int index)
+{
+	// handle each allowed value for safety
+	switch(index)
+	{
+	case 0:
+		return DisplayMode::plain;
+	case 1:
+		return DisplayMode::fade;
+	case 2:
+		return DisplayMode::flyingLettersVerticalUp;
+	case 3:
+		return DisplayMode::flyingLettersVerticalDown;
+	case 4:
+		return DisplayMode::explode;
+	default:
+		return DisplayMode::invalid;
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// parseColor
+//
+// Converts a color string of 6 hex digits (rrggbb)
+//
+// -> s: color string, may be NULL
+//    result: receives the color if the string is valid
+// <- true if the string is valid
+//---------------------------------------------------------------------------------------
+bool WebServerClass::parseColor(const char *s, palette_entry &result)
+{
+	if (!s || strlen(s) != 6 || strspn(s, "0123456789abcdefABCDEF") != 6) return false;
+	uint32_t value = strtoul(s, NULL, 16);
+	result.r = value >> 16;
+	result.g = value >> 8;
+	result.b = value;
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+// stateJson
+//
+// Serializes all settings of the web interface together with the active effect and
+// the number of NTP synchronizations
+//
+// -> buf: target buffer
+//    size: size of the buffer
+// <- length of the JSON string
+//---------------------------------------------------------------------------------------
+size_t WebServerClass::stateJson(char *buf, size_t size)
+{
+	Effect *effect = LED.effects.current();
+	int n = snprintf(buf, size, "{\"bg\":\"%02X%02X%02X\",\"fg\":\"%02X%02X%02X\","
+			"\"s\":\"%02X%02X%02X\",\"ntpserver\":\"%s\",\"timezone\":%d,"
+			"\"mode\":%d,\"heartbeat\":%s,\"effect\":\"%s\",\"ntpsyncs\":%u,"
+			"\"streamtimeout\":%d,\"streamuniverse\":%d}",
+			Config.bg.r, Config.bg.g, Config.bg.b, Config.fg.r, Config.fg.g, Config.fg.b,
+			Config.s.r, Config.s.g, Config.s.b, Config.ntpServers,
+			Config.timeZone, modeToIndex(Config.defaultMode),
+			Config.heartbeat ? "true" : "false", effect ? effect->name : "none",
+			NTP.syncCount, Config.streamTimeout, Config.streamUniverse);
+	if (n < 0) n = 0;
+	return ((size_t)n < size) ? n : size - 1;
+}
+
+//---------------------------------------------------------------------------------------
+// sendState
+//
+// Replies with a JSON structure containing all settings of the web interface
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::sendState()
+{
+	this->responseLength = stateJson(this->response, sizeof(this->response));
+	this->respond(200, PSTR("application/json"), this->response, this->responseLength);
+}
+
+//---------------------------------------------------------------------------------------
+// handleApiPreview
+//
+// Handles requests to "/api/preview?bg=rrggbb&fg=rrggbb&s=rrggbb" sent while a color
+// is picked. The colors are shown with the next frame without changing or saving the
+// configuration; "/api/update" with the final colors ends the preview, so does
+// "cancel=1" or LIVE_PREVIEW_TIMEOUT without further colors.
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleApiPreview()
+{
+	static const char *names[3] = {"bg", "fg", "s"};
+	palette_entry colors[3];
+	int mask = 0;
+
+	for (int i = 0; i < 3; i++)
+	{
+		const char *value = this->findArg(names[i]);
+		if (!value) continue;
+		if (!parseColor(value, colors[i]))
+		{
+			this->sendText(400, "ERR");
+			return;
+		}
+		mask |= 1 << i;
+	}
+
+	if (this->findArg("cancel")) LED.endPreview();
+	for (int i = 0; i < 3; i++)
+	{
+		if (mask & (1 << i)) LED.previewColor(i, colors[i]);
+	}
+	this->sendText(200, "OK");
+}
+
+//---------------------------------------------------------------------------------------
+// handleEvents
+//
+// Handles requests to "/events?fps=<n>", hands the connection over to LiveStream which
+// keeps it open as server-sent event stream
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleEvents()
+{
+	int fps = this->getIntArg("fps", LIVESTREAM_FPS_DEFAULT);
+	if (!LiveStream.accept(this->server->client(), fps))
+	{
+		this->sendText(503, "ERR");
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// handleApiState
+//
+// Handles requests to "/api/state", replies with all settings of the web interface:
+// {"bg":"rrggbb","fg":"rrggbb","s":"rrggbb","ntpserver":"host[,host...]","timezone":n,
+// "mode":n,"heartbeat":true|false,"streamtimeout":ms,"streamuniverse":n}
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleApiState()
+{
+	this->sendState();
+}
+
+//---------------------------------------------------------------------------------------
+// handleApiUpdate
+//
+// Handles POST requests to "/api/update" with form encoded arguments containing any
+// subset of the fields of "/api/state" (heartbeat as 0 or 1). All fields are checked
+// before any of them is applied, so either all or none of them take effect. The
+// configuration is saved once, delayed.
+// Replies with the resulting state.
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleApiUpdate()
+{
+	palette_entry bg = Config.bg, fg = Config.fg, s = Config.s;
+	DisplayMode mode = Config.defaultMode;
+	int timeZone = Config.timeZone;
+	bool heartbeat = Config.heartbeat;
+	char ntpServers[NTP_SERVER_LIST_SIZE];
+	strcpy(ntpServers, Config.ntpServers);
+	int streamTimeout = Config.streamTimeout;
+	int streamUniverse = Config.streamUniverse;
+	bool colors = this->findArg("bg") || this->findArg("fg") || this->findArg("s");
+	bool valid = true;
+	const char *value;
+
+	if ((value = this->findArg("bg"))) valid &= parseColor(value, bg);
+	if ((value = this->findArg("fg"))) valid &= parseColor(value, fg);
+	if ((value = this->findArg("s"))) valid &= parseColor(value, s);
+	if (this->findArg("mode"))
+	{
+		mode = modeFromIndex(this->getIntArg("mode", 0));
+		valid &= (mode != DisplayMode::invalid);
+	}
+	if (this->findArg("timezone"))
+	{
+		timeZone = this->getIntArg("timezone", 0);
+		valid &= (timeZone >= -12 && timeZone <= 14);
+	}
+	if (this->findArg("heartbeat")) heartbeat = this->isArg("heartbeat", "1");
+	if (this->findArg("ntpserver"))
+	{
+		valid &= this->getArg("ntpserver", ntpServers, sizeof(ntpServers)) &&
+				ConfigClass::isValidNtpServers(ntpServers);
+	}
+	streamTimeout = this->getIntArg("streamtimeout", streamTimeout);
+	streamUniverse = this->getIntArg("streamuniverse", streamUniverse);
+	valid &= ConfigClass::isValidStream(streamTimeout, streamUniverse);
+
+	if (!valid)
+	{
+		this->sendText(400, "ERR");
+		return;
+	}
+
+	Config.bg = bg;
+	Config.fg = fg;
+	Config.s = s;
+	if (colors) LED.endPreview();
+	Config.heartbeat = heartbeat;
+	Config.streamTimeout = streamTimeout;
+	Config.streamUniverse = streamUniverse;
+	if (mode != Config.defaultMode)
+	{
+		Config.defaultMode = mode;
+		LED.setMode(mode);
+	}
+	if (timeZone != Config.timeZone)
+	{
+		Config.timeZone = timeZone;
+		NTP.setTimeZone(timeZone);
+	}
+	if (strcmp(ntpServers, Config.ntpServers) != 0)
+	{
+		strcpy(Config.ntpServers, ntpServers);
+		NTP.setServers(Config.ntpServers);
+	}
+	Config.saveDelayed();
+	this->sendState();
+}
+
+//---------------------------------------------------------------------------------------
+// handleWebStats
+//
+// Handles requests to "/webstats", replies with the worst and the last time spent in
+// process() and the number of requests, average and maximum latency of each route
+// (all times in microseconds)
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleWebStats()
+{
+	char path[WEB_PATH_MAX];
+
+	this->beginChunked("application/json");
+	this->append("{\"maxstall\":%u,\"laststall\":%u,\"allocs\":%u,\"routes\":[",
+			this->maxStall, this->lastStall, this->allocations);
+
+	bool first = true;
+	for (int i = 0; i <= routeCount; i++)
+	{
+		const route_stat &stat = this->stats[i];
+		if (!stat.count) continue;
+		if (i < routeCount) memcpy_P(path, routes[i].path, sizeof(path));
+		else strcpy(path, "*");
+		this->append("%s{\"path\":\"%s\",\"count\":%u,\"avg\":%u,\"max\":%u,"
+				"\"allocs\":%u}", first ? "" : ",", path, stat.count,
+				(uint32_t)(stat.total / stat.count), stat.max, stat.allocs);
+		first = false;
+		this->sendChunk(false);
+	}
+	this->append("]}");
+	this->sendChunk(true);
+}
+
+//---------------------------------------------------------------------------------------
+// handleNtpStats
+//
+// Handles requests to "/ntpstats", replies with the state of the clock discipline
+// (offset, delay and jitter in microseconds, drift in ppb, poll interval in seconds),
+// the configured servers (reach as bit mask of the last 8 requests, delay of the last
+// reply, selected server of the last synchronization) and the history of the last
+// synchronizations, oldest first, each as
+// [seconds since boot, offset, delay, drift, poll interval, server index]
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleNtpStats()
+{
+	this->beginChunked("application/json");
+	this->append("{\"synchronized\":%s,\"syncs\":%u,\"steps\":%u,\"poll\":%u,"
+			"\"offset\":%d,\"delay\":%d,\"jitter\":%d,\"drift\":%d,\"failures\":%u,"
+			"\"rejected\":%u,\"dropped\":%u,\"selected\":%d,\"servers\":[",
+			Clock.isSynchronized() ? "true" : "false", NTP.syncCount, Clock.steps,
+			NTP.getPollInterval(), NTP.lastOffset, NTP.lastDelay, Clock.jitter,
+			Clock.getDrift(), NTP.failures, NTP.rejectCount, NTP.dropCount,
+			NTP.selectedServer);
+
+	for (int i = 0; i < NTP.serverCount(); i++)
+	{
+		const ntp_server &server = NTP.getServer(i);
+		char ip[16] = "";
+		if (server.resolved)
+		{
+			snprintf(ip, sizeof(ip), "%u.%u.%u.%u", server.ip[0], server.ip[1],
+					server.ip[2], server.ip[3]);
+		}
+		this->append("{\"name\":\"%s\",\"ip\":\"%s\",\"reach\":%u,\"delay\":%d,"
+				"\"denied\":%s}%s", server.name, ip, server.reach, server.answered ? server.delay : -1,
+				server.denied ? "true" : "false", i < NTP.serverCount() - 1 ? "," : "");
+		this->sendChunk(false);
+	}
+	this->append("],\"history\":[");
+
+	for (int age = NTP.historyCount() - 1; age >= 0; age--)
+	{
+		ntp_sample sample = NTP.getSample(age);
+		this->append("[%u,%d,%d,%d,%u,%u]%s", sample.time, sample.offset, sample.delay,
+				sample.drift, 1 << sample.poll, sample.server, age ? "," : "");
+		this->sendChunk(false);
+	}
+	this->append("]}");
+	this->sendChunk(true);
+}
+
+//---------------------------------------------------------------------------------------
+// extractColor
+//
+// Converts the given web server argument to a color struct
+// -> argName: Name of the web server argument
+//	result: Pointer to palette_entry struct to receive result
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::extractColor(const char *argName, palette_entry& result)
+{
+	char color[8];
+	if (this->getArg(argName, color, sizeof(color))) parseColor(color, result);
+}
+
+//---------------------------------------------------------------------------------------
+// handleSetColor
+//
+// Handles the "/setcolor" request, expects arguments:
+//	/setcolor?fg=xxxxxx&bg=yyyyyy&s=zzzzzz
+//	with xxxxxx, yyyyyy and zzzzzz being hexadecimal HTML colors (without leading '#')
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleSetColor()
+{
+	this->extractColor("fg", Config.fg);
+	this->extractColor("bg", Config.bg);
+	this->extractColor("s", Config.s);
+	this->sendText(200, "OK");
+	Config.saveDelayed();
+}
+
+//---------------------------------------------------------------------------------------
+// selectGradient
+//
+// Returns the gradient palette selected by the "name" argument
+//
+// -> --
+// <- pointer to gradient palette in Config, NULL if the name is unknown
+//---------------------------------------------------------------------------------------
+gradient_t *WebServerClass::selectGradient()
+{
+	if (this->isArg("name", "fire")) return &Config.fireGradient;
+	if (this->isArg("name", "plasma")) return &Config.plasmaGradient;
+	return NULL;
+}
+
+//---------------------------------------------------------------------------------------
+// handleGetPalette
+//
+// Handles the "/getpalette?name=fire|plasma" request, outputs the color stops of the
+// gradient palette in the format accepted by /setpalette
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleGetPalette()
+{
+	gradient_t *gradient = this->selectGradient();
+	if (!gradient)
+	{
+		this->sendText(400, "ERR");
+		return;
+	}
+
+	for (int i = 0; i < gradient->count; i++)
+	{
+		this->append("%s%u:%02x%02x%02x", i ? "," : "", gradient->stops[i].pos,
+				gradient->stops[i].color.r, gradient->stops[i].color.g,
+				gradient->stops[i].color.b);
+	}
+	this->respond(200, PSTR("text/plain"), this->response, this->responseLength);
+}
+
+//---------------------------------------------------------------------------------------
+// handleSetPalette
+//
+// Handles the "/setpalette" request, expects arguments:
+//	/setpalette?name=fire&stops=0:000000,63:ff0000,127:ffff00,255:ffffff
+//	with name being "fire" or "plasma" and stops being a comma separated list of up to
+//	MAX_GRADIENT_STOPS palette indexes (0...255, ascending) with hexadecimal HTML colors
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleSetPalette()
+{
+	gradient_t *gradient = this->selectGradient();
+	gradient_t result;
+	result.count = 0;
+
+	// "255:rrggbb," per stop
+	char stops[MAX_GRADIENT_STOPS * 11 + 1];
+	bool valid = this->getArg("stops", stops, sizeof(stops));
+	char *p = stops, *end;
+	long pos;
+	uint32_t color;
+	while (gradient && valid && *p && result.count < MAX_GRADIENT_STOPS)
+	{
+		pos = strtol(p, &end, 10);
+		if (end == p || *end != ':' || pos < 0 || pos > 255) break;
+		p = end + 1;
+		if (strspn(p, "0123456789abcdefABCDEF") != 6) break;
+		color = strtoul(p, &end, 16);
+		if (*end && *end != ',') break;
+
+		result.stops[result.count].pos = pos;
+		result.stops[result.count].color = {
+			(uint8_t)(color >> 16), (uint8_t)(color >> 8), (uint8_t)color};
+		result.count++;
+		p = *end ? end + 1 : end;
+	}
+
+	if (!gradient || !valid || *p || !ConfigClass::isValidGradient(result))
+	{
+		this->sendText(400, "ERR");
+		return;
+	}
+
+	*gradient = result;
+	Config.paletteVersion++;
+	Config.saveDelayed();
+	this->sendText(200, "OK");
+}
+
+//---------------------------------------------------------------------------------------
+// handleGetCalibration
+//
+// Handles the "/getcalibration" request, replies with JSON structure containing the
+// calibration profiles and the profile index of each LED in chain order
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleGetCalibration()
+{
+	this->append("{\"profiles\":[");
+	for (int i = 0; i < NUM_CALIBRATION_PROFILES; i++)
+	{
+		calibration_profile &p = Config.calibration[i];
+		this->append("%s{\"curve\":%u,\"gain\":[%u,%u,%u],\"offset\":[%d,%d,%d]}",
+				i ? "," : "", p.curve, p.gain[0], p.gain[1], p.gain[2],
+				p.offset[0], p.offset[1], p.offset[2]);
+	}
+
+	this->append("],\"leds\":\"");
+	for (int i = 0; i < NUM_PIXELS; i++) this->append("%c", '0' + Config.ledProfile[i]);
+	this->append("\"}");
+
+	this->respond(200, PSTR("application/json"), this->response, this->responseLength);
+}
+
+//---------------------------------------------------------------------------------------
+// handleSetCalibration
+//
+// Handles the "/setcalibration" request, expects arguments:
+//	/setcalibration?profile=n[&curve=c][&gain=r,g,b][&offset=r,g,b][&leds=first-last]
+//	with n being the profile index (0...NUM_CALIBRATION_PROFILES-1), c the brightness
+//	curve (LED type), gain in 1/128 steps (128 = 1.0) and offset in -128...127. leds
+//	assigns the profile to a single LED or a range of LEDs in chain order, e. g. to
+//	compensate the voltage drop at the end of the chain. Use /debug to light single
+//	LEDs while measuring.
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleSetCalibration()
+{
+	int profile = this->getIntArg("profile", -1);
+	if (profile < 0 || profile >= NUM_CALIBRATION_PROFILES)
+	{
+		this->sendText(400, "ERR");
+		return;
+	}
+
+	calibration_profile p = Config.calibration[profile];
+	int values[3];
+	bool ok = true;
+	const char *value;
+
+	if (this->findArg("curve"))
+	{
+		int curve = this->getIntArg("curve", 0);
+		if (curve < 0 || curve >= NUM_BRIGHTNESS_CURVES) ok = false;
+		else p.curve = curve;
+	}
+	if ((value = this->findArg("gain")))
+	{
+		if (sscanf(value, "%d,%d,%d",
+				&values[0], &values[1], &values[2]) != 3) ok = false;
+		for (int c = 0; ok && c < 3; c++)
+		{
+			if (values[c] < 0 || values[c] > 255) ok = false;
+			else p.gain[c] = values[c];
+		}
+	}
+	if ((value = this->findArg("offset")))
+	{
+		if (sscanf(value, "%d,%d,%d",
+				&values[0], &values[1], &values[2]) != 3) ok = false;
+		for (int c = 0; ok && c < 3; c++)
+		{
+			if (values[c] < -128 || values[c] > 127) ok = false;
+			else p.offset[c] = values[c];
+		}
+	}
+
+	int first = -1, last = -1;
+	if ((value = this->findArg("leds")))
+	{
+		int n = sscanf(value, "%d-%d", &first, &last);
+		if (n == 1) last = first;
+		if (n < 1 || first < 0 || last < first || last >= NUM_PIXELS) ok = false;
+	}
+
+	if (!ok)
+	{
+		this->sendText(400, "ERR");
+		return;
+	}
+
+	Config.calibration[profile] = p;
+	for (int i = first; i >= 0 && i <= last; i++) Config.ledProfile[i] = profile;
+	LED.loadCalibration();
+	Config.saveDelayed();
+	this->sendText(200, "OK");
+}
+
+//---------------------------------------------------------------------------------------
+// handleGetPower
+//
+// Handles the "/getpower" request, replies with JSON structure containing the estimated
+// supply current and the state of the power limiter
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleGetPower()
+{
+	this->append("{\"current\":%d,\"demand\":%d,\"budget\":%d,\"limit\":%d,"
+			"\"limiting\":%s,\"channel\":[%u,%u,%u]}",
+			LED.getCurrent(), LED.getDemand(), Config.powerBudget, LED.getPowerLimit(),
+			LED.getPowerLimit() < 256 ? "true" : "false", Config.channelCurrent[0],
+			Config.channelCurrent[1], Config.channelCurrent[2]);
+	this->respond(200, PSTR("application/json"), this->response, this->responseLength);
+}
+
+//---------------------------------------------------------------------------------------
+// handleSetPower
+//
+// Handles the "/setpower" request, expects arguments:
+//	/setpower?budget=x[&channel=r,g,b]
+//	with x being the supply current budget in mA (0 = unlimited) and r, g, b the
+//	current of a single LED channel at full intensity in mA
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleSetPower()
+{
+	int budget = this->getIntArg("budget", Config.powerBudget);
+	const char *channel = this->findArg("channel");
+	int values[3];
+	uint8_t current[3];
+	memcpy(current, Config.channelCurrent, sizeof(current));
+
+	if (channel)
+	{
+		if (sscanf(channel, "%d,%d,%d",
+				&values[0], &values[1], &values[2]) != 3 ||
+				values[0] < 1 || values[0] > 255 || values[1] < 1 || values[1] > 255 ||
+				values[2] < 1 || values[2] > 255)
+		{
+			this->sendText(400, "ERR");
+			return;
+		}
+		for (int c = 0; c < 3; c++) current[c] = values[c];
+	}
+	if (!ConfigClass::isValidPower(budget, current))
+	{
+		this->sendText(400, "ERR");
+		return;
+	}
+
+	memcpy(Config.channelCurrent, current, sizeof(current));
+	Config.powerBudget = budget;
+	Config.saveDelayed();
+	this->sendText(200, "OK");
+}
+
+//---------------------------------------------------------------------------------------
+// handleGetLightCurve
+//
+// Handles the "/getlightcurve" request, outputs the points of the ambient light curve
+// in the format accepted by /setlightcurve
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleGetLightCurve()
+{
+	for (int i = 0; i < Config.lightCurve.count; i++)
+	{
+		this->append("%s%u:%u", i ? "," : "", Config.lightCurve.points[i].adc,
+				Config.lightCurve.points[i].brightness);
+	}
+	this->respond(200, PSTR("text/plain"), this->response, this->responseLength);
+}
+
+//---------------------------------------------------------------------------------------
+// handleSetLightCurve
+//
+// Handles the "/setlightcurve" request, expects one of the arguments:
+//	/setlightcurve?points=0:160,300:96,680:64,800:32,900:15,1023:15
+//		replaces the curve with up to MAX_LIGHT_POINTS pairs of ADC value [0...1023]
+//		and brightness [0...256] in ascending ADC order
+//	/setlightcurve?add=x
+//		pairs the current filtered ADC value (see /getadc) with brightness x, replaces
+//		a point close to that ADC value or inserts a new one
+//	/setlightcurve?reset
+//		restores the default curve
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleSetLightCurve()
+{
+	light_curve_t curve = Config.lightCurve;
+
+	if (this->findArg("points"))
+	{
+		// "65535:65535," per point
+		char points[MAX_LIGHT_POINTS * 12 + 1];
+		bool valid = this->getArg("points", points, sizeof(points));
+		char *p = points;
+		unsigned int adc, brightness;
+		int n;
+		curve.count = 0;
+		while (valid && *p && curve.count < MAX_LIGHT_POINTS)
+		{
+			if (sscanf(p, "%u:%u%n", &adc, &brightness, &n) != 2) break;
+			if (p[n] && p[n] != ',') break;
+			curve.points[curve.count].adc = adc > 65535 ? 65535 : adc;
+			curve.points[curve.count].brightness = brightness > 65535 ? 65535 : brightness;
+			curve.count++;
+			p += p[n] ? n + 1 : n;
+		}
+		if (!valid || *p) curve.count = 0;
+	}
+	else if (this->findArg("add"))
+	{
+		int adc = Brightness.avg >> BRIGHTNESS_AVG_SHIFT;
+		int brightness = this->getIntArg("add", 0);
+		int i = 0;
+
+		// find the first point at or after the ADC value
+		while (i < curve.count && curve.points[i].adc + 8 < adc) i++;
+		if (i >= curve.count || abs(curve.points[i].adc - adc) > 8)
+		{
+			// no point close to the ADC value, insert a new one
+			if (curve.count >= MAX_LIGHT_POINTS)
+			{
+				this->sendText(400, "ERR");
+				return;
+			}
+			memmove(&curve.points[i + 1], &curve.points[i],
+					(curve.count - i) * sizeof(light_point));
+			curve.count++;
+		}
+		curve.points[i].adc = adc;
+		curve.points[i].brightness = (brightness < 0) ? 65535 : brightness;
+	}
+	else if (this->findArg("reset"))
+	{
+		curve = ConfigClass::defaultLightCurve;
+	}
+
+	if (!ConfigClass::isValidLightCurve(curve))
+	{
+		this->sendText(400, "ERR");
+		return;
+	}
+
+	Config.lightCurve = curve;
+	Brightness.loadCurve();
+	Config.saveDelayed();
+	this->sendText(200, "OK");
+}
+
+//---------------------------------------------------------------------------------------
+// handleLightHistory
+//
+// Handles the "/lighthistory" request, expects arguments:
+//	/lighthistory?level=n[&format=bin]
+//	with n being 0 (1 s records), 1 (1 min records) or 2 (15 min records). Outputs the
+//	records oldest first as CSV with columns age (seconds), min, avg, max (ADC values),
+//	brightness and override. The binary format consists of an 8 byte header ("LH",
+//	level, 0, interval in seconds and record count as little endian uint16) followed
+//	by the light_record structures.
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleLightHistory()
+{
+	int level = this->getIntArg("level", 0);
+	if (level < 0 || level >= LIGHT_HISTORY_LEVELS)
+	{
+		this->sendText(400, "ERR");
+		return;
+	}
+
+	int count = LightHistory.count(level);
+	uint32_t interval = LightHistory.interval(level);
+	light_record r;
+
+	if (this->isArg("format", "bin"))
+	{
+		// the records are sent by continueTransfers(), records added in the meantime
+		// move the older ones by one position, the length stays the same
+		int slot = this->findTransfer();
+		if (slot < 0 && count > 0)
+		{
+			this->server->sendHeader("Retry-After", "1");
+			this->sendText(503, "Busy");
+			return;
+		}
+
+		uint8_t header[8] = {'L', 'H', (uint8_t)level, 0,
+			(uint8_t)interval, (uint8_t)(interval >> 8),
+			(uint8_t)count, (uint8_t)(count >> 8)};
+		this->server->setContentLength(sizeof(header) + count * sizeof(light_record));
+		this->server->send(200, "application/octet-stream", "");
+		WiFiClient client = this->server->client();
+		client.write(header, sizeof(header));
+		if (count == 0) return;
+
+		web_transfer &t = this->transfers[slot];
+		t.client = client;
+		t.historyLevel = level;
+		t.historyAge = count - 1;
+		t.active = true;
+		return;
+	}
+
+	this->beginChunked("text/csv");
+	this->append("age,min,avg,max,brightness,override\n");
+	for (int age = count - 1; age >= 0; age--)
+	{
+		r = LightHistory.get(level, age);
+		this->append("%u,%u,%u,%u,%u,%u\n", (age + 1) * interval, r.min << 2,
+				r.avg << 2, r.max << 2, r.state & 0xFE, r.state & 0x01);
+		this->sendChunk(false);
+	}
+	this->sendChunk(true);
+}
+
+//---------------------------------------------------------------------------------------
+// handleSaveConfig
+//
+// Saves the current configuration to EEPROM
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleSaveConfig()
+{
+	// commit from the main loop instead of blocking the request
+	Config.delayedWriteTimer = 0;
+	Config.delayedWriteFlag = true;
+	this->sendText(200, "OK");
+}
+
+//---------------------------------------------------------------------------------------
+// handleLoadConfig
+//
+// Loads the current configuration from EEPROM
+//
+// -> --
+// <- --
+//---------------------------------------------------------------------------------------
+void WebServerClass::handleLoadConfig()
 {
 	Config.load();
-	this->server->send(200, "text/plain", "OK");
+	LED.loadCalibration();
+	Brightness.loadCurve();
+	this->sendText(200, "OK");
 }
 
 //---------------------------------------------------------------------------------------
@@ -610,9 +2100,9 @@ void WebServerClass::handleLoadConfig()
 //---------------------------------------------------------------------------------------
 void WebServerClass::handleSetHeartbeat()
 {
-	Config.heartbeat = (this->server->hasArg("value") && this->server->arg("value") == "1");
-	Config.save();
-	this->server->send(200, "text/plain", "OK");
+	Config.heartbeat = this->isArg("value", "1");
+	Config.saveDelayed();
+	this->sendText(200, "OK");
 }
 
 //---------------------------------------------------------------------------------------
@@ -625,8 +2115,7 @@ void WebServerClass::handleSetHeartbeat()
 //---------------------------------------------------------------------------------------
 void WebServerClass::handleGetHeartbeat()
 {
-	if(Config.heartbeat) this->server->send(200, "text/plain", "1");
-	else this->server->send(200, "text/plain", "0");
+	this->sendText(200, Config.heartbeat ? "1" : "0");
 }
 
 //---------------------------------------------------------------------------------------
@@ -640,10 +2129,7 @@ void WebServerClass::handleGetHeartbeat()
 //---------------------------------------------------------------------------------------
 void WebServerClass::handleGetColors()
 {
-	String message = String(Config.bg.r) + "," + String(Config.bg.g) + ","
-			+ String(Config.bg.b) + "," + String(Config.fg.r) + ","
-			+ String(Config.fg.g) + "," + String(Config.fg.b) + ","
-			+ String(Config.s.r) + "," + String(Config.s.g) + ","
-			+ String(Config.s.b);
-	this->server->send(200, "text/plain", message);
+	this->append("%u,%u,%u,%u,%u,%u,%u,%u,%u", Config.bg.r, Config.bg.g, Config.bg.b,
+			Config.fg.r, Config.fg.g, Config.fg.b, Config.s.r, Config.s.g, Config.s.b);
+	this->respond(200, PSTR("text/plain"), this->response, this->responseLength);
 }
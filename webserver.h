@@ -21,9 +21,77 @@
 #include <stdint.h>
 #include <ESP8266WiFi.h>
 #include <ESP8266WebServer.h>
+#include <FS.h>
 
 #include "config.h"
 
+// maximum number of files in the flash file system with precomputed entity tags and
+// maximum length of their names
+#define STATIC_FILES_MAX 16
+#define STATIC_PATH_MAX 32
+
+// file in the flash file system, variant 0 is the file itself, variant 1 the gzip
+// compressed copy with ".gz" appended to the name
+typedef struct _static_file
+{
+	char path[STATIC_PATH_MAX];
+	bool exists[2];
+	uint32_t etag[2];
+} static_file;
+
+// maximum number of routes in WebServerClass::routes[] and maximum length of their
+// paths including the terminating zero
+#define WEB_ROUTES_MAX 40
+#define WEB_PATH_MAX 16
+
+// size of the response buffer all replies are formatted in, chunked replies are sent
+// whenever WEB_CHUNK_SIZE bytes have been collected
+#define WEB_RESPONSE_SIZE 1280
+#define WEB_CHUNK_SIZE 1024
+
+// maximum time in microseconds process() spends on file transfers after handling a
+// request, number of files sent in parts at the same time and size of those parts
+#define WEB_TIME_BUDGET 4000
+#define WEB_TRANSFERS_MAX 2
+#define WEB_TRANSFER_CHUNK 512
+
+class WebServerClass;
+typedef void (WebServerClass::*web_handler_t)();
+
+// URI handled by a member function of WebServerClass, the route table resides in
+// PROGMEM and is read with memcpy_P(). If body is set, it receives the raw request
+// body in parts before handler is called, otherwise ESP8266WebServer stores the body
+// as argument "plain".
+typedef struct _web_route
+{
+	char path[WEB_PATH_MAX];
+	HTTPMethod method;
+	web_handler_t handler;
+	web_handler_t body;
+} web_route;
+
+// number of requests, latency of a route in microseconds and number of heap
+// allocations made by its handler
+typedef struct _route_stat
+{
+	uint32_t count;
+	uint64_t total;
+	uint32_t max;
+	uint32_t allocs;
+} route_stat;
+
+// file or light history being sent in parts by WebServerClass::process(), the light
+// history is sent from record historyAge down to the newest record, historyLevel is
+// -1 for a file
+typedef struct _web_transfer
+{
+	WiFiClient client;
+	File file;
+	int historyLevel;
+	int historyAge;
+	bool active;
+} web_transfer;
+
 class WebServerClass
 {
 public:
@@ -31,12 +99,56 @@ public:
 	virtual ~WebServerClass();
 	void begin();
 	void process();
+	static size_t stateJson(char *buf, size_t size);
+
+	// number of heap allocations made by request handlers, expected to stay 0, only
+	// counted if WEB_COUNT_ALLOCATIONS is defined (see webserver.cpp)
+	uint32_t allocations = 0;
 
 private:
 	ESP8266WebServer *server = NULL;
+	static_file files[STATIC_FILES_MAX];
+	int fileCount = 0;
+	static const web_route routes[];
+	static const int routeCount;
+	// one more than the number of routes for handleNotFound()
+	route_stat stats[WEB_ROUTES_MAX + 1];
+	web_transfer transfers[WEB_TRANSFERS_MAX];
+	uint32_t lastStall = 0;
+	uint32_t maxStall = 0;
+	char response[WEB_RESPONSE_SIZE];
+	size_t responseLength = 0;
+
+	// frame received by receivePixels(), number of body bytes, content type and
+	// whether all bytes were valid
+	uint8_t pixelFrame[NUM_PIXELS * 3];
+	size_t pixelLength = 0;
+	bool pixelBinary = false;
+	bool pixelValid = false;
 
-	String contentType(String filename);
-	bool serveFile(String path);
+	PGM_P contentType(const char *filename);
+	bool serveFile(const char *uri);
+	void indexFiles();
+	void dispatch(int route);
+	void receiveBody(int route);
+	void clearResponse();
+	void append(const char *format, ...) __attribute__((format(printf, 2, 3)));
+	void respond(int code, PGM_P type, const char *content, size_t length);
+	void sendText(int code, const char *text);
+	void beginChunked(const char *type);
+	void sendChunk(bool last);
+	const char *findArg(const char *name);
+	const char *findHeader(const char *name);
+	bool getArg(const char *name, char *buf, size_t size);
+	long getIntArg(const char *name, long fallback);
+	bool isArg(const char *name, const char *value);
+	int findTransfer();
+	bool checkTransfer(File &file);
+	void sendFile(File &file, PGM_P type);
+	void continueTransfers(uint32_t start);
+	static size_t readHistory(web_transfer &t, uint8_t *buf, size_t size);
+	const static_file *findFile(const char *path);
+	static uint32_t hashFile(File &file);
 	void handleSaveConfig();
 	void handleLoadConfig();
 	void handleGetColors();
@@ -55,11 +167,33 @@ private:
 	void handleG();
 	void handleB();
 	void handleDebug();
+	void receivePixels();
+	void handlePixels();
 	void handleSetBrightness();
 	void handleGetADC();
 	void handleGetNtpServer();
 	void handleSetNtpServer();
-	void extractColor(String argName, palette_entry& result);
+	void handleGetPalette();
+	void handleSetPalette();
+	void handleGetCalibration();
+	void handleSetCalibration();
+	void handleGetPower();
+	void handleSetPower();
+	void handleGetLightCurve();
+	void handleSetLightCurve();
+	void handleLightHistory();
+	void handleApiState();
+	void handleApiUpdate();
+	void handleEvents();
+	void handleApiPreview();
+	void handleWebStats();
+	void handleNtpStats();
+	void sendState();
+	void extractColor(const char *argName, palette_entry& result);
+	static bool parseColor(const char *s, palette_entry &result);
+	static int modeToIndex(DisplayMode mode);
+	static DisplayMode modeFromIndex(int index);
+	gradient_t *selectGradient();
 };
 
 extern WebServerClass WebServer;